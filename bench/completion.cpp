@@ -0,0 +1,140 @@
+// Measures building, saving and mapping a 2M entry completion index, and the
+// per-keystroke cost of narrowing it while a value is typed. Also checks that
+// files with offsets or counts that do not fit are refused.
+
+#include "libquest.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace libquest;
+
+#define ENTRIES 2000000
+#define VALUES 1000
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// saves a small index, writes value over the 8 bytes at offset in the file,
+// and reports whether it still loads; a truncated file is made when value is
+// negative
+static bool loads_after(const char *path, size_t offset, int64_t value)
+{
+    completion_index_t({ "ab", "cd", "ef" }).save(path);
+
+    if (value < 0)
+    {
+        truncate(path, offset);
+    }
+    else
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        uint64_t word = value;
+
+        file.seekp(offset);
+        file.write((const char *)&word, sizeof(word));
+    }
+
+    return completion_index_t::load(path) != nullptr;
+}
+
+int main()
+{
+    std::vector<std::string> entries;
+    char buffer[64];
+
+    entries.reserve(ENTRIES);
+
+    for (int i = 0; i < ENTRIES; i++)
+    {
+        snprintf(buffer, sizeof(buffer), "sku-%c%c-%08d", 'a' + i % 26, 'a' + (i / 26) % 26, i);
+        entries.push_back(buffer);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    completion_index_t built(entries);
+    double build_time = elapsed_ms(start);
+
+    char path[] = "/tmp/libquest_completion_XXXXXX";
+    close(mkstemp(path));
+    built.save(path);
+
+    start = std::chrono::steady_clock::now();
+    auto index = completion_index_t::load(path);
+    double load_time = elapsed_ms(start);
+
+    if (!index || index->size() != ENTRIES)
+    {
+        std::cerr << "failed to load the saved index\n";
+
+        return 1;
+    }
+
+    char small_path[] = "/tmp/libquest_completion_XXXXXX";
+    close(mkstemp(small_path));
+
+    // the header is magic, count and data size, followed by the offsets
+    // 0, 2, 4, 6 and the 6 bytes of data
+    bool refused = loads_after(small_path, 8, 3) && !loads_after(small_path, 8, 4) && !loads_after(small_path, 8, INT64_MAX) &&
+                   !loads_after(small_path, 16, 7) && !loads_after(small_path, 32, 7) && !loads_after(small_path, 40, 1) &&
+                   !loads_after(small_path, 48, 5) && !loads_after(small_path, 50, -1);
+
+    unlink(path);
+    unlink(small_path);
+
+    if (!refused)
+    {
+        std::cerr << "loaded an index file that does not fit together\n";
+
+        return 1;
+    }
+
+    double worst = 0;
+    double total = 0;
+    size_t keystrokes = 0;
+
+    for (int v = 0; v < VALUES; v++)
+    {
+        const std::string &target = entries[(v * 7919) % ENTRIES];
+        std::vector<completion_index_t::range_t> ranges { index->all() };
+
+        for (size_t i = 0; i < target.size(); i++)
+        {
+            auto key_start = std::chrono::steady_clock::now();
+
+            ranges.push_back(index->narrow(ranges.back(), i, target[i]));
+
+            // what the prompt would list below the input
+            for (size_t r = ranges.back().begin; r < std::min(ranges.back().end, ranges.back().begin + 5); r++)
+            {
+                if (index->at(r).empty())
+                {
+                    return 1;
+                }
+            }
+
+            double elapsed = elapsed_ms(key_start) * 1000;
+
+            worst = std::max(worst, elapsed);
+            total += elapsed;
+            keystrokes++;
+        }
+
+        if (ranges.back().size() != 1 || index->at(ranges.back().begin) != target)
+        {
+            std::cerr << "did not narrow down to " << target << "\n";
+
+            return 1;
+        }
+    }
+
+    std::cerr << ENTRIES << " entries: built in " << build_time << " ms, mapped in " << load_time << " ms\n"
+              << "per keystroke: " << total / keystrokes << " us mean, " << worst << " us worst\n";
+}
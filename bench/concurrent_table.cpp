@@ -0,0 +1,93 @@
+// Has several threads push rows into a concurrent_table_t as fast as they can
+// while its render thread redraws into a sink that only counts bytes, and
+// reports how long the pushes took, the slowest single push, and how many
+// frames were drawn. Then checks that every row arrived whole and in order.
+// With fewer cores than threads the slowest push includes time spent
+// descheduled, since a push itself never waits.
+
+#include "libquest.h"
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace libquest;
+
+#define PRODUCERS 8
+#define ROWS_PER_PRODUCER 100000
+
+int main()
+{
+    size_t bytes = 0;
+    concurrent_table_t table({ "producer", "row", "check" }, 20, 30, [&](std::string_view piece) { bytes += piece.size(); });
+
+    std::vector<std::thread> producers;
+    std::atomic<int64_t> slowest_push_ns = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int p = 0; p < PRODUCERS; p++)
+    {
+        producers.emplace_back([&, p]()
+        {
+            int64_t slowest = 0;
+
+            for (int i = 0; i < ROWS_PER_PRODUCER; i++)
+            {
+                std::string row = std::to_string(i);
+                auto push_start = std::chrono::steady_clock::now();
+
+                // the last cell repeats the others, so a torn row would show up
+                table.push_row({ std::to_string(p), row, std::to_string(p) + ":" + row });
+
+                slowest = std::max<int64_t>(slowest, (std::chrono::steady_clock::now() - push_start).count());
+            }
+
+            int64_t seen = slowest_push_ns.load();
+
+            while (seen < slowest && !slowest_push_ns.compare_exchange_weak(seen, slowest))
+            {
+            }
+        });
+    }
+
+    for (auto &producer : producers)
+    {
+        producer.join();
+    }
+
+    double push_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    table.stop();
+
+    std::cout << PRODUCERS << " threads pushed " << PRODUCERS * ROWS_PER_PRODUCER << " rows in " << push_ms << " ms, slowest push "
+              << slowest_push_ns.load() / 1000.0 << " us" << std::endl;
+    std::cout << "  " << table.frames() << " frames, " << bytes << " bytes drawn" << std::endl;
+
+    std::vector<int> next(PRODUCERS, 0);
+
+    for (size_t y = 1; y < table.row_count(); y++)
+    {
+        std::string producer, row, check;
+
+        table.write_cell(y, 0, producer);
+        table.write_cell(y, 1, row);
+        table.write_cell(y, 2, check);
+
+        int p = std::stoi(producer);
+
+        if (check != producer + ":" + row || std::stoi(row) != next[p]++)
+        {
+            std::cerr << "row " << y << " is torn or out of order" << std::endl;
+            return 1;
+        }
+    }
+
+    if (table.row_count() != PRODUCERS * ROWS_PER_PRODUCER + 1)
+    {
+        std::cerr << "rows went missing" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,116 @@
+// Fills a table of a million rows with an id column and three columns that
+// only ever hold a few values, once as typed_table_t strings and once as a
+// string_table_t, which keeps the low cardinality columns as dictionary codes.
+// Reports the memory each takes, how long filling it and measuring its
+// columns took, and checks that both draw the same window of rows.
+
+#include "libquest.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace libquest;
+
+#define ROWS 1000000
+#define WINDOW_ROWS 20
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    std::vector<std::string> statuses = { "running", "stopped", "\x1b[31mfailed\x1b[0m", "pending" };
+    std::vector<std::string> regions;
+    std::vector<std::string> host_types;
+
+    for (int i = 0; i < 12; i++)
+    {
+        regions.push_back("region-" + std::to_string(i) + "-north-east");
+    }
+
+    for (int i = 0; i < 30; i++)
+    {
+        host_types.push_back("compute-optimised-" + std::to_string(i) + ".xlarge");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    typed_table_t<std::string, std::string, std::string, std::string> strings({ "id", "status", "region", "host type" });
+
+    strings.reserve(ROWS);
+
+    for (int i = 0; i < ROWS; i++)
+    {
+        strings.append_row("host-" + std::to_string(i), statuses[i * 7 % statuses.size()], regions[i * 13 % regions.size()], host_types[i % host_types.size()]);
+    }
+
+    double strings_fill = elapsed_ms(start);
+    size_t strings_bytes = 0;
+
+    // the strings themselves, and the heap blocks of those too long to be stored inline
+    std::apply([&](const auto &...column)
+    {
+        for (const auto *values : { &column... })
+        {
+            for (const std::string &value : *values)
+            {
+                strings_bytes += sizeof(std::string) + (value.capacity() > 15 ? value.capacity() + 1 : 0);
+            }
+        }
+    }, std::tie(strings.column<0>(), strings.column<1>(), strings.column<2>(), strings.column<3>()));
+
+    start = std::chrono::steady_clock::now();
+    string_table_t encoded({ "id", "status", "region", "host type" });
+
+    encoded.reserve(ROWS);
+
+    for (int i = 0; i < ROWS; i++)
+    {
+        std::string id = "host-" + std::to_string(i);
+
+        encoded.append_row({ id, statuses[i * 7 % statuses.size()], regions[i * 13 % regions.size()], host_types[i % host_types.size()] });
+    }
+
+    double encoded_fill = elapsed_ms(start);
+
+    auto measure = [](const cell_table_t &table)
+    {
+        auto start = std::chrono::steady_clock::now();
+        size_t total = 0;
+
+        for (size_t x = 0; x < table.column_count(); x++)
+        {
+            total += table.column_width(x);
+        }
+
+        return std::pair { total, elapsed_ms(start) };
+    };
+
+    auto [strings_width, strings_measure] = measure(strings);
+    auto [encoded_width, encoded_measure] = measure(encoded);
+
+    std::cout << ROWS << " rows as typed_table_t strings: " << strings_bytes / 1000000.0 << " MB, filled in " << strings_fill << " ms, measured in "
+              << strings_measure << " ms" << std::endl;
+    std::cout << ROWS << " rows as string_table_t: " << encoded.memory_bytes() / 1000000.0 << " MB, filled in " << encoded_fill << " ms, measured in "
+              << encoded_measure << " ms" << std::endl;
+
+    for (size_t x = 0; x < encoded.column_count(); x++)
+    {
+        std::cout << "  column " << x << ": " << (encoded.dictionary_encoded(x) ? std::to_string(encoded.dictionary_size(x)) + " values" : "plain") << std::endl;
+    }
+
+    std::string strings_window, encoded_window;
+
+    strings.render([&](std::string_view piece) { strings_window.append(piece); }, ROWS / 2, WINDOW_ROWS);
+    encoded.render([&](std::string_view piece) { encoded_window.append(piece); }, ROWS / 2, WINDOW_ROWS);
+
+    if (strings_width != encoded_width || strings_window != encoded_window)
+    {
+        std::cerr << "the tables do not draw the same" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+// Fills a history file with 1M entries, then measures reopening it and
+// reverse searching it for recent, old and missing values.
+
+#include "libquest.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace libquest;
+
+#define ENTRIES 1000000
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    char path[] = "/tmp/libquest_history_XXXXXX";
+    char buffer[64];
+
+    close(mkstemp(path));
+    unlink(path);
+
+    {
+        auto history = history_t::open(path, 64 * 1024 * 1024);
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < ENTRIES; i++)
+        {
+            snprintf(buffer, sizeof(buffer), "deploy --region eu-%d --build %08d", i % 7, i);
+            history->append("Command?", buffer);
+        }
+
+        std::cerr << ENTRIES << " appends: " << elapsed_ms(start) << " ms\n";
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto history = history_t::open(path);
+
+    std::cerr << "reopen: " << elapsed_ms(start) << " ms\n";
+
+    const char *queries[] = { "--build 00999990", "--build 00000042", "--build 12345678" };
+
+    for (const char *query : queries)
+    {
+        history_t::cursor_t cursor = history->end();
+        std::string entry;
+
+        start = std::chrono::steady_clock::now();
+
+        bool found = history->search("Command?", query, cursor, entry);
+
+        std::cerr << "search '" << query << "': " << elapsed_ms(start) << " ms, " << (found ? entry : "no match") << "\n";
+    }
+
+    unlink(path);
+}
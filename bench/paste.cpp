@@ -0,0 +1,90 @@
+// Pastes text into ask_multiline with scripted input, the way terminals send
+// it: line breaks as CR, or as CRLF. In both the editor and append mode it
+// checks that a short paste mixing both comes out as the lines it was, then
+// times a 1 MiB paste and checks that none of its lines were lost or run
+// together.
+
+#include "libquest.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace libquest;
+
+#define PASTE_BYTES (1024 * 1024)
+
+#define PASTE_BEGIN "\x1b[200~"
+#define PASTE_END "\x1b[201~"
+#define CTRL_D "\x04"
+
+// replaces stdin with a file holding script and sends the prompts' output to /dev/null
+static void redirect_io(const std::string &script)
+{
+    char path[] = "/tmp/libquest_bench_XXXXXX";
+    int fd = mkstemp(path);
+
+    if (write(fd, script.data(), script.size()) != (ssize_t)script.size())
+    {
+        abort();
+    }
+
+    lseek(fd, 0, SEEK_SET);
+    unlink(path);
+    dup2(fd, STDIN_FILENO);
+    close(fd);
+
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+}
+
+int main()
+{
+    // every other line ends in CRLF, so some of them are split between reads
+    std::string big_paste;
+    size_t big_lines = 0;
+
+    while (big_paste.size() < PASTE_BYTES)
+    {
+        big_paste += "a pasted line of text " + std::to_string(big_lines) + (big_lines % 2 ? "\r\n" : "\r");
+        big_lines++;
+    }
+
+    big_paste += "last";
+
+    // append mode takes the line the paste left open and two blank lines to finish
+    std::string editor_script = PASTE_BEGIN "a\rb\r\nc" PASTE_END CTRL_D PASTE_BEGIN + big_paste + PASTE_END CTRL_D;
+    std::string append_script = PASTE_BEGIN "a\rb\r\nc" PASTE_END "\n\n\n" PASTE_BEGIN + big_paste + PASTE_END "\n\n\n";
+
+    redirect_io(editor_script + append_script);
+
+    for (multiline_mode mode : { MULTILINE_EDITOR, MULTILINE_APPEND })
+    {
+        const char *name = mode == MULTILINE_EDITOR ? "editor" : "append mode";
+        std::string small = ask_multiline("Notes?", {}, mode);
+
+        if (small != "a\nb\nc")
+        {
+            std::cerr << "a short paste in " << name << " came out wrong" << std::endl;
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::string big = ask_multiline("Notes?", {}, mode);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::cerr << name << ": " << big_paste.size() << " bytes pasted in " << ms << " ms" << std::endl;
+
+        if (big.find('\r') != std::string::npos || (size_t)std::count(big.begin(), big.end(), '\n') != big_lines)
+        {
+            std::cerr << "a large paste in " << name << " lost its line breaks" << std::endl;
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+// Updates progress bars and a spinner from several threads as fast as they
+// can go, and reports the update rate along with how few frames and bytes
+// the throttled renderer turned them into.
+
+#include "libquest.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace libquest;
+
+#define WORKERS 4
+#define UPDATES_PER_WORKER 5000000
+
+int main()
+{
+    size_t bytes = 0;
+    progress_t progress(15, [&](std::string_view piece) { bytes += piece.size(); });
+    spinner_t &spinner = progress.add_spinner("working");
+    std::vector<progress_bar_t *> bars;
+    std::vector<std::thread> workers;
+
+    for (int w = 0; w < WORKERS; w++)
+    {
+        bars.push_back(&progress.add_bar("worker " + std::to_string(w), UPDATES_PER_WORKER));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int w = 0; w < WORKERS; w++)
+    {
+        workers.emplace_back([&, w]()
+        {
+            for (int i = 0; i < UPDATES_PER_WORKER; i++)
+            {
+                bars[w]->add();
+                spinner.tick();
+            }
+        });
+    }
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    spinner.finish();
+    progress.stop();
+
+    std::cout << WORKERS * UPDATES_PER_WORKER * 2 << " updates in " << elapsed_ms << " ms, "
+              << WORKERS * UPDATES_PER_WORKER * 2 / elapsed_ms / 1000 << " million/s" << std::endl;
+    std::cout << "  " << progress.frames() << " frames, " << bytes << " bytes drawn" << std::endl;
+}
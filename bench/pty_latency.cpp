@@ -0,0 +1,326 @@
+// Runs prompts under a pseudo terminal and replays scripted key presses into
+// them, the way a terminal emulator would. For every key it measures the time
+// until the prompt has redrawn and gone back to waiting for input, along with
+// the bytes it wrote, and reports percentiles of those and the CPU time the
+// prompt used. Nothing but the pty is needed, so it runs headless.
+
+#include "libquest.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <utmp.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace libquest;
+
+#define SELECT_OPTIONS 10000
+#define SELECT_KEYS 500
+#define INPUT_KEYS 2000
+#define PASTE_BYTES (1024 * 1024)
+
+// how long the output has to stay quiet before the prompt is checked for being idle
+#define IDLE_POLL_MS 1
+
+// a prompt that does not answer a key within this long is taken to be stuck
+#define STUCK_TIMEOUT_MS 10000
+
+using bench_clock = std::chrono::steady_clock;
+
+struct session_t
+{
+    pid_t pid = -1;
+    int master = -1;
+    size_t bytes = 0;
+};
+
+static double to_us(bench_clock::duration duration)
+{
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+// Starts the prompt in a child whose terminal is the slave side of a new pty.
+// The terminal starts out without echo or line buffering, so keys sent before
+// the prompt has switched it to raw mode are not echoed back.
+static session_t start(const std::function<void()> &prompt)
+{
+    session_t session;
+    struct winsize size = { 24, 80, 0, 0 };
+    int slave;
+
+    if (openpty(&session.master, &slave, nullptr, nullptr, &size) < 0)
+    {
+        perror("openpty");
+        exit(1);
+    }
+
+    struct termios attributes;
+
+    tcgetattr(slave, &attributes);
+    attributes.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(slave, TCSANOW, &attributes);
+
+    // nothing buffered may be left to be written twice once the child exits
+    fflush(stdout);
+    session.pid = fork();
+
+    if (session.pid == 0)
+    {
+        close(session.master);
+
+        if (login_tty(slave) < 0)
+        {
+            _exit(1);
+        }
+
+        // exit rather than _exit, so that instrumented builds write out the child's profile
+        prompt();
+        exit(0);
+    }
+
+    close(slave);
+    fcntl(session.master, F_SETFL, fcntl(session.master, F_GETFL) | O_NONBLOCK);
+
+    return session;
+}
+
+// true while the child is blocked, which once its output has gone quiet means it is waiting for a key
+static bool sleeping(pid_t pid)
+{
+    char path[64];
+    char stat[512];
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+    int fd = open(path, O_RDONLY);
+    ssize_t n = fd < 0 ? -1 : read(fd, stat, sizeof(stat) - 1);
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    if (n <= 0)
+    {
+        return false;
+    }
+
+    stat[n] = '\0';
+
+    const char *state = strrchr(stat, ')');
+
+    return state && state[1] == ' ' && state[2] == 'S';
+}
+
+// Drains the child's output while writing data to it, then waits for the
+// frame it causes and sets last_byte to when that frame finished arriving.
+// Returns false once the child has exited.
+static bool send(session_t &session, std::string_view data, bench_clock::time_point &last_byte)
+{
+    char buffer[64 * 1024];
+    bool drawn = false;
+    auto start = bench_clock::now();
+
+    last_byte = start;
+
+    while (true)
+    {
+        struct pollfd pfd = { session.master, POLLIN, 0 };
+
+        if (!data.empty())
+        {
+            pfd.events |= POLLOUT;
+        }
+
+        int ready = poll(&pfd, 1, data.empty() ? IDLE_POLL_MS : -1);
+
+        if (ready < 0 && errno != EINTR)
+        {
+            perror("poll");
+            exit(1);
+        }
+
+        if (pfd.revents & POLLOUT)
+        {
+            ssize_t n = write(session.master, data.data(), data.size());
+
+            if (n > 0)
+            {
+                data.remove_prefix(n);
+            }
+        }
+
+        if (pfd.revents & (POLLIN | POLLHUP))
+        {
+            ssize_t n = read(session.master, buffer, sizeof(buffer));
+
+            if (n <= 0 && errno != EAGAIN)
+            {
+                return false;
+            }
+
+            if (n > 0)
+            {
+                session.bytes += n;
+                last_byte = bench_clock::now();
+                drawn = true;
+            }
+
+            continue;
+        }
+
+        if (ready == 0 && data.empty())
+        {
+            if (drawn && sleeping(session.pid))
+            {
+                return true;
+            }
+
+            if (bench_clock::now() - start > std::chrono::milliseconds(STUCK_TIMEOUT_MS))
+            {
+                std::cerr << "prompt stopped responding" << std::endl;
+                kill(session.pid, SIGKILL);
+                exit(1);
+            }
+        }
+    }
+}
+
+static void print_percentiles(const char *name, std::vector<double> values, const char *unit)
+{
+    if (values.empty())
+    {
+        return;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    auto at = [&](double fraction)
+    {
+        return values[std::min(values.size() - 1, (size_t)(fraction * values.size()))];
+    };
+
+    printf("  %-10s p50 %10.1f  p90 %10.1f  p99 %10.1f  max %10.1f %s\n", name, at(0.5), at(0.9), at(0.99), values.back(), unit);
+}
+
+// Waits for the first frame, sends every key and measures it, then sends the
+// closing key and collects the CPU time of the child once it has exited.
+static void measure(const char *name, const std::function<void()> &prompt, const std::vector<std::string> &keys, const std::string &finish)
+{
+    session_t session = start(prompt);
+    bench_clock::time_point last_byte;
+    std::vector<double> latencies;
+    std::vector<double> bytes;
+
+    send(session, {}, last_byte);
+
+    auto start_time = bench_clock::now();
+
+    for (const std::string &key : keys)
+    {
+        size_t start_bytes = session.bytes;
+        auto sent = bench_clock::now();
+
+        if (!send(session, key, last_byte))
+        {
+            break;
+        }
+
+        latencies.push_back(to_us(last_byte - sent));
+        bytes.push_back(session.bytes - start_bytes);
+    }
+
+    double total_ms = to_us(bench_clock::now() - start_time) / 1000;
+
+    // the answer is printed once the prompt closes, so keep reading until the child is gone
+    if (send(session, finish, last_byte))
+    {
+        while (send(session, {}, last_byte))
+        {
+        }
+    }
+
+    int status;
+    struct rusage usage;
+
+    wait4(session.pid, &status, 0, &usage);
+    close(session.master);
+
+    double cpu_ms = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+
+    printf("%s: %zu keys in %.1f ms, %.1f ms cpu, %zu bytes written\n", name, keys.size(), total_ms, cpu_ms, session.bytes);
+    print_percentiles("latency", latencies, "us");
+    print_percentiles("bytes", bytes, "bytes/key");
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        std::cerr << name << " did not exit cleanly" << std::endl;
+        exit(1);
+    }
+}
+
+int main()
+{
+    std::vector<std::string> options;
+
+    for (int i = 0; i < SELECT_OPTIONS; i++)
+    {
+        options.push_back("option " + std::to_string(i));
+    }
+
+    // holding the down arrow on a long list
+    measure("select, held down arrow", [&]()
+    {
+        ask_select("Pick one", std::span<const std::string>(options));
+    },
+    std::vector<std::string>(SELECT_KEYS, "\x1b[B"), "\r");
+
+    // the same keys arriving all at once, as from key repeat outrunning the prompt
+    std::string burst;
+
+    for (int i = 0; i < SELECT_KEYS; i++)
+    {
+        burst += "\x1b[B";
+    }
+
+    measure("select, burst of down arrows", [&]()
+    {
+        ask_select("Pick one", std::span<const std::string>(options));
+    },
+    { burst }, "\r");
+
+    // typing a long line one key at a time, which scrolls the input sideways
+    measure("input, typed line", []()
+    {
+        ask_input("Name?");
+    },
+    std::vector<std::string>(INPUT_KEYS, "a"), "\r");
+
+    // a single bracketed paste of many lines into the editor
+    std::string paste = "\x1b[200~";
+
+    while (paste.size() < PASTE_BYTES)
+    {
+        paste += "a pasted line of text that is long enough to be realistic " + std::to_string(paste.size()) + "\n";
+    }
+
+    paste += "\x1b[201~";
+
+    measure("multiline editor, 1 MiB paste", []()
+    {
+        ask_multiline("Notes?", {}, MULTILINE_EDITOR);
+    },
+    { paste }, "\x04");
+}
@@ -0,0 +1,228 @@
+// Has a child process write rows into a shared_table_t as fast as it can
+// while this process follows it the way a live viewer would, catching up and
+// drawing the newest rows into a sink that only counts bytes. Reports what a
+// frame cost and checks that every row it drew was whole; rows the writer
+// overwrote while they were being read are counted rather than drawn. Opening
+// the segment is timed while the writer pauses, once after a few rows and
+// once after all of them, and should take as long both times. Creating the
+// segment again while the writer runs has to fail.
+
+#include "libquest.h"
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace libquest;
+
+#define ROWS 2000000
+#define EARLY_ROWS 1000
+#define VISIBLE_ROWS 20
+#define OPENS 100
+#define SEGMENT_NAME "/libquest_bench_shared_table"
+
+static double elapsed_us(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// tells the other process it can go on, and waits until it says the same
+static void handshake(int to, int from)
+{
+    char byte = 'x';
+
+    if (write(to, &byte, 1) != 1 || read(from, &byte, 1) != 1)
+    {
+        exit(1);
+    }
+}
+
+// the median time shared_table_t::open takes
+static double time_open()
+{
+    std::vector<double> times;
+
+    for (int i = 0; i < OPENS; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto table = shared_table_t::open(SEGMENT_NAME);
+
+        times.push_back(elapsed_us(start));
+
+        if (!table)
+        {
+            std::cerr << "could not open the segment" << std::endl;
+            exit(1);
+        }
+    }
+
+    std::sort(times.begin(), times.end());
+
+    return times[times.size() / 2];
+}
+
+static void write_rows(int to, int from)
+{
+    auto table = shared_table_t::create(SEGMENT_NAME, { "host", "row", "check" }, 4 * 1024 * 1024, 64 * 1024);
+
+    if (!table)
+    {
+        perror("shared_table_t::create");
+        exit(1);
+    }
+
+    for (int i = 0; i < ROWS; i++)
+    {
+        if (i == EARLY_ROWS)
+        {
+            handshake(to, from);
+        }
+
+        std::string host = "node-" + std::to_string(i % 97);
+        std::string row = std::to_string(i);
+
+        // the last cell repeats the others, so a torn row would show up
+        table->append_row({ host, row, host + ":" + row });
+    }
+
+    handshake(to, from);
+}
+
+int main()
+{
+    int to_child[2];
+    int to_parent[2];
+
+    if (pipe(to_child) != 0 || pipe(to_parent) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    fflush(stdout);
+
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        write_rows(to_parent[1], to_child[0]);
+        exit(0);
+    }
+
+    char byte;
+
+    // the writer stops after the first rows until it is told to go on
+    if (read(to_parent[0], &byte, 1) != 1)
+    {
+        std::cerr << "the writer did not start" << std::endl;
+        return 1;
+    }
+
+    double early_open_us = time_open();
+
+    // the writer is still running, so its name cannot be taken over
+    errno = 0;
+
+    if (shared_table_t::create(SEGMENT_NAME, { "host" }, 1024, 16) || errno != EEXIST)
+    {
+        std::cerr << "a second writer took the segment over" << std::endl;
+        return 1;
+    }
+
+    auto table = shared_table_t::open(SEGMENT_NAME);
+    size_t bytes = 0;
+    size_t frames = 0;
+    size_t drawn = 0;
+    size_t overwritten = 0;
+    double frame_us = 0;
+    auto sink = [&](std::string_view piece) { bytes += piece.size(); };
+
+    if (write(to_child[1], &byte, 1) != 1)
+    {
+        return 1;
+    }
+
+    // follow the writer until it says it is done
+    while (true)
+    {
+        struct pollfd pfd = { to_parent[0], POLLIN, 0 };
+        bool done = poll(&pfd, 1, 0) == 1;
+        auto frame_start = std::chrono::steady_clock::now();
+
+        table->refresh();
+
+        size_t rows = table->row_count() - 1;
+        size_t first_row = rows > VISIBLE_ROWS ? rows - VISIBLE_ROWS : 0;
+
+        table->render(sink, first_row, VISIBLE_ROWS);
+        frame_us += elapsed_us(frame_start);
+        frames++;
+
+        for (size_t y = first_row + 1; y <= rows; y++)
+        {
+            std::string host(table->cell(y, 0));
+            std::string row(table->cell(y, 1));
+            std::string check(table->cell(y, 2));
+
+            // what was read is only good if the row was still there afterwards
+            if (!table->current(y))
+            {
+                overwritten++;
+            }
+            else if (check != host + ":" + row || row != std::to_string(table->first_sequence() + y - 1))
+            {
+                std::cerr << "row " << table->first_sequence() + y - 1 << " is torn" << std::endl;
+                return 1;
+            }
+            else
+            {
+                drawn++;
+            }
+        }
+
+        if (done)
+        {
+            break;
+        }
+    }
+
+    if (read(to_parent[0], &byte, 1) != 1)
+    {
+        return 1;
+    }
+
+    double late_open_us = time_open();
+    uint64_t written = table->first_sequence() + table->row_count() - 1;
+
+    if (write(to_child[1], &byte, 1) != 1)
+    {
+        return 1;
+    }
+
+    int status;
+
+    waitpid(pid, &status, 0);
+
+    std::cout << frames << " frames following " << written << " rows, " << frame_us / std::max<size_t>(frames, 1) << " us/frame, " << bytes
+              << " bytes drawn" << std::endl;
+    std::cout << "  " << drawn << " rows checked, " << overwritten << " overwritten while being read" << std::endl;
+    std::cout << "  opened in " << early_open_us << " us after " << EARLY_ROWS << " rows, " << late_open_us << " us after " << written << std::endl;
+
+    if (written != ROWS)
+    {
+        std::cerr << "rows went missing" << std::endl;
+        return 1;
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        std::cerr << "the writer did not exit cleanly" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,85 @@
+// Fills a spill_table_t with more rows than its memory limit could hold,
+// renders all of it into a sink that only counts bytes, then renders a window
+// from the middle, and reports the memory it used along the way.
+
+#include "libquest.h"
+#include <stdio.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace libquest;
+
+#define ROWS 2000000
+#define MEMORY_LIMIT (16 * 1024 * 1024)
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static long peak_rss_kb()
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_maxrss;
+}
+
+static void print_stats(const spill_table_t &table)
+{
+    auto stats = table.memory_stats();
+
+    std::cout << "  " << stats.rows << " rows in " << stats.chunks << " chunks, " << stats.file_bytes / (1024 * 1024) << " MiB on disk" << std::endl;
+    std::cout << "  buffered " << stats.buffered_bytes / 1024 << " KiB, mapped " << stats.mapped_bytes / 1024 << " KiB, index "
+              << stats.index_bytes / 1024 << " KiB, limit " << stats.limit / 1024 << " KiB" << std::endl;
+    std::cout << "  peak rss " << peak_rss_kb() / 1024 << " MiB" << std::endl;
+}
+
+int main()
+{
+    auto table = spill_table_t::create({ "time", "user", "action", "object" }, MEMORY_LIMIT);
+
+    if (!table)
+    {
+        std::cout << "could not create the temporary file" << std::endl;
+
+        return 1;
+    }
+
+    char time[32];
+    char user[32];
+    char object[64];
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < ROWS; i++)
+    {
+        snprintf(time, sizeof(time), "2024-01-%02d %02d:%02d:%02d", 1 + i % 28, i / 3600 % 24, i / 60 % 60, i % 60);
+        snprintf(user, sizeof(user), "user%05ld", i * 7919L % 50000);
+        snprintf(object, sizeof(object), "/projects/%d/documents/%08d", i % 997, i);
+
+        table->append_row({ time, user, i % 3 ? "read" : "write", object });
+    }
+
+    std::cout << "appended " << ROWS << " rows in " << elapsed_ms(start) << " ms" << std::endl;
+    print_stats(*table);
+
+    size_t rendered = 0;
+
+    start = std::chrono::steady_clock::now();
+    table->render([&](std::string_view piece) { rendered += piece.size(); });
+
+    std::cout << "rendered " << rendered / (1024 * 1024) << " MiB in " << elapsed_ms(start) << " ms" << std::endl;
+    print_stats(*table);
+
+    std::string window;
+
+    start = std::chrono::steady_clock::now();
+    table->render([&](std::string_view piece) { window.append(piece); }, ROWS / 2, 20);
+
+    std::cout << "rendered 20 rows from the middle in " << elapsed_ms(start) << " ms" << std::endl;
+
+    return 0;
+}
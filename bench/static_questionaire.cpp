@@ -0,0 +1,119 @@
+// Runs the same questions through questionaire_t and static_questionaire_t with
+// scripted input and counts the heap allocations made by each run.
+
+#include "libquest.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <string>
+
+using namespace libquest;
+
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+
+    if (void *ptr = malloc(size))
+    {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+#define ITERATIONS 10000
+
+static const char script[] = "Bob\n\x1b[B\x1b[B\ny\n";
+
+// replaces stdin with a file holding the script repeated for every run and
+// sends the prompts' output to /dev/null
+static void redirect_io(int runs)
+{
+    char path[] = "/tmp/libquest_bench_XXXXXX";
+    int fd = mkstemp(path);
+
+    for (int i = 0; i < runs; i++)
+    {
+        if (write(fd, script, sizeof(script) - 1) != sizeof(script) - 1)
+        {
+            abort();
+        }
+    }
+
+    lseek(fd, 0, SEEK_SET);
+    unlink(path);
+    dup2(fd, STDIN_FILENO);
+    close(fd);
+
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+}
+
+template <typename F>
+static void measure(const char *name, F &&run)
+{
+    // the first run sets up the stdio and iostream buffers
+    run();
+
+    size_t start_allocations = allocations;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        run();
+    }
+
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << name << ": "
+              << elapsed / ITERATIONS << " us/run, "
+              << double(allocations - start_allocations) / ITERATIONS << " allocations/run\n";
+}
+
+int main()
+{
+    redirect_io(2 * (ITERATIONS + 1));
+
+    questionaire_t runtime =
+    {
+        new input_t { "What is your name?" },
+        new select_t { "What is your favorite color?", { "red", "green", "blue" } },
+        new yesno_t { "Do you want to continue?" }
+    };
+
+    static_questionaire_t<
+        static_input_t<"What is your name?">,
+        static_select_t<"What is your favorite color?", "red", "green", "blue">,
+        static_yesno_t<"Do you want to continue?">
+    > compiled;
+
+    decltype(compiled)::answers_type answers;
+
+    measure("questionaire_t", [&] { runtime.run(); });
+    measure("static_questionaire_t", [&] { compiled.run(answers); });
+
+    if (std::get<0>(answers) != "Bob" || std::get<1>(answers).index != 2 || !std::get<2>(answers))
+    {
+        std::cerr << "unexpected answers\n";
+
+        return 1;
+    }
+}
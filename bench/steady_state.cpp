@@ -0,0 +1,160 @@
+// Asks the same questions and draws the same table over and over with
+// scripted input, counting heap allocations, once with the library's own
+// working memory and once with an arena the caller hands it. After the first
+// run everything should be served from memory that was already there, so it
+// fails if any run after that allocates.
+
+#include "libquest.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <memory_resource>
+#include <new>
+#include <string>
+
+using namespace libquest;
+
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+
+    if (void *ptr = malloc(size))
+    {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+#define ITERATIONS 2000
+#define TABLE_ROWS 200
+#define ARENA_SIZE (16 * 1024 * 1024)
+
+// answers too long to fit inside a std::string, so they need memory of their own
+static const char script[] =
+    "Bob the builder, who answers with rather long names\n"
+    "\x1b[B\x1b[B\n"
+    "a first line of notes that is long enough\nand a second one\n\n\n"
+    "y\n";
+
+// replaces stdin with a file holding the script repeated for every run and
+// sends the prompts' output to /dev/null
+static void redirect_io(int runs)
+{
+    char path[] = "/tmp/libquest_bench_XXXXXX";
+    int fd = mkstemp(path);
+
+    for (int i = 0; i < runs; i++)
+    {
+        if (write(fd, script, sizeof(script) - 1) != sizeof(script) - 1)
+        {
+            abort();
+        }
+    }
+
+    lseek(fd, 0, SEEK_SET);
+    unlink(path);
+    dup2(fd, STDIN_FILENO);
+    close(fd);
+
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+}
+
+static bool measure(const char *name, std::pmr::memory_resource *resource)
+{
+    questionaire_t questions(
+    {
+        new input_t { "What is your name?" },
+        new select_t { "What is your favorite color?", { "red", "green", "blue" } },
+        new multiline_t { "Any notes?" },
+        new yesno_t { "Do you want to continue?" }
+    },
+    resource);
+
+    table_t table(TABLE_BORDER_VERT | TABLE_HEADER_BORDER, rounded_borders);
+
+    table.append_column(column_t { "\x1b[1mNAME\x1b[0m", "COLOUR", "NOTES" });
+
+    for (int i = 0; i < TABLE_ROWS; i++)
+    {
+        table.append_column(column_t { "name " + std::to_string(i), i % 3 == 0 ? "\x1b[31mred\x1b[0m" : "blue", "notes that go on\nover two lines" });
+    }
+
+    std::string rendered;
+
+    auto run = [&]()
+    {
+        questions.run();
+        table.to_string(rendered);
+        table.run();
+    };
+
+    // the first run fills the pools, the stdio and iostream buffers and the answers
+    run();
+
+    size_t start_allocations = allocations;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        run();
+    }
+
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    size_t made = allocations - start_allocations;
+
+    std::cerr << name << ": " << elapsed / ITERATIONS << " us/run, " << double(made) / ITERATIONS << " allocations/run\n";
+
+    if (to_string(questions.answers[0]) != "Bob the builder, who answers with rather long names" || to_string(questions.answers[1]) != "blue" ||
+        to_string(questions.answers[2]) != "a first line of notes that is long enough\nand a second one" || to_string(questions.answers[3]) != "yes")
+    {
+        std::cerr << "unexpected answers" << std::endl;
+
+        return false;
+    }
+
+    return made == 0;
+}
+
+int main()
+{
+    redirect_io(2 * (ITERATIONS + 1));
+
+    if (!measure("built in working memory", std::pmr::get_default_resource()))
+    {
+        return 1;
+    }
+
+    // an arena the caller owns, with a pool on top so that freed blocks are
+    // used again. Blocks above the pool's largest size would go straight to the
+    // arena, which never reuses them, so the pool takes everything up to 1 MiB.
+    static char buffer[ARENA_SIZE];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    std::pmr::unsynchronized_pool_resource pool(std::pmr::pool_options { 0, 1024 * 1024 }, &arena);
+
+    set_working_memory(&pool);
+
+    bool clean = measure("caller's arena", &pool);
+
+    set_working_memory(nullptr);
+
+    return clean ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+// Builds a tree_table_t of clusters holding nodes holding processes, then
+// times drawing the top level, expanding and collapsing single rows, and
+// expanding everything. Every step checks the rows and column widths the
+// table keeps against a count and a measuring pass over the rows shown.
+
+#include "libquest.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace libquest;
+
+#define CLUSTERS 50
+#define NODES 100
+#define PROCESSES 100
+#define VISIBLE_ROWS 20
+
+static double elapsed_us(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the widths a cell_table_t would measure, and the rows it would count
+static bool check(const tree_table_t &table, size_t rows, const char *step)
+{
+    bool right = table.row_count() == rows + 1;
+
+    for (size_t x = 0; x < table.column_count(); x++)
+    {
+        right = right && table.column_width(x) == table.cell_table_t::column_width(x);
+    }
+
+    if (!right)
+    {
+        std::cerr << "rows or widths are wrong after " << step << std::endl;
+    }
+
+    return right;
+}
+
+// times an expand or collapse along with drawing the rows around it
+template <typename F>
+static double timed(tree_table_t &table, size_t node, F &&change)
+{
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    change(node);
+
+    size_t row = table.row_of(node);
+
+    table.render([&](std::string_view piece) { bytes += piece.size(); }, row - 1, VISIBLE_ROWS);
+
+    return elapsed_us(start);
+}
+
+int main()
+{
+    tree_table_t table({ "name", "cpu", "memory", "state" });
+    std::vector<size_t> clusters;
+    std::vector<size_t> nodes;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int c = 0; c < CLUSTERS; c++)
+    {
+        size_t cluster = table.add_row(tree_table_t::root, { "cluster-" + std::to_string(c), "", "", "ok" });
+
+        clusters.push_back(cluster);
+
+        for (int n = 0; n < NODES; n++)
+        {
+            size_t node = table.add_row(cluster, { "node-" + std::to_string(c) + "-" + std::to_string(n), "", "", "ok" });
+
+            nodes.push_back(node);
+
+            for (int p = 0; p < PROCESSES; p++)
+            {
+                // one process somewhere has a much longer name, which only counts once it is shown
+                std::string name = c == CLUSTERS - 1 && n == NODES - 1 && p == 0 ? "a process with a name that is longer than all the others" : "worker-" + std::to_string(p);
+
+                table.add_row(node, { name, std::to_string(p % 100) + "%", std::to_string(p * 16) + " MiB", p % 7 ? "running" : "sleeping" });
+            }
+        }
+    }
+
+    double build_ms = elapsed_us(start) / 1000;
+    size_t total = CLUSTERS * (1 + NODES * (1 + PROCESSES));
+
+    std::cout << "built " << total << " rows in " << build_ms << " ms" << std::endl;
+
+    size_t bytes = 0;
+
+    start = std::chrono::steady_clock::now();
+    table.render([&](std::string_view piece) { bytes += piece.size(); });
+    std::cout << "  drew the top level in " << elapsed_us(start) << " us" << std::endl;
+
+    if (!check(table, CLUSTERS, "building"))
+    {
+        return 1;
+    }
+
+    size_t last_cluster = clusters.back();
+    size_t last_node = nodes.back();
+    auto expand = [&](size_t node) { table.expand(node); };
+    auto collapse = [&](size_t node) { table.collapse(node); };
+
+    double cluster_us = timed(table, last_cluster, expand);
+
+    if (!check(table, CLUSTERS + NODES, "expanding a cluster"))
+    {
+        return 1;
+    }
+
+    double node_us = timed(table, last_node, expand);
+
+    if (!check(table, CLUSTERS + NODES + PROCESSES, "expanding a node"))
+    {
+        return 1;
+    }
+
+    double collapse_us = timed(table, last_node, collapse);
+
+    if (!check(table, CLUSTERS + NODES, "collapsing a node"))
+    {
+        return 1;
+    }
+
+    std::cout << "  expanding a cluster " << cluster_us << " us, a node " << node_us << " us, collapsing the node " << collapse_us
+              << " us, each drawn" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+
+    for (size_t cluster : clusters)
+    {
+        table.expand(cluster);
+    }
+
+    for (size_t node : nodes)
+    {
+        table.expand(node);
+    }
+
+    std::cout << "  expanding all " << total << " rows " << elapsed_us(start) / 1000 << " ms" << std::endl;
+
+    if (!check(table, total, "expanding everything"))
+    {
+        return 1;
+    }
+
+    // with everything shown, a change near the top still only touches the rows above it
+    collapse_us = timed(table, nodes.front(), collapse);
+    node_us = timed(table, nodes.front(), expand);
+
+    start = std::chrono::steady_clock::now();
+    table.render([&](std::string_view piece) { bytes += piece.size(); }, total / 2, VISIBLE_ROWS);
+
+    std::cout << "  then collapsing a node " << collapse_us << " us, expanding it again " << node_us << " us, drawing "
+              << VISIBLE_ROWS << " rows from the middle " << elapsed_us(start) << " us" << std::endl;
+
+    return check(table, total, "expanding a node again") ? 0 : 1;
+}
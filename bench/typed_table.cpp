@@ -0,0 +1,51 @@
+// Renders the same numeric rows through table_t, converting every value to a
+// string first, and through typed_table_t, which formats them while rendering.
+
+#include "libquest.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace libquest;
+
+#define ROWS 1000
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    auto start = std::chrono::steady_clock::now();
+    table_t strings(TABLE_BORDER_VERT | TABLE_HEADER_BORDER);
+
+    strings.append_column(column_t { "id", "count", "ratio", "latency" });
+
+    for (int i = 0; i < ROWS; i++)
+    {
+        strings.append_column(column_t { std::to_string(i), std::to_string(i * 37 % 100003), std::to_string(i / 7.0), std::to_string(i % 900) + "us" });
+    }
+
+    size_t string_size = strings.to_string().size();
+    double string_time = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    typed_table_t<int, long, double, std::chrono::microseconds> typed({ "id", "count", "ratio", "latency" });
+
+    typed.reserve(ROWS);
+
+    for (int i = 0; i < ROWS; i++)
+    {
+        typed.append_row(i, i * 37L % 100003, i / 7.0, std::chrono::microseconds(i % 900));
+    }
+
+    size_t typed_size = typed.to_string().size();
+    double typed_time = elapsed_ms(start);
+
+    std::cout << ROWS << " rows through table_t: " << string_time << " ms, " << string_size << " bytes" << std::endl;
+    std::cout << ROWS << " rows through typed_table_t: " << typed_time << " ms, " << typed_size << " bytes" << std::endl;
+
+    return 0;
+}
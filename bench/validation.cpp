@@ -0,0 +1,126 @@
+// Measures the per-keystroke cost of the validators, typing values one
+// character at a time against a 1M entry allow-list. Also checks that a
+// number range takes in the decimals at its bounds.
+
+#include "libquest.h"
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace libquest;
+
+#define ENTRIES 1000000
+#define VALUES 1000
+
+// types value a character at a time, then takes back to_erase of them, the way the prompt would
+static bool typed_in_range(number_range_t &range, std::string value, size_t to_erase = 0)
+{
+    std::string error;
+    bool valid = false;
+
+    for (size_t i = 1; i <= value.size(); i++)
+    {
+        valid = range.check(std::string_view(value).substr(0, i), i - 1, error);
+    }
+
+    for (size_t i = 0; i < to_erase; i++)
+    {
+        value.pop_back();
+        valid = range.check(value, value.size(), error);
+    }
+
+    return valid;
+}
+
+static bool check_number_range()
+{
+    number_range_t range(-0.3, 0.3);
+    number_range_t large(0, 12345678901234567890.0);
+
+    // the bounds are inclusive, and more digits than fit in 64 bits still land on the right double
+    return typed_in_range(range, "0.3") && typed_in_range(range, "-0.3") && typed_in_range(range, "0.300") &&
+           typed_in_range(range, "0.31", 1) && typed_in_range(range, "+.3") && !typed_in_range(range, "0.30000000000000005") &&
+           !typed_in_range(range, "0.31") && !typed_in_range(range, "-0.3000001") && !typed_in_range(range, "0.3.") &&
+           typed_in_range(large, "12345678901234567890") && !typed_in_range(large, "12345678901234567890000");
+}
+
+int main()
+{
+    std::vector<std::string> entries;
+    char buffer[64];
+
+    entries.reserve(ENTRIES);
+
+    for (int i = 0; i < ENTRIES; i++)
+    {
+        snprintf(buffer, sizeof(buffer), "host-%07d.eu-west.example.com", i);
+        entries.push_back(buffer);
+    }
+
+    auto build_start = std::chrono::steady_clock::now();
+    auto list = std::make_shared<const allow_list_t>(entries);
+    auto build_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+    validators_t validators =
+    {
+        std::make_shared<required_t>(),
+        std::make_shared<length_t>(1, 64),
+        std::make_shared<pattern_t>("[a-z0-9.-]+"),
+        std::make_shared<one_of_t>(list)
+    };
+
+    std::string value;
+    std::string error;
+    double worst = 0;
+    double total = 0;
+    size_t keystrokes = 0;
+    size_t accepted = 0;
+
+    for (int v = 0; v < VALUES; v++)
+    {
+        std::string target = entries[(v * 7919) % ENTRIES];
+
+        value.clear();
+
+        for (char c : target)
+        {
+            value.push_back(c);
+
+            auto start = std::chrono::steady_clock::now();
+            bool valid = true;
+
+            for (auto &validator : validators)
+            {
+                valid = validator->check(value, value.size() - 1, error) && valid;
+            }
+
+            double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+            worst = std::max(worst, elapsed);
+            total += elapsed;
+            keystrokes++;
+            accepted += valid && value.size() == target.size();
+        }
+    }
+
+    std::cerr << "allow-list of " << list->size() << " entries built in " << build_time << " ms\n"
+              << "per keystroke: " << total / keystrokes << " us mean, " << worst << " us worst\n";
+
+    if (accepted != VALUES)
+    {
+        std::cerr << "only " << accepted << " of " << VALUES << " values were accepted\n";
+
+        return 1;
+    }
+
+    if (!check_number_range())
+    {
+        std::cerr << "number_range_t got a value at its bounds wrong\n";
+
+        return 1;
+    }
+}
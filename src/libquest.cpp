@@ -1,12 +1,27 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <termios.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
 #include <iostream>
 #include <sstream>
+#include <fstream>
 #include <locale>
 #include <codecvt>
 #include <algorithm>
 #include <functional>
+#include <array>
+#include <map>
+#include <atomic>
+#include <bit>
+#include <span>
 
 #include "libquest.h"
 
@@ -16,18 +31,323 @@
 #define STYLE4 "\033[1;36m"
 #define STYLE5 "\033[90m"
 #define STYLE_CLEAR "\033[0m"
+#define STYLE_ERROR "\033[1;31m"
 
-static void change_term_style(std::string style)
+// Prompts set their styles through here, so only the codes that change the
+// style on the terminal are sent.
+static libquest::style_writer_t term_style;
+
+static void change_term_style(std::string_view style)
+{
+    static std::string codes;
+
+    codes.clear();
+    term_style.apply(style);
+    term_style.flush(codes);
+
+    std::cout << codes;
+}
+
+// The program may have styled the terminal since the last prompt, so every
+// prompt calls this first and its first style starts with a full reset.
+static void forget_term_style()
+{
+    term_style.forget();
+}
+
+// Stats are compiled in with LIBQUEST_STATS, everything wrapped in STATS()
+// disappears without it.
+#ifdef LIBQUEST_STATS
+#define STATS(...) __VA_ARGS__
+#else
+#define STATS(...)
+#endif
+
+// Every thread counts into its own stats, so a render thread never races a
+// render on another thread or a reader of stats().
+static thread_local libquest::stats_t stats_data;
+static libquest::stats_hook_t stats_hook;
+
+// set on the library's own render threads, whose stats nobody reads and which never call the hook
+static thread_local bool stats_background = false;
+
+#ifdef LIBQUEST_STATS
+
+static void stats_publish()
+{
+    if (stats_hook && !stats_background)
+    {
+        stats_hook(stats_data);
+    }
+}
+
+// adds the time it was alive for to a counter
+struct stats_timer_t
+{
+    std::chrono::nanoseconds &total;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    ~stats_timer_t()
+    {
+        total += std::chrono::steady_clock::now() - start;
+    }
+};
+
+// the frame the running prompt is drawing
+static struct
+{
+    libquest::question_type type = libquest::QUESTION_BASE_CLASS;
+    std::chrono::steady_clock::time_point start;
+    bool keyed = false;
+    uint64_t bytes = 0;
+    uint64_t syscalls = 0;
+} stats_frame;
+
+// input has been read, the frame lasts until the next flush
+static void stats_frame_begin()
+{
+    if (!stats_frame.keyed)
+    {
+        stats_frame.keyed = true;
+        stats_frame.start = std::chrono::steady_clock::now();
+    }
+}
+
+static void stats_frame_end()
+{
+    if (stats_frame.type == libquest::QUESTION_BASE_CLASS || (!stats_frame.keyed && stats_frame.bytes == 0))
+    {
+        return;
+    }
+
+    auto &prompt = stats_data.prompts[stats_frame.type];
+
+    prompt.frames++;
+    prompt.bytes += stats_frame.bytes;
+    prompt.syscalls += stats_frame.syscalls;
+    prompt.max_frame_bytes = std::max(prompt.max_frame_bytes, stats_frame.bytes);
+    prompt.max_frame_syscalls = std::max(prompt.max_frame_syscalls, stats_frame.syscalls);
+
+    // the first frame of a prompt is drawn before any input, so it has no latency
+    if (stats_frame.keyed)
+    {
+        prompt.latency.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stats_frame.start));
+    }
+
+    stats_frame.keyed = false;
+    stats_frame.bytes = 0;
+    stats_frame.syscalls = 0;
+}
+
+// Stands in for the buffer of std::cout while a prompt runs. It writes to
+// stdout itself, so that every byte and every write of a frame is counted.
+class stats_prompt_t : public std::streambuf
+{
+public:
+    stats_prompt_t(libquest::question_type type)
+    {
+        std::cout.flush();
+        previous = std::cout.rdbuf(this);
+        setp(buffer, buffer + sizeof(buffer));
+
+        stats_frame.type = type;
+        stats_data.prompts[type].prompts++;
+    }
+
+    ~stats_prompt_t()
+    {
+        sync();
+        stats_frame_end();
+        stats_frame.type = libquest::QUESTION_BASE_CLASS;
+        std::cout.rdbuf(previous);
+
+        stats_publish();
+    }
+
+protected:
+    int overflow(int c) override
+    {
+        if (sync() != 0)
+        {
+            return EOF;
+        }
+
+        if (c != EOF)
+        {
+            *pptr() = c;
+            pbump(1);
+        }
+
+        return 0;
+    }
+
+    int sync() override
+    {
+        const char *data = pbase();
+        size_t len = pptr() - pbase();
+
+        while (len > 0)
+        {
+            ssize_t n = write(STDOUT_FILENO, data, len);
+
+            stats_frame.syscalls++;
+
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                return -1;
+            }
+
+            stats_frame.bytes += n;
+            data += n;
+            len -= n;
+        }
+
+        setp(buffer, buffer + sizeof(buffer));
+
+        return 0;
+    }
+
+private:
+    std::streambuf *previous;
+    char buffer[16 * 1024];
+};
+
+#endif
+
+// how long to wait for the rest of an escape sequence before treating ESC as a key press
+#define ESCAPE_TIMEOUT_MS 25
+
+// number of completions listed below an input prompt
+#define MAX_SUGGESTIONS 5
+
+// All terminal input goes through this buffer, so bytes that were read ahead
+// while one prompt was running are still seen by the next one.
+struct input_buffer_t
+{
+    char data[64 * 1024];
+    size_t begin = 0;
+    size_t end = 0;
+
+    size_t size() const
+    {
+        return end - begin;
+    }
+
+    const char *peek() const
+    {
+        return data + begin;
+    }
+
+    void consume(size_t n)
+    {
+        begin += n;
+
+        if (begin == end)
+        {
+            begin = end = 0;
+        }
+    }
+
+    // Reads whatever is available from stdin in a single call. Returns false
+    // on end of file, or if nothing arrived within timeout_ms.
+    bool fill(int timeout_ms = -1)
+    {
+        if (begin > 0)
+        {
+            memmove(data, data + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+
+        if (end == sizeof(data))
+        {
+            return true;
+        }
+
+        if (timeout_ms >= 0)
+        {
+            struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+
+            STATS(stats_frame.syscalls++);
+
+            if (poll(&pfd, 1, timeout_ms) <= 0)
+            {
+                return false;
+            }
+        }
+
+        ssize_t n;
+
+        do
+        {
+            STATS(stats_frame.syscalls++);
+            n = read(STDIN_FILENO, data + end, sizeof(data) - end);
+        }
+        while (n < 0 && errno == EINTR);
+
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        end += n;
+
+        return true;
+    }
+};
+
+static input_buffer_t stdin_buffer;
+
+static bool read_line(std::string &line)
 {
-    std::cout << style;
+    line.clear();
+
+    std::cout.flush();
+    STATS(stats_frame_end());
+
+    while (true)
+    {
+        const char *data = stdin_buffer.peek();
+        const char *newline = (const char *)memchr(data, '\n', stdin_buffer.size());
+
+        if (newline)
+        {
+            line.append(data, newline);
+            stdin_buffer.consume(newline - data + 1);
+            STATS(stats_frame_begin());
+
+            return true;
+        }
+
+        line.append(data, stdin_buffer.size());
+        stdin_buffer.consume(stdin_buffer.size());
+
+        if (!stdin_buffer.fill())
+        {
+            return !line.empty();
+        }
+    }
 }
 
-#define KEY_UP ((int)0x415b1b)
-#define KEY_DOWN ((int)0x425b1b)
+// 0 means prompts draw as soon as the pending keys are applied
+static std::chrono::steady_clock::duration min_frame_interval {};
 
-static void on_key(std::function<bool(int)> callback)
+// Calls callback with every key until it returns false. The keys that are
+// already waiting are all applied before render is called to draw the result,
+// so a prompt only draws one frame however many keys arrive at once.
+template <typename F, typename R>
+static void on_key(F &&callback, R &&render)
 {
+    // wrapping a reference keeps std::function from allocating a copy of the callback
+    libquest::key_handler_t handler = std::ref(callback);
+
     static struct termios oldt, newt;
+    static libquest::key_decoder_t decoder;
 
     tcgetattr(STDIN_FILENO, &oldt);
     newt = oldt;
@@ -35,33 +355,72 @@ static void on_key(std::function<bool(int)> callback)
 
     tcsetattr(STDIN_FILENO, TCSANOW, &newt);
 
-    while (true)
-    {
-        char a = 0, b = 0, c = 0;
+    bool stopped = false;
+    bool need_input = stdin_buffer.size() == 0;
+    bool applied = false;
+    auto next_frame = std::chrono::steady_clock::time_point();
 
-        a = getchar();
+    while (!stopped)
+    {
+        bool final = false;
 
-        if (a == 27)
+        if (need_input)
         {
-            b = getchar();
+            size_t pending = stdin_buffer.size();
+            auto now = std::chrono::steady_clock::now();
+            int wait_ms = now < next_frame ? std::chrono::ceil<std::chrono::milliseconds>(next_frame - now).count() : 0;
 
-            if (b != 91)
+            // more keys that are already there, or that come before the next
+            // frame may be drawn, are applied first
+            if (!stdin_buffer.fill(wait_ms))
             {
-                continue;
-            }
+                if (applied)
+                {
+                    render();
+                    applied = false;
+                    next_frame = std::chrono::steady_clock::now() + min_frame_interval;
+                }
 
-            c = getchar();
-        }
+                std::cout.flush();
+                STATS(stats_frame_end());
 
-        if(!callback((c << 16) | (b << 8) | a))
-        {
-            break;
+                if (pending == 0)
+                {
+                    if (!stdin_buffer.fill())
+                    {
+                        handler({ libquest::KEY_EOF });
+
+                        break;
+                    }
+                }
+                else
+                {
+                    // the previous pass left an incomplete sequence behind, so wait
+                    // briefly for the rest of it before giving up on it
+                    final = !stdin_buffer.fill(ESCAPE_TIMEOUT_MS);
+                }
+            }
         }
+
+        STATS(stats_frame_begin());
+
+        size_t consumed = decoder.decode(stdin_buffer.peek(), stdin_buffer.size(), final, handler, stopped);
+
+        stdin_buffer.consume(consumed);
+        applied = applied || consumed > 0;
+        need_input = true;
     }
 
     tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
 }
 
+template <typename F>
+static void on_key(F &&callback)
+{
+    on_key(callback, []() {});
+}
+
+// erases the current line and the n lines above it with a fixed number of escape codes
 static void erase_term_lines(int n)
 {
     if (n < 1)
@@ -69,28 +428,54 @@ static void erase_term_lines(int n)
         return;
     }
 
-    for (int i = 0; i < n; i++)
-    {
-        std::cout << "\x1b[1A"
-                  << "\x1b[2K";
-    }
-
-    std::cout << "\r";
+    std::cout << "\x1b[" << n << "A"
+              << "\r"
+              << "\x1b[J";
 }
 
+#define BRACKETED_PASTE_ON "\x1b[?2004h"
+#define BRACKETED_PASTE_OFF "\x1b[?2004l"
 
-static std::string wstr_to_str(const std::wstring &wstr)
+static std::wstring str_to_wstr(const std::string &str)
 {
     std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
 
-    return converter.to_bytes(wstr);
+    return converter.from_bytes(str);
 }
 
-static std::wstring str_to_wstr(const std::string &str)
+// encodes text as UTF-8 onto the end of out, without a converter of its own to allocate
+template <typename String>
+static void append_utf8(std::wstring_view text, String &out)
 {
-    std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
+    out.reserve(out.size() + text.size());
 
-    return converter.from_bytes(str);
+    for (wchar_t ch : text)
+    {
+        uint32_t c = ch;
+
+        if (c < 0x80)
+        {
+            out.push_back((char)c);
+        }
+        else if (c < 0x800)
+        {
+            out.push_back((char)(0xC0 | (c >> 6)));
+            out.push_back((char)(0x80 | (c & 0x3F)));
+        }
+        else if (c < 0x10000)
+        {
+            out.push_back((char)(0xE0 | (c >> 12)));
+            out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (c & 0x3F)));
+        }
+        else
+        {
+            out.push_back((char)(0xF0 | (c >> 18)));
+            out.push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+            out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (c & 0x3F)));
+        }
+    }
 }
 
 // The native wcwidth function is not standardised and it lacks emoji support,
@@ -130,6 +515,334 @@ static bool binary_search_range(const std::vector<char_range_t>& ranges, wchar_t
     return false;
 }
 
+static const std::vector<char_range_t> utf_zero_width_chars =
+{
+    { 0x00300, 0x0036f },
+    { 0x00483, 0x00489 },
+    { 0x00591, 0x005bd },
+    { 0x005bf, 0x005bf },
+    { 0x005c1, 0x005c2 },
+    { 0x005c4, 0x005c5 },
+    { 0x005c7, 0x005c7 },
+    { 0x00610, 0x0061a },
+    { 0x0064b, 0x0065f },
+    { 0x00670, 0x00670 },
+    { 0x006d6, 0x006dc },
+    { 0x006df, 0x006e4 },
+    { 0x006e7, 0x006e8 },
+    { 0x006ea, 0x006ed },
+    { 0x00711, 0x00711 },
+    { 0x00730, 0x0074a },
+    { 0x007a6, 0x007b0 },
+    { 0x007eb, 0x007f3 },
+    { 0x007fd, 0x007fd },
+    { 0x00816, 0x00819 },
+    { 0x0081b, 0x00823 },
+    { 0x00825, 0x00827 },
+    { 0x00829, 0x0082d },
+    { 0x00859, 0x0085b },
+    { 0x008d3, 0x008e1 },
+    { 0x008e3, 0x00902 },
+    { 0x0093a, 0x0093a },
+    { 0x0093c, 0x0093c },
+    { 0x00941, 0x00948 },
+    { 0x0094d, 0x0094d },
+    { 0x00951, 0x00957 },
+    { 0x00962, 0x00963 },
+    { 0x00981, 0x00981 },
+    { 0x009bc, 0x009bc },
+    { 0x009c1, 0x009c4 },
+    { 0x009cd, 0x009cd },
+    { 0x009e2, 0x009e3 },
+    { 0x009fe, 0x009fe },
+    { 0x00a01, 0x00a02 },
+    { 0x00a3c, 0x00a3c },
+    { 0x00a41, 0x00a42 },
+    { 0x00a47, 0x00a48 },
+    { 0x00a4b, 0x00a4d },
+    { 0x00a51, 0x00a51 },
+    { 0x00a70, 0x00a71 },
+    { 0x00a75, 0x00a75 },
+    { 0x00a81, 0x00a82 },
+    { 0x00abc, 0x00abc },
+    { 0x00ac1, 0x00ac5 },
+    { 0x00ac7, 0x00ac8 },
+    { 0x00acd, 0x00acd },
+    { 0x00ae2, 0x00ae3 },
+    { 0x00afa, 0x00aff },
+    { 0x00b01, 0x00b01 },
+    { 0x00b3c, 0x00b3c },
+    { 0x00b3f, 0x00b3f },
+    { 0x00b41, 0x00b44 },
+    { 0x00b4d, 0x00b4d },
+    { 0x00b55, 0x00b56 },
+    { 0x00b62, 0x00b63 },
+    { 0x00b82, 0x00b82 },
+    { 0x00bc0, 0x00bc0 },
+    { 0x00bcd, 0x00bcd },
+    { 0x00c00, 0x00c00 },
+    { 0x00c04, 0x00c04 },
+    { 0x00c3e, 0x00c40 },
+    { 0x00c46, 0x00c48 },
+    { 0x00c4a, 0x00c4d },
+    { 0x00c55, 0x00c56 },
+    { 0x00c62, 0x00c63 },
+    { 0x00c81, 0x00c81 },
+    { 0x00cbc, 0x00cbc },
+    { 0x00cbf, 0x00cbf },
+    { 0x00cc6, 0x00cc6 },
+    { 0x00ccc, 0x00ccd },
+    { 0x00ce2, 0x00ce3 },
+    { 0x00d00, 0x00d01 },
+    { 0x00d3b, 0x00d3c },
+    { 0x00d41, 0x00d44 },
+    { 0x00d4d, 0x00d4d },
+    { 0x00d62, 0x00d63 },
+    { 0x00d81, 0x00d81 },
+    { 0x00dca, 0x00dca },
+    { 0x00dd2, 0x00dd4 },
+    { 0x00dd6, 0x00dd6 },
+    { 0x00e31, 0x00e31 },
+    { 0x00e34, 0x00e3a },
+    { 0x00e47, 0x00e4e },
+    { 0x00eb1, 0x00eb1 },
+    { 0x00eb4, 0x00ebc },
+    { 0x00ec8, 0x00ecd },
+    { 0x00f18, 0x00f19 },
+    { 0x00f35, 0x00f35 },
+    { 0x00f37, 0x00f37 },
+    { 0x00f39, 0x00f39 },
+    { 0x00f71, 0x00f7e },
+    { 0x00f80, 0x00f84 },
+    { 0x00f86, 0x00f87 },
+    { 0x00f8d, 0x00f97 },
+    { 0x00f99, 0x00fbc },
+    { 0x00fc6, 0x00fc6 },
+    { 0x0102d, 0x01030 },
+    { 0x01032, 0x01037 },
+    { 0x01039, 0x0103a },
+    { 0x0103d, 0x0103e },
+    { 0x01058, 0x01059 },
+    { 0x0105e, 0x01060 },
+    { 0x01071, 0x01074 },
+    { 0x01082, 0x01082 },
+    { 0x01085, 0x01086 },
+    { 0x0108d, 0x0108d },
+    { 0x0109d, 0x0109d },
+    { 0x0135d, 0x0135f },
+    { 0x01712, 0x01714 },
+    { 0x01732, 0x01734 },
+    { 0x01752, 0x01753 },
+    { 0x01772, 0x01773 },
+    { 0x017b4, 0x017b5 },
+    { 0x017b7, 0x017bd },
+    { 0x017c6, 0x017c6 },
+    { 0x017c9, 0x017d3 },
+    { 0x017dd, 0x017dd },
+    { 0x0180b, 0x0180d },
+    { 0x01885, 0x01886 },
+    { 0x018a9, 0x018a9 },
+    { 0x01920, 0x01922 },
+    { 0x01927, 0x01928 },
+    { 0x01932, 0x01932 },
+    { 0x01939, 0x0193b },
+    { 0x01a17, 0x01a18 },
+    { 0x01a1b, 0x01a1b },
+    { 0x01a56, 0x01a56 },
+    { 0x01a58, 0x01a5e },
+    { 0x01a60, 0x01a60 },
+    { 0x01a62, 0x01a62 },
+    { 0x01a65, 0x01a6c },
+    { 0x01a73, 0x01a7c },
+    { 0x01a7f, 0x01a7f },
+    { 0x01ab0, 0x01ac0 },
+    { 0x01b00, 0x01b03 },
+    { 0x01b34, 0x01b34 },
+    { 0x01b36, 0x01b3a },
+    { 0x01b3c, 0x01b3c },
+    { 0x01b42, 0x01b42 },
+    { 0x01b6b, 0x01b73 },
+    { 0x01b80, 0x01b81 },
+    { 0x01ba2, 0x01ba5 },
+    { 0x01ba8, 0x01ba9 },
+    { 0x01bab, 0x01bad },
+    { 0x01be6, 0x01be6 },
+    { 0x01be8, 0x01be9 },
+    { 0x01bed, 0x01bed },
+    { 0x01bef, 0x01bf1 },
+    { 0x01c2c, 0x01c33 },
+    { 0x01c36, 0x01c37 },
+    { 0x01cd0, 0x01cd2 },
+    { 0x01cd4, 0x01ce0 },
+    { 0x01ce2, 0x01ce8 },
+    { 0x01ced, 0x01ced },
+    { 0x01cf4, 0x01cf4 },
+    { 0x01cf8, 0x01cf9 },
+    { 0x01dc0, 0x01df9 },
+    { 0x01dfb, 0x01dff },
+    { 0x020d0, 0x020f0 },
+    { 0x02cef, 0x02cf1 },
+    { 0x02d7f, 0x02d7f },
+    { 0x02de0, 0x02dff },
+    { 0x0302a, 0x0302d },
+    { 0x03099, 0x0309a },
+    { 0x0a66f, 0x0a672 },
+    { 0x0a674, 0x0a67d },
+    { 0x0a69e, 0x0a69f },
+    { 0x0a6f0, 0x0a6f1 },
+    { 0x0a802, 0x0a802 },
+    { 0x0a806, 0x0a806 },
+    { 0x0a80b, 0x0a80b },
+    { 0x0a825, 0x0a826 },
+    { 0x0a82c, 0x0a82c },
+    { 0x0a8c4, 0x0a8c5 },
+    { 0x0a8e0, 0x0a8f1 },
+    { 0x0a8ff, 0x0a8ff },
+    { 0x0a926, 0x0a92d },
+    { 0x0a947, 0x0a951 },
+    { 0x0a980, 0x0a982 },
+    { 0x0a9b3, 0x0a9b3 },
+    { 0x0a9b6, 0x0a9b9 },
+    { 0x0a9bc, 0x0a9bd },
+    { 0x0a9e5, 0x0a9e5 },
+    { 0x0aa29, 0x0aa2e },
+    { 0x0aa31, 0x0aa32 },
+    { 0x0aa35, 0x0aa36 },
+    { 0x0aa43, 0x0aa43 },
+    { 0x0aa4c, 0x0aa4c },
+    { 0x0aa7c, 0x0aa7c },
+    { 0x0aab0, 0x0aab0 },
+    { 0x0aab2, 0x0aab4 },
+    { 0x0aab7, 0x0aab8 },
+    { 0x0aabe, 0x0aabf },
+    { 0x0aac1, 0x0aac1 },
+    { 0x0aaec, 0x0aaed },
+    { 0x0aaf6, 0x0aaf6 },
+    { 0x0abe5, 0x0abe5 },
+    { 0x0abe8, 0x0abe8 },
+    { 0x0abed, 0x0abed },
+    { 0x0fb1e, 0x0fb1e },
+    { 0x0fe00, 0x0fe0f },
+    { 0x0fe20, 0x0fe2f },
+    { 0x101fd, 0x101fd },
+    { 0x102e0, 0x102e0 },
+    { 0x10376, 0x1037a },
+    { 0x10a01, 0x10a03 },
+    { 0x10a05, 0x10a06 },
+    { 0x10a0c, 0x10a0f },
+    { 0x10a38, 0x10a3a },
+    { 0x10a3f, 0x10a3f },
+    { 0x10ae5, 0x10ae6 },
+    { 0x10d24, 0x10d27 },
+    { 0x10eab, 0x10eac },
+    { 0x10f46, 0x10f50 },
+    { 0x11001, 0x11001 },
+    { 0x11038, 0x11046 },
+    { 0x1107f, 0x11081 },
+    { 0x110b3, 0x110b6 },
+    { 0x110b9, 0x110ba },
+    { 0x11100, 0x11102 },
+    { 0x11127, 0x1112b },
+    { 0x1112d, 0x11134 },
+    { 0x11173, 0x11173 },
+    { 0x11180, 0x11181 },
+    { 0x111b6, 0x111be },
+    { 0x111c9, 0x111cc },
+    { 0x111cf, 0x111cf },
+    { 0x1122f, 0x11231 },
+    { 0x11234, 0x11234 },
+    { 0x11236, 0x11237 },
+    { 0x1123e, 0x1123e },
+    { 0x112df, 0x112df },
+    { 0x112e3, 0x112ea },
+    { 0x11300, 0x11301 },
+    { 0x1133b, 0x1133c },
+    { 0x11340, 0x11340 },
+    { 0x11366, 0x1136c },
+    { 0x11370, 0x11374 },
+    { 0x11438, 0x1143f },
+    { 0x11442, 0x11444 },
+    { 0x11446, 0x11446 },
+    { 0x1145e, 0x1145e },
+    { 0x114b3, 0x114b8 },
+    { 0x114ba, 0x114ba },
+    { 0x114bf, 0x114c0 },
+    { 0x114c2, 0x114c3 },
+    { 0x115b2, 0x115b5 },
+    { 0x115bc, 0x115bd },
+    { 0x115bf, 0x115c0 },
+    { 0x115dc, 0x115dd },
+    { 0x11633, 0x1163a },
+    { 0x1163d, 0x1163d },
+    { 0x1163f, 0x11640 },
+    { 0x116ab, 0x116ab },
+    { 0x116ad, 0x116ad },
+    { 0x116b0, 0x116b5 },
+    { 0x116b7, 0x116b7 },
+    { 0x1171d, 0x1171f },
+    { 0x11722, 0x11725 },
+    { 0x11727, 0x1172b },
+    { 0x1182f, 0x11837 },
+    { 0x11839, 0x1183a },
+    { 0x1193b, 0x1193c },
+    { 0x1193e, 0x1193e },
+    { 0x11943, 0x11943 },
+    { 0x119d4, 0x119d7 },
+    { 0x119da, 0x119db },
+    { 0x119e0, 0x119e0 },
+    { 0x11a01, 0x11a0a },
+    { 0x11a33, 0x11a38 },
+    { 0x11a3b, 0x11a3e },
+    { 0x11a47, 0x11a47 },
+    { 0x11a51, 0x11a56 },
+    { 0x11a59, 0x11a5b },
+    { 0x11a8a, 0x11a96 },
+    { 0x11a98, 0x11a99 },
+    { 0x11c30, 0x11c36 },
+    { 0x11c38, 0x11c3d },
+    { 0x11c3f, 0x11c3f },
+    { 0x11c92, 0x11ca7 },
+    { 0x11caa, 0x11cb0 },
+    { 0x11cb2, 0x11cb3 },
+    { 0x11cb5, 0x11cb6 },
+    { 0x11d31, 0x11d36 },
+    { 0x11d3a, 0x11d3a },
+    { 0x11d3c, 0x11d3d },
+    { 0x11d3f, 0x11d45 },
+    { 0x11d47, 0x11d47 },
+    { 0x11d90, 0x11d91 },
+    { 0x11d95, 0x11d95 },
+    { 0x11d97, 0x11d97 },
+    { 0x11ef3, 0x11ef4 },
+    { 0x16af0, 0x16af4 },
+    { 0x16b30, 0x16b36 },
+    { 0x16f4f, 0x16f4f },
+    { 0x16f8f, 0x16f92 },
+    { 0x16fe4, 0x16fe4 },
+    { 0x1bc9d, 0x1bc9e },
+    { 0x1d167, 0x1d169 },
+    { 0x1d17b, 0x1d182 },
+    { 0x1d185, 0x1d18b },
+    { 0x1d1aa, 0x1d1ad },
+    { 0x1d242, 0x1d244 },
+    { 0x1da00, 0x1da36 },
+    { 0x1da3b, 0x1da6c },
+    { 0x1da75, 0x1da75 },
+    { 0x1da84, 0x1da84 },
+    { 0x1da9b, 0x1da9f },
+    { 0x1daa1, 0x1daaf },
+    { 0x1e000, 0x1e006 },
+    { 0x1e008, 0x1e018 },
+    { 0x1e01b, 0x1e021 },
+    { 0x1e023, 0x1e024 },
+    { 0x1e026, 0x1e02a },
+    { 0x1e130, 0x1e136 },
+    { 0x1e2ec, 0x1e2ef },
+    { 0x1e8d0, 0x1e8d6 },
+    { 0x1e944, 0x1e94a },
+    { 0xe0100, 0xe01ef }
+};
+
 static int get_wchar_width(wchar_t c)
 {
     static std::vector<wchar_t> zero_width_chars =
@@ -154,334 +867,6 @@ static int get_wchar_width(wchar_t c)
         0x2063,
     };
 
-    static std::vector<char_range_t> utf_zero_width_chars =
-    {
-        { 0x00300, 0x0036f },
-        { 0x00483, 0x00489 },
-        { 0x00591, 0x005bd },
-        { 0x005bf, 0x005bf },
-        { 0x005c1, 0x005c2 },
-        { 0x005c4, 0x005c5 },
-        { 0x005c7, 0x005c7 },
-        { 0x00610, 0x0061a },
-        { 0x0064b, 0x0065f },
-        { 0x00670, 0x00670 },
-        { 0x006d6, 0x006dc },
-        { 0x006df, 0x006e4 },
-        { 0x006e7, 0x006e8 },
-        { 0x006ea, 0x006ed },
-        { 0x00711, 0x00711 },
-        { 0x00730, 0x0074a },
-        { 0x007a6, 0x007b0 },
-        { 0x007eb, 0x007f3 },
-        { 0x007fd, 0x007fd },
-        { 0x00816, 0x00819 },
-        { 0x0081b, 0x00823 },
-        { 0x00825, 0x00827 },
-        { 0x00829, 0x0082d },
-        { 0x00859, 0x0085b },
-        { 0x008d3, 0x008e1 },
-        { 0x008e3, 0x00902 },
-        { 0x0093a, 0x0093a },
-        { 0x0093c, 0x0093c },
-        { 0x00941, 0x00948 },
-        { 0x0094d, 0x0094d },
-        { 0x00951, 0x00957 },
-        { 0x00962, 0x00963 },
-        { 0x00981, 0x00981 },
-        { 0x009bc, 0x009bc },
-        { 0x009c1, 0x009c4 },
-        { 0x009cd, 0x009cd },
-        { 0x009e2, 0x009e3 },
-        { 0x009fe, 0x009fe },
-        { 0x00a01, 0x00a02 },
-        { 0x00a3c, 0x00a3c },
-        { 0x00a41, 0x00a42 },
-        { 0x00a47, 0x00a48 },
-        { 0x00a4b, 0x00a4d },
-        { 0x00a51, 0x00a51 },
-        { 0x00a70, 0x00a71 },
-        { 0x00a75, 0x00a75 },
-        { 0x00a81, 0x00a82 },
-        { 0x00abc, 0x00abc },
-        { 0x00ac1, 0x00ac5 },
-        { 0x00ac7, 0x00ac8 },
-        { 0x00acd, 0x00acd },
-        { 0x00ae2, 0x00ae3 },
-        { 0x00afa, 0x00aff },
-        { 0x00b01, 0x00b01 },
-        { 0x00b3c, 0x00b3c },
-        { 0x00b3f, 0x00b3f },
-        { 0x00b41, 0x00b44 },
-        { 0x00b4d, 0x00b4d },
-        { 0x00b55, 0x00b56 },
-        { 0x00b62, 0x00b63 },
-        { 0x00b82, 0x00b82 },
-        { 0x00bc0, 0x00bc0 },
-        { 0x00bcd, 0x00bcd },
-        { 0x00c00, 0x00c00 },
-        { 0x00c04, 0x00c04 },
-        { 0x00c3e, 0x00c40 },
-        { 0x00c46, 0x00c48 },
-        { 0x00c4a, 0x00c4d },
-        { 0x00c55, 0x00c56 },
-        { 0x00c62, 0x00c63 },
-        { 0x00c81, 0x00c81 },
-        { 0x00cbc, 0x00cbc },
-        { 0x00cbf, 0x00cbf },
-        { 0x00cc6, 0x00cc6 },
-        { 0x00ccc, 0x00ccd },
-        { 0x00ce2, 0x00ce3 },
-        { 0x00d00, 0x00d01 },
-        { 0x00d3b, 0x00d3c },
-        { 0x00d41, 0x00d44 },
-        { 0x00d4d, 0x00d4d },
-        { 0x00d62, 0x00d63 },
-        { 0x00d81, 0x00d81 },
-        { 0x00dca, 0x00dca },
-        { 0x00dd2, 0x00dd4 },
-        { 0x00dd6, 0x00dd6 },
-        { 0x00e31, 0x00e31 },
-        { 0x00e34, 0x00e3a },
-        { 0x00e47, 0x00e4e },
-        { 0x00eb1, 0x00eb1 },
-        { 0x00eb4, 0x00ebc },
-        { 0x00ec8, 0x00ecd },
-        { 0x00f18, 0x00f19 },
-        { 0x00f35, 0x00f35 },
-        { 0x00f37, 0x00f37 },
-        { 0x00f39, 0x00f39 },
-        { 0x00f71, 0x00f7e },
-        { 0x00f80, 0x00f84 },
-        { 0x00f86, 0x00f87 },
-        { 0x00f8d, 0x00f97 },
-        { 0x00f99, 0x00fbc },
-        { 0x00fc6, 0x00fc6 },
-        { 0x0102d, 0x01030 },
-        { 0x01032, 0x01037 },
-        { 0x01039, 0x0103a },
-        { 0x0103d, 0x0103e },
-        { 0x01058, 0x01059 },
-        { 0x0105e, 0x01060 },
-        { 0x01071, 0x01074 },
-        { 0x01082, 0x01082 },
-        { 0x01085, 0x01086 },
-        { 0x0108d, 0x0108d },
-        { 0x0109d, 0x0109d },
-        { 0x0135d, 0x0135f },
-        { 0x01712, 0x01714 },
-        { 0x01732, 0x01734 },
-        { 0x01752, 0x01753 },
-        { 0x01772, 0x01773 },
-        { 0x017b4, 0x017b5 },
-        { 0x017b7, 0x017bd },
-        { 0x017c6, 0x017c6 },
-        { 0x017c9, 0x017d3 },
-        { 0x017dd, 0x017dd },
-        { 0x0180b, 0x0180d },
-        { 0x01885, 0x01886 },
-        { 0x018a9, 0x018a9 },
-        { 0x01920, 0x01922 },
-        { 0x01927, 0x01928 },
-        { 0x01932, 0x01932 },
-        { 0x01939, 0x0193b },
-        { 0x01a17, 0x01a18 },
-        { 0x01a1b, 0x01a1b },
-        { 0x01a56, 0x01a56 },
-        { 0x01a58, 0x01a5e },
-        { 0x01a60, 0x01a60 },
-        { 0x01a62, 0x01a62 },
-        { 0x01a65, 0x01a6c },
-        { 0x01a73, 0x01a7c },
-        { 0x01a7f, 0x01a7f },
-        { 0x01ab0, 0x01ac0 },
-        { 0x01b00, 0x01b03 },
-        { 0x01b34, 0x01b34 },
-        { 0x01b36, 0x01b3a },
-        { 0x01b3c, 0x01b3c },
-        { 0x01b42, 0x01b42 },
-        { 0x01b6b, 0x01b73 },
-        { 0x01b80, 0x01b81 },
-        { 0x01ba2, 0x01ba5 },
-        { 0x01ba8, 0x01ba9 },
-        { 0x01bab, 0x01bad },
-        { 0x01be6, 0x01be6 },
-        { 0x01be8, 0x01be9 },
-        { 0x01bed, 0x01bed },
-        { 0x01bef, 0x01bf1 },
-        { 0x01c2c, 0x01c33 },
-        { 0x01c36, 0x01c37 },
-        { 0x01cd0, 0x01cd2 },
-        { 0x01cd4, 0x01ce0 },
-        { 0x01ce2, 0x01ce8 },
-        { 0x01ced, 0x01ced },
-        { 0x01cf4, 0x01cf4 },
-        { 0x01cf8, 0x01cf9 },
-        { 0x01dc0, 0x01df9 },
-        { 0x01dfb, 0x01dff },
-        { 0x020d0, 0x020f0 },
-        { 0x02cef, 0x02cf1 },
-        { 0x02d7f, 0x02d7f },
-        { 0x02de0, 0x02dff },
-        { 0x0302a, 0x0302d },
-        { 0x03099, 0x0309a },
-        { 0x0a66f, 0x0a672 },
-        { 0x0a674, 0x0a67d },
-        { 0x0a69e, 0x0a69f },
-        { 0x0a6f0, 0x0a6f1 },
-        { 0x0a802, 0x0a802 },
-        { 0x0a806, 0x0a806 },
-        { 0x0a80b, 0x0a80b },
-        { 0x0a825, 0x0a826 },
-        { 0x0a82c, 0x0a82c },
-        { 0x0a8c4, 0x0a8c5 },
-        { 0x0a8e0, 0x0a8f1 },
-        { 0x0a8ff, 0x0a8ff },
-        { 0x0a926, 0x0a92d },
-        { 0x0a947, 0x0a951 },
-        { 0x0a980, 0x0a982 },
-        { 0x0a9b3, 0x0a9b3 },
-        { 0x0a9b6, 0x0a9b9 },
-        { 0x0a9bc, 0x0a9bd },
-        { 0x0a9e5, 0x0a9e5 },
-        { 0x0aa29, 0x0aa2e },
-        { 0x0aa31, 0x0aa32 },
-        { 0x0aa35, 0x0aa36 },
-        { 0x0aa43, 0x0aa43 },
-        { 0x0aa4c, 0x0aa4c },
-        { 0x0aa7c, 0x0aa7c },
-        { 0x0aab0, 0x0aab0 },
-        { 0x0aab2, 0x0aab4 },
-        { 0x0aab7, 0x0aab8 },
-        { 0x0aabe, 0x0aabf },
-        { 0x0aac1, 0x0aac1 },
-        { 0x0aaec, 0x0aaed },
-        { 0x0aaf6, 0x0aaf6 },
-        { 0x0abe5, 0x0abe5 },
-        { 0x0abe8, 0x0abe8 },
-        { 0x0abed, 0x0abed },
-        { 0x0fb1e, 0x0fb1e },
-        { 0x0fe00, 0x0fe0f },
-        { 0x0fe20, 0x0fe2f },
-        { 0x101fd, 0x101fd },
-        { 0x102e0, 0x102e0 },
-        { 0x10376, 0x1037a },
-        { 0x10a01, 0x10a03 },
-        { 0x10a05, 0x10a06 },
-        { 0x10a0c, 0x10a0f },
-        { 0x10a38, 0x10a3a },
-        { 0x10a3f, 0x10a3f },
-        { 0x10ae5, 0x10ae6 },
-        { 0x10d24, 0x10d27 },
-        { 0x10eab, 0x10eac },
-        { 0x10f46, 0x10f50 },
-        { 0x11001, 0x11001 },
-        { 0x11038, 0x11046 },
-        { 0x1107f, 0x11081 },
-        { 0x110b3, 0x110b6 },
-        { 0x110b9, 0x110ba },
-        { 0x11100, 0x11102 },
-        { 0x11127, 0x1112b },
-        { 0x1112d, 0x11134 },
-        { 0x11173, 0x11173 },
-        { 0x11180, 0x11181 },
-        { 0x111b6, 0x111be },
-        { 0x111c9, 0x111cc },
-        { 0x111cf, 0x111cf },
-        { 0x1122f, 0x11231 },
-        { 0x11234, 0x11234 },
-        { 0x11236, 0x11237 },
-        { 0x1123e, 0x1123e },
-        { 0x112df, 0x112df },
-        { 0x112e3, 0x112ea },
-        { 0x11300, 0x11301 },
-        { 0x1133b, 0x1133c },
-        { 0x11340, 0x11340 },
-        { 0x11366, 0x1136c },
-        { 0x11370, 0x11374 },
-        { 0x11438, 0x1143f },
-        { 0x11442, 0x11444 },
-        { 0x11446, 0x11446 },
-        { 0x1145e, 0x1145e },
-        { 0x114b3, 0x114b8 },
-        { 0x114ba, 0x114ba },
-        { 0x114bf, 0x114c0 },
-        { 0x114c2, 0x114c3 },
-        { 0x115b2, 0x115b5 },
-        { 0x115bc, 0x115bd },
-        { 0x115bf, 0x115c0 },
-        { 0x115dc, 0x115dd },
-        { 0x11633, 0x1163a },
-        { 0x1163d, 0x1163d },
-        { 0x1163f, 0x11640 },
-        { 0x116ab, 0x116ab },
-        { 0x116ad, 0x116ad },
-        { 0x116b0, 0x116b5 },
-        { 0x116b7, 0x116b7 },
-        { 0x1171d, 0x1171f },
-        { 0x11722, 0x11725 },
-        { 0x11727, 0x1172b },
-        { 0x1182f, 0x11837 },
-        { 0x11839, 0x1183a },
-        { 0x1193b, 0x1193c },
-        { 0x1193e, 0x1193e },
-        { 0x11943, 0x11943 },
-        { 0x119d4, 0x119d7 },
-        { 0x119da, 0x119db },
-        { 0x119e0, 0x119e0 },
-        { 0x11a01, 0x11a0a },
-        { 0x11a33, 0x11a38 },
-        { 0x11a3b, 0x11a3e },
-        { 0x11a47, 0x11a47 },
-        { 0x11a51, 0x11a56 },
-        { 0x11a59, 0x11a5b },
-        { 0x11a8a, 0x11a96 },
-        { 0x11a98, 0x11a99 },
-        { 0x11c30, 0x11c36 },
-        { 0x11c38, 0x11c3d },
-        { 0x11c3f, 0x11c3f },
-        { 0x11c92, 0x11ca7 },
-        { 0x11caa, 0x11cb0 },
-        { 0x11cb2, 0x11cb3 },
-        { 0x11cb5, 0x11cb6 },
-        { 0x11d31, 0x11d36 },
-        { 0x11d3a, 0x11d3a },
-        { 0x11d3c, 0x11d3d },
-        { 0x11d3f, 0x11d45 },
-        { 0x11d47, 0x11d47 },
-        { 0x11d90, 0x11d91 },
-        { 0x11d95, 0x11d95 },
-        { 0x11d97, 0x11d97 },
-        { 0x11ef3, 0x11ef4 },
-        { 0x16af0, 0x16af4 },
-        { 0x16b30, 0x16b36 },
-        { 0x16f4f, 0x16f4f },
-        { 0x16f8f, 0x16f92 },
-        { 0x16fe4, 0x16fe4 },
-        { 0x1bc9d, 0x1bc9e },
-        { 0x1d167, 0x1d169 },
-        { 0x1d17b, 0x1d182 },
-        { 0x1d185, 0x1d18b },
-        { 0x1d1aa, 0x1d1ad },
-        { 0x1d242, 0x1d244 },
-        { 0x1da00, 0x1da36 },
-        { 0x1da3b, 0x1da6c },
-        { 0x1da75, 0x1da75 },
-        { 0x1da84, 0x1da84 },
-        { 0x1da9b, 0x1da9f },
-        { 0x1daa1, 0x1daaf },
-        { 0x1e000, 0x1e006 },
-        { 0x1e008, 0x1e018 },
-        { 0x1e01b, 0x1e021 },
-        { 0x1e023, 0x1e024 },
-        { 0x1e026, 0x1e02a },
-        { 0x1e130, 0x1e136 },
-        { 0x1e2ec, 0x1e2ef },
-        { 0x1e8d0, 0x1e8d6 },
-        { 0x1e944, 0x1e94a },
-        { 0xe0100, 0xe01ef }
-    };
-
     static std::vector<char_range_t> utf_chars =
     {
         { 0x01100, 0x0115f },
@@ -623,678 +1008,7201 @@ static int get_wchar_width(wchar_t c)
     return 1;
 }
 
-namespace libquest
+static wchar_t decode_utf8(const char *str, size_t len)
 {
-    std::string input_t::run()
+    unsigned char c = str[0];
+    int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+    wchar_t result = extra ? c & (0x3F >> extra) : c;
+
+    for (int i = 1; i <= extra && i < len; i++)
     {
-        std::string result;
+        result = (result << 6) | (str[i] & 0x3F);
+    }
 
-        change_term_style(STYLE1);
-        std::cout << "? ";
-        change_term_style(STYLE2);
-        std::cout << question_text << " ";
-        change_term_style(STYLE_CLEAR);
-        std::cout.flush();
+    return result;
+}
 
-        getline(std::cin, result);
+// Grapheme clusters
+//
+// What the user sees as one character can be several code points: a letter
+// with combining marks, a flag made of two regional indicators, or an emoji
+// joined to others with ZWJs. Widths are measured per cluster so these take
+// up the columns the terminal actually gives them. The break rules are the
+// ones from https://www.unicode.org/reports/tr29/
 
-        if (result.empty())
-        {
-            result = default_option;
-        }
+enum grapheme_property
+{
+    GRAPHEME_OTHER,
+    GRAPHEME_CR,
+    GRAPHEME_LF,
+    GRAPHEME_CONTROL,
+    GRAPHEME_EXTEND,
+    GRAPHEME_ZWJ,
+    GRAPHEME_REGIONAL_INDICATOR,
+    GRAPHEME_PREPEND,
+    GRAPHEME_SPACING_MARK,
+    GRAPHEME_L,
+    GRAPHEME_V,
+    GRAPHEME_T,
+    GRAPHEME_LV,
+    GRAPHEME_LVT,
+    GRAPHEME_PICTOGRAPHIC,
+    GRAPHEME_PROPERTY_COUNT
+};
 
-        erase_term_lines(1);
+struct property_range_t
+{
+    char32_t start;
+    char32_t end;
+    grapheme_property property;
+};
 
-        change_term_style(STYLE1);
-        std::cout << "? ";
-        change_term_style(STYLE2);
-        std::cout << question_text << " ";
-        change_term_style(STYLE3);
-        std::cout << result << std::endl;
-        change_term_style(STYLE_CLEAR);
+// Applied in order on top of the zero width table, which supplies Extend.
+// Hangul syllables are worked out arithmetically.
+static const property_range_t grapheme_property_ranges[] =
+{
+    { 0x0000, 0x001F, GRAPHEME_CONTROL },
+    { 0x000A, 0x000A, GRAPHEME_LF },
+    { 0x000D, 0x000D, GRAPHEME_CR },
+    { 0x007F, 0x009F, GRAPHEME_CONTROL },
+    { 0x00AD, 0x00AD, GRAPHEME_CONTROL },
+    { 0x0600, 0x0605, GRAPHEME_PREPEND },
+    { 0x06DD, 0x06DD, GRAPHEME_PREPEND },
+    { 0x070F, 0x070F, GRAPHEME_PREPEND },
+    { 0x0890, 0x0891, GRAPHEME_PREPEND },
+    { 0x08E2, 0x08E2, GRAPHEME_PREPEND },
+    { 0x0903, 0x0903, GRAPHEME_SPACING_MARK },
+    { 0x093B, 0x093B, GRAPHEME_SPACING_MARK },
+    { 0x093E, 0x0940, GRAPHEME_SPACING_MARK },
+    { 0x0949, 0x094C, GRAPHEME_SPACING_MARK },
+    { 0x094E, 0x094F, GRAPHEME_SPACING_MARK },
+    { 0x0982, 0x0983, GRAPHEME_SPACING_MARK },
+    { 0x09BF, 0x09C0, GRAPHEME_SPACING_MARK },
+    { 0x09C7, 0x09C8, GRAPHEME_SPACING_MARK },
+    { 0x09CB, 0x09CC, GRAPHEME_SPACING_MARK },
+    { 0x0A03, 0x0A03, GRAPHEME_SPACING_MARK },
+    { 0x0A3E, 0x0A40, GRAPHEME_SPACING_MARK },
+    { 0x0A83, 0x0A83, GRAPHEME_SPACING_MARK },
+    { 0x0ABE, 0x0AC0, GRAPHEME_SPACING_MARK },
+    { 0x0AC9, 0x0AC9, GRAPHEME_SPACING_MARK },
+    { 0x0ACB, 0x0ACC, GRAPHEME_SPACING_MARK },
+    { 0x0B02, 0x0B03, GRAPHEME_SPACING_MARK },
+    { 0x0B40, 0x0B40, GRAPHEME_SPACING_MARK },
+    { 0x0B47, 0x0B48, GRAPHEME_SPACING_MARK },
+    { 0x0B4B, 0x0B4C, GRAPHEME_SPACING_MARK },
+    { 0x0BBF, 0x0BBF, GRAPHEME_SPACING_MARK },
+    { 0x0BC1, 0x0BC2, GRAPHEME_SPACING_MARK },
+    { 0x0BC6, 0x0BC8, GRAPHEME_SPACING_MARK },
+    { 0x0BCA, 0x0BCC, GRAPHEME_SPACING_MARK },
+    { 0x0C01, 0x0C03, GRAPHEME_SPACING_MARK },
+    { 0x0C41, 0x0C44, GRAPHEME_SPACING_MARK },
+    { 0x0C82, 0x0C83, GRAPHEME_SPACING_MARK },
+    { 0x0D02, 0x0D03, GRAPHEME_SPACING_MARK },
+    { 0x0D3F, 0x0D40, GRAPHEME_SPACING_MARK },
+    { 0x0D46, 0x0D48, GRAPHEME_SPACING_MARK },
+    { 0x0D4A, 0x0D4C, GRAPHEME_SPACING_MARK },
+    { 0x0D4E, 0x0D4E, GRAPHEME_PREPEND },
+    { 0x0D82, 0x0D83, GRAPHEME_SPACING_MARK },
+    { 0x0DD0, 0x0DD1, GRAPHEME_SPACING_MARK },
+    { 0x0DD8, 0x0DDE, GRAPHEME_SPACING_MARK },
+    { 0x0DF2, 0x0DF3, GRAPHEME_SPACING_MARK },
+    { 0x0E33, 0x0E33, GRAPHEME_SPACING_MARK },
+    { 0x0EB3, 0x0EB3, GRAPHEME_SPACING_MARK },
+    { 0x0F3E, 0x0F3F, GRAPHEME_SPACING_MARK },
+    { 0x0F7F, 0x0F7F, GRAPHEME_SPACING_MARK },
+    { 0x1031, 0x1031, GRAPHEME_SPACING_MARK },
+    { 0x103B, 0x103C, GRAPHEME_SPACING_MARK },
+    { 0x1056, 0x1057, GRAPHEME_SPACING_MARK },
+    { 0x1084, 0x1084, GRAPHEME_SPACING_MARK },
+    { 0x1100, 0x115F, GRAPHEME_L },
+    { 0x1160, 0x11A7, GRAPHEME_V },
+    { 0x11A8, 0x11FF, GRAPHEME_T },
+    { 0x17B6, 0x17B6, GRAPHEME_SPACING_MARK },
+    { 0x17BE, 0x17C5, GRAPHEME_SPACING_MARK },
+    { 0x17C7, 0x17C8, GRAPHEME_SPACING_MARK },
+    { 0x180E, 0x180E, GRAPHEME_CONTROL },
+    { 0x200B, 0x200B, GRAPHEME_CONTROL },
+    { 0x200C, 0x200C, GRAPHEME_EXTEND },
+    { 0x200D, 0x200D, GRAPHEME_ZWJ },
+    { 0x200E, 0x200F, GRAPHEME_CONTROL },
+    { 0x2028, 0x202E, GRAPHEME_CONTROL },
+    { 0x203C, 0x203C, GRAPHEME_PICTOGRAPHIC },
+    { 0x2049, 0x2049, GRAPHEME_PICTOGRAPHIC },
+    { 0x2060, 0x206F, GRAPHEME_CONTROL },
+    { 0x2122, 0x2122, GRAPHEME_PICTOGRAPHIC },
+    { 0x2139, 0x2139, GRAPHEME_PICTOGRAPHIC },
+    { 0x2194, 0x2199, GRAPHEME_PICTOGRAPHIC },
+    { 0x21A9, 0x21AA, GRAPHEME_PICTOGRAPHIC },
+    { 0x231A, 0x231B, GRAPHEME_PICTOGRAPHIC },
+    { 0x2328, 0x2328, GRAPHEME_PICTOGRAPHIC },
+    { 0x2388, 0x2388, GRAPHEME_PICTOGRAPHIC },
+    { 0x23CF, 0x23CF, GRAPHEME_PICTOGRAPHIC },
+    { 0x23E9, 0x23F3, GRAPHEME_PICTOGRAPHIC },
+    { 0x23F8, 0x23FA, GRAPHEME_PICTOGRAPHIC },
+    { 0x24C2, 0x24C2, GRAPHEME_PICTOGRAPHIC },
+    { 0x25AA, 0x25AB, GRAPHEME_PICTOGRAPHIC },
+    { 0x25B6, 0x25B6, GRAPHEME_PICTOGRAPHIC },
+    { 0x25C0, 0x25C0, GRAPHEME_PICTOGRAPHIC },
+    { 0x25FB, 0x25FE, GRAPHEME_PICTOGRAPHIC },
+    { 0x2600, 0x2605, GRAPHEME_PICTOGRAPHIC },
+    { 0x2607, 0x2612, GRAPHEME_PICTOGRAPHIC },
+    { 0x2614, 0x2685, GRAPHEME_PICTOGRAPHIC },
+    { 0x2690, 0x2705, GRAPHEME_PICTOGRAPHIC },
+    { 0x2708, 0x2712, GRAPHEME_PICTOGRAPHIC },
+    { 0x2714, 0x2714, GRAPHEME_PICTOGRAPHIC },
+    { 0x2716, 0x2716, GRAPHEME_PICTOGRAPHIC },
+    { 0x271D, 0x271D, GRAPHEME_PICTOGRAPHIC },
+    { 0x2721, 0x2721, GRAPHEME_PICTOGRAPHIC },
+    { 0x2728, 0x2728, GRAPHEME_PICTOGRAPHIC },
+    { 0x2733, 0x2734, GRAPHEME_PICTOGRAPHIC },
+    { 0x2744, 0x2744, GRAPHEME_PICTOGRAPHIC },
+    { 0x2747, 0x2747, GRAPHEME_PICTOGRAPHIC },
+    { 0x274C, 0x274C, GRAPHEME_PICTOGRAPHIC },
+    { 0x274E, 0x274E, GRAPHEME_PICTOGRAPHIC },
+    { 0x2753, 0x2755, GRAPHEME_PICTOGRAPHIC },
+    { 0x2757, 0x2757, GRAPHEME_PICTOGRAPHIC },
+    { 0x2763, 0x2767, GRAPHEME_PICTOGRAPHIC },
+    { 0x2795, 0x2797, GRAPHEME_PICTOGRAPHIC },
+    { 0x27A1, 0x27A1, GRAPHEME_PICTOGRAPHIC },
+    { 0x27B0, 0x27B0, GRAPHEME_PICTOGRAPHIC },
+    { 0x27BF, 0x27BF, GRAPHEME_PICTOGRAPHIC },
+    { 0x2934, 0x2935, GRAPHEME_PICTOGRAPHIC },
+    { 0x2B05, 0x2B07, GRAPHEME_PICTOGRAPHIC },
+    { 0x2B1B, 0x2B1C, GRAPHEME_PICTOGRAPHIC },
+    { 0x2B50, 0x2B50, GRAPHEME_PICTOGRAPHIC },
+    { 0x2B55, 0x2B55, GRAPHEME_PICTOGRAPHIC },
+    { 0x3030, 0x3030, GRAPHEME_PICTOGRAPHIC },
+    { 0x303D, 0x303D, GRAPHEME_PICTOGRAPHIC },
+    { 0x3297, 0x3297, GRAPHEME_PICTOGRAPHIC },
+    { 0x3299, 0x3299, GRAPHEME_PICTOGRAPHIC },
+    { 0xA960, 0xA97C, GRAPHEME_L },
+    { 0xD7B0, 0xD7C6, GRAPHEME_V },
+    { 0xD7CB, 0xD7FB, GRAPHEME_T },
+    { 0xFEFF, 0xFEFF, GRAPHEME_CONTROL },
+    { 0xFFF0, 0xFFFB, GRAPHEME_CONTROL },
+    { 0x110BD, 0x110BD, GRAPHEME_PREPEND },
+    { 0x110CD, 0x110CD, GRAPHEME_PREPEND },
+    { 0x1F000, 0x1F0FF, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F10D, 0x1F10F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F12F, 0x1F12F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F16C, 0x1F171, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F17E, 0x1F17F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F18E, 0x1F18E, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F191, 0x1F19A, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F1AD, 0x1F1E5, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F1E6, 0x1F1FF, GRAPHEME_REGIONAL_INDICATOR },
+    { 0x1F201, 0x1F20F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F21A, 0x1F21A, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F22F, 0x1F22F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F232, 0x1F23A, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F23C, 0x1F23F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F249, 0x1F3FA, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F3FB, 0x1F3FF, GRAPHEME_EXTEND },
+    { 0x1F400, 0x1F53D, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F546, 0x1F64F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F680, 0x1F6FF, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F774, 0x1F77F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F7D5, 0x1F7FF, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F80C, 0x1F80F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F848, 0x1F84F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F85A, 0x1F85F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F888, 0x1F88F, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F8AE, 0x1F8FF, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F90C, 0x1F93A, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F93C, 0x1F945, GRAPHEME_PICTOGRAPHIC },
+    { 0x1F947, 0x1FAFF, GRAPHEME_PICTOGRAPHIC },
+    { 0x1FC00, 0x1FFFD, GRAPHEME_PICTOGRAPHIC },
+    { 0xE0000, 0xE001F, GRAPHEME_CONTROL },
+    { 0xE0020, 0xE007F, GRAPHEME_EXTEND },
+    { 0xE0080, 0xE00FF, GRAPHEME_CONTROL },
+};
 
-        return result;
-    }
+#define GRAPHEME_BLOCK_BITS 8
+#define GRAPHEME_BLOCK_SIZE (1 << GRAPHEME_BLOCK_BITS)
+#define MAX_CODE_POINT 0x10FFFF
 
-    std::string multiline_t::run()
+// A two stage lookup table: the code point's block picks one of the distinct
+// 256 entry blocks, most of which are shared, and the low bits index into it.
+struct grapheme_table_t
+{
+    std::vector<uint16_t> block_index;
+    std::vector<uint8_t> blocks;
+
+    grapheme_table_t()
     {
-        std::string result;
+        std::vector<uint8_t> properties(MAX_CODE_POINT + 1, GRAPHEME_OTHER);
 
-        change_term_style(STYLE1);
-        std::cout << "? ";
-        change_term_style(STYLE2);
-        std::cout << question_text;
-        change_term_style(STYLE3);
-        std::cout << " [Enter 2 empty lines to finish]\n";
-        change_term_style(STYLE_CLEAR);
-        std::cout.flush();
+        for (auto &range : utf_zero_width_chars)
+        {
+            std::fill(properties.begin() + range.start, properties.begin() + range.end + 1, GRAPHEME_EXTEND);
+        }
 
-        int blanks = 0;
-        int line_num = 0;
+        for (auto &range : grapheme_property_ranges)
+        {
+            std::fill(properties.begin() + range.start, properties.begin() + range.end + 1, range.property);
+        }
 
-        while (!std::cin.eof())
+        for (char32_t c = 0xAC00; c <= 0xD7A3; c++)
         {
-            std::string line;
-            std::getline(std::cin, line);
+            properties[c] = (c - 0xAC00) % 28 == 0 ? GRAPHEME_LV : GRAPHEME_LVT;
+        }
 
-            if (std::cin.fail())
-            {
-                break;
-            }
+        std::map<std::string, uint16_t> seen;
 
-            if (line.empty() && line_num == 0)
-            {
-                result = default_option;
+        for (size_t start = 0; start <= MAX_CODE_POINT; start += GRAPHEME_BLOCK_SIZE)
+        {
+            std::string block((const char *)properties.data() + start, GRAPHEME_BLOCK_SIZE);
+            auto it = seen.find(block);
 
-                break;
+            if (it == seen.end())
+            {
+                it = seen.emplace(block, blocks.size() / GRAPHEME_BLOCK_SIZE).first;
+                blocks.insert(blocks.end(), block.begin(), block.end());
             }
 
-            if (line.empty())
-            {
-                blanks++;
+            block_index.push_back(it->second);
+        }
+    }
 
-                if (blanks == 2)
-                {
-                    break;
-                }
-            }
+    grapheme_property get(char32_t c) const
+    {
+        if (c > MAX_CODE_POINT)
+        {
+            return GRAPHEME_OTHER;
+        }
+
+        return (grapheme_property)blocks[block_index[c >> GRAPHEME_BLOCK_BITS] * GRAPHEME_BLOCK_SIZE + (c & (GRAPHEME_BLOCK_SIZE - 1))];
+    }
+};
+
+static grapheme_property get_grapheme_property(char32_t c)
+{
+    static const grapheme_table_t table;
+
+    return table.get(c);
+}
+
+enum
+{
+    GRAPHEME_BREAK,
+    GRAPHEME_JOIN,
+    // GB11, only joins when the ZWJ follows a pictograph and its extenders
+    GRAPHEME_JOIN_IF_EMOJI,
+    // GB12/13, regional indicators join in pairs
+    GRAPHEME_JOIN_IF_ODD_RI
+};
+
+// grapheme_rules[previous][next] says whether there is a boundary between them
+static const std::array<std::array<uint8_t, GRAPHEME_PROPERTY_COUNT>, GRAPHEME_PROPERTY_COUNT> grapheme_rules = []
+{
+    std::array<std::array<uint8_t, GRAPHEME_PROPERTY_COUNT>, GRAPHEME_PROPERTY_COUNT> rules {};
+
+    // later rules take precedence, so they are written over the earlier ones
+    rules[GRAPHEME_REGIONAL_INDICATOR][GRAPHEME_REGIONAL_INDICATOR] = GRAPHEME_JOIN_IF_ODD_RI;
+    rules[GRAPHEME_ZWJ][GRAPHEME_PICTOGRAPHIC] = GRAPHEME_JOIN_IF_EMOJI;
+
+    for (int i = 0; i < GRAPHEME_PROPERTY_COUNT; i++)
+    {
+        rules[GRAPHEME_PREPEND][i] = GRAPHEME_JOIN;
+        rules[i][GRAPHEME_SPACING_MARK] = GRAPHEME_JOIN;
+        rules[i][GRAPHEME_EXTEND] = GRAPHEME_JOIN;
+        rules[i][GRAPHEME_ZWJ] = GRAPHEME_JOIN;
+    }
+
+    rules[GRAPHEME_LVT][GRAPHEME_T] = GRAPHEME_JOIN;
+    rules[GRAPHEME_T][GRAPHEME_T] = GRAPHEME_JOIN;
+    rules[GRAPHEME_LV][GRAPHEME_V] = GRAPHEME_JOIN;
+    rules[GRAPHEME_LV][GRAPHEME_T] = GRAPHEME_JOIN;
+    rules[GRAPHEME_V][GRAPHEME_V] = GRAPHEME_JOIN;
+    rules[GRAPHEME_V][GRAPHEME_T] = GRAPHEME_JOIN;
+    rules[GRAPHEME_L][GRAPHEME_L] = GRAPHEME_JOIN;
+    rules[GRAPHEME_L][GRAPHEME_V] = GRAPHEME_JOIN;
+    rules[GRAPHEME_L][GRAPHEME_LV] = GRAPHEME_JOIN;
+    rules[GRAPHEME_L][GRAPHEME_LVT] = GRAPHEME_JOIN;
+
+    for (int i = 0; i < GRAPHEME_PROPERTY_COUNT; i++)
+    {
+        for (int control : { GRAPHEME_CR, GRAPHEME_LF, GRAPHEME_CONTROL })
+        {
+            rules[i][control] = GRAPHEME_BREAK;
+            rules[control][i] = GRAPHEME_BREAK;
+        }
+    }
+
+    rules[GRAPHEME_CR][GRAPHEME_LF] = GRAPHEME_JOIN;
+
+    return rules;
+}();
+
+// Walks a text one code point at a time and reports where clusters start.
+struct grapheme_breaker_t
+{
+    grapheme_property previous = GRAPHEME_CONTROL;
+    bool started = false;
+
+    // 1 after a pictograph and any extenders, 2 once a ZWJ follows them
+    int emoji_state = 0;
+    int regional_indicators = 0;
+
+    bool is_boundary(char32_t c)
+    {
+        grapheme_property property = get_grapheme_property(c);
+        bool boundary = true;
+
+        if (started)
+        {
+            switch (grapheme_rules[previous][property])
+            {
+            case GRAPHEME_JOIN:
+                boundary = false;
+                break;
+            case GRAPHEME_JOIN_IF_EMOJI:
+                boundary = emoji_state != 2;
+                break;
+            case GRAPHEME_JOIN_IF_ODD_RI:
+                boundary = regional_indicators % 2 == 0;
+                break;
+            }
+        }
+
+        if (property == GRAPHEME_PICTOGRAPHIC)
+        {
+            emoji_state = 1;
+        }
+        else if (property == GRAPHEME_ZWJ && emoji_state == 1)
+        {
+            emoji_state = 2;
+        }
+        else if (property != GRAPHEME_EXTEND || emoji_state != 1)
+        {
+            emoji_state = 0;
+        }
+
+        regional_indicators = property == GRAPHEME_REGIONAL_INDICATOR ? regional_indicators + 1 : 0;
+        previous = property;
+        started = true;
+
+        return boundary;
+    }
+};
+
+template <typename CharT>
+static char32_t next_code_point(const CharT *&it, const CharT *end)
+{
+    if constexpr (sizeof(CharT) == 1)
+    {
+        unsigned char c = *it;
+        size_t len = std::min<size_t>(c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1, end - it);
+        char32_t result = decode_utf8((const char *)it, len);
+
+        it += len;
+
+        return result;
+    }
+    else
+    {
+        return *it++;
+    }
+}
+
+// Adds up the width of every grapheme cluster in [it, end). A cluster is as
+// wide as its widest code point, except that flags and emoji presentation
+// selectors always take two columns.
+template <typename CharT>
+static size_t measure_width(const CharT *it, const CharT *end)
+{
+    grapheme_breaker_t breaker;
+    size_t total = 0;
+    int cluster_width = 0;
+
+    while (it != end)
+    {
+        // printable ASCII followed by more ASCII is always a cluster on its own,
+        // so most text never reaches the break rules
+        if (*it >= 0x20 && *it < 0x7F && it + 1 != end && (std::make_unsigned_t<CharT>)it[1] < 0x80 &&
+            breaker.previous != GRAPHEME_PREPEND)
+        {
+            total += cluster_width + 1;
+            cluster_width = 0;
+            breaker = grapheme_breaker_t();
+            it++;
+
+            continue;
+        }
+
+        char32_t c = next_code_point(it, end);
+
+        if (breaker.is_boundary(c))
+        {
+            total += cluster_width;
+            cluster_width = 0;
+        }
+
+        int width = c == 0xFE0F || breaker.previous == GRAPHEME_REGIONAL_INDICATOR ? 2 : get_wchar_width(c);
+
+        cluster_width = std::max(cluster_width, width);
+    }
+
+    return total + cluster_width;
+}
+
+// width of a line of text, which may contain colour escape codes
+template <typename CharT>
+static size_t line_width(std::basic_string_view<CharT> line)
+{
+    const CharT escape_start[] = { 0x1b, '[', 0 };
+    size_t width = 0;
+
+    while (!line.empty())
+    {
+        size_t escape = std::min(line.find(escape_start), line.size());
+
+        width += measure_width(line.data(), line.data() + escape);
+
+        size_t end = line.find(CharT('m'), escape);
+
+        if (end == std::basic_string_view<CharT>::npos)
+        {
+            break;
+        }
+
+        line.remove_prefix(end + 1);
+    }
+
+    return width;
+}
+
+// removes the last character of text, as long as it does not start before limit,
+// and rubs it out on the terminal. Combining marks, joined emoji and flags are
+// removed together with the character they belong to. Returns the offset it
+// was removed from.
+static size_t erase_last_char(std::string &text, size_t limit)
+{
+    if (text.size() <= limit)
+    {
+        return text.size();
+    }
+
+    grapheme_breaker_t breaker;
+    const char *end = text.data() + text.size();
+    size_t last = limit;
+
+    for (const char *it = text.data() + limit; it != end;)
+    {
+        const char *start = it;
+
+        if (breaker.is_boundary(next_code_point(it, end)))
+        {
+            last = start - text.data();
+        }
+    }
+
+    size_t width = std::max<size_t>(1, measure_width(text.data() + last, end));
+
+    text.erase(last);
+
+    for (size_t i = 0; i < width; i++)
+    {
+        std::cout << "\b \b";
+    }
+
+    return last;
+}
+
+// returns the end of the grapheme cluster that starts at pos
+static size_t next_cluster(std::string_view text, size_t pos)
+{
+    grapheme_breaker_t breaker;
+    const char *it = text.data() + pos;
+    const char *end = text.data() + text.size();
+
+    breaker.is_boundary(next_code_point(it, end));
+
+    while (it != end)
+    {
+        const char *start = it;
+
+        if (breaker.is_boundary(next_code_point(it, end)))
+        {
+            return start - text.data();
+        }
+    }
+
+    return text.size();
+}
+
+// how many bytes of whole clusters from the start of text fit in the given
+// number of columns, and how wide they are
+static size_t fit_width(std::string_view text, size_t columns, size_t &width)
+{
+    size_t pos = 0;
+
+    width = 0;
+
+    while (pos < text.size())
+    {
+        size_t next = next_cluster(text, pos);
+        size_t cluster_width = measure_width(text.data() + pos, text.data() + next);
+
+        if (width + cluster_width > columns)
+        {
+            break;
+        }
+
+        width += cluster_width;
+        pos = next;
+    }
+
+    return pos;
+}
+
+static size_t terminal_columns()
+{
+    struct winsize size;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0)
+    {
+        return size.ws_col;
+    }
+
+    return 80;
+}
+
+// How many lines of a terminal columns wide text takes up, where every line
+// ends in a line break and those wider than the terminal wrap onto more.
+static size_t wrapped_lines(std::string_view text, size_t columns)
+{
+    size_t lines = 0;
+
+    for (size_t start = 0, end; start < text.size(); start = end + 1)
+    {
+        end = std::min(text.find('\n', start), text.size());
+        lines += std::max<size_t>((line_width(text.substr(start, end - start)) + columns - 1) / columns, 1);
+    }
+
+    return lines;
+}
+
+static size_t terminal_rows()
+{
+    struct winsize size;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0)
+    {
+        return size.ws_row;
+    }
+
+    return 24;
+}
+
+// Text with a gap at the edit position, so typing and deleting there only
+// moves the ends of the gap. Moving the gap elsewhere costs the distance moved.
+class gap_buffer_t
+{
+public:
+    size_t size() const
+    {
+        return data.size() - (gap_end - gap_start);
+    }
+
+    char at(size_t pos) const
+    {
+        return pos < gap_start ? data[pos] : data[pos + gap_end - gap_start];
+    }
+
+    void insert(size_t pos, std::string_view text)
+    {
+        move_gap(pos);
+
+        if (gap_end - gap_start < text.size())
+        {
+            grow(text.size());
+        }
+
+        std::copy(text.begin(), text.end(), data.begin() + gap_start);
+        gap_start += text.size();
+    }
+
+    void erase(size_t from, size_t to)
+    {
+        move_gap(to);
+        gap_start = from;
+    }
+
+    void assign(std::string_view text)
+    {
+        gap_start = gap_end = data.size();
+        erase(0, size());
+        insert(0, text);
+    }
+
+    // copies [from, to) onto the end of out
+    template <typename String>
+    void copy(size_t from, size_t to, String &out) const
+    {
+        if (from < gap_start)
+        {
+            out.append(data.data() + from, std::min(to, gap_start) - from);
+        }
+
+        if (to > gap_start)
+        {
+            from = std::max(from, gap_start);
+            out.append(data.data() + from + gap_end - gap_start, to - from);
+        }
+    }
+
+    // the whole text in one piece, which moves the gap to the end
+    std::string_view view()
+    {
+        move_gap(size());
+
+        return std::string_view(data.data(), gap_start);
+    }
+
+private:
+    std::pmr::string data { libquest::working_memory() };
+    size_t gap_start = 0;
+    size_t gap_end = 0;
+
+    void move_gap(size_t pos)
+    {
+        if (pos < gap_start)
+        {
+            std::copy_backward(data.begin() + pos, data.begin() + gap_start, data.begin() + gap_end);
+        }
+        else
+        {
+            std::copy(data.begin() + gap_end, data.begin() + gap_end + pos - gap_start, data.begin() + gap_start);
+        }
+
+        gap_end += pos - gap_start;
+        gap_start = pos;
+    }
+
+    // at least doubles the capacity, so a long paste arriving in pieces is still
+    // linear. Short text stays in the string's inline storage.
+    void grow(size_t needed)
+    {
+        size_t tail = data.size() - gap_end;
+        size_t capacity = std::max({ data.size() * 2, size() + needed, data.capacity() });
+
+        data.resize(capacity);
+        std::copy_backward(data.begin() + gap_end, data.begin() + gap_end + tail, data.end());
+        gap_end = capacity - tail;
+    }
+};
+
+// Text as a sequence of pieces, each a slice of either the original text, which
+// is never copied, or of an append-only buffer holding everything added since.
+// The pieces sit in a treap ordered by position that keeps the number of bytes
+// and line breaks under every node, so edits and finding a line are O(log n).
+class piece_table_t
+{
+public:
+    explicit piece_table_t(std::string_view original)
+    : original(original)
+    {
+        for (size_t i = 0; i < original.size(); i++)
+        {
+            if (original[i] == '\n')
+            {
+                original_newlines.push_back(i);
+            }
+        }
+
+        root = new_node(false, 0, original.size());
+    }
+
+    size_t size() const
+    {
+        return bytes(root);
+    }
+
+    size_t line_count() const
+    {
+        return newlines(root) + 1;
+    }
+
+    void insert(size_t pos, std::string_view text)
+    {
+        if (text.empty())
+        {
+            return;
+        }
+
+        size_t start = added.size();
+
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '\n')
+            {
+                added_newlines.push_back(start + i);
+            }
+        }
+
+        added.append(text);
+
+        int left, right;
+
+        split(root, pos, left, right);
+        root = merge(merge(left, new_node(true, start, text.size())), right);
+    }
+
+    void erase(size_t from, size_t to)
+    {
+        if (from >= to)
+        {
+            return;
+        }
+
+        int left, middle, right;
+
+        split(root, to, middle, right);
+        split(middle, from, left, middle);
+        release(middle);
+        root = merge(left, right);
+    }
+
+    // offset of the first byte of a line, counting from 0
+    size_t line_start(size_t line) const
+    {
+        size_t offset = 0;
+        int t = root;
+
+        if (line == 0)
+        {
+            return 0;
+        }
+
+        while (t != NIL)
+        {
+            const node_t &node = nodes[t];
+            size_t before = newlines(node.left);
+
+            if (line <= before)
+            {
+                t = node.left;
+            }
+            else if (line <= before + node.newlines)
+            {
+                const auto &index = node.added ? added_newlines : original_newlines;
+                size_t at = *(std::lower_bound(index.begin(), index.end(), node.start) + (line - before - 1));
+
+                return offset + bytes(node.left) + at - node.start + 1;
+            }
             else
             {
-                blanks = 0;
+                line -= before + node.newlines;
+                offset += bytes(node.left) + node.length;
+                t = node.right;
+            }
+        }
+
+        return size();
+    }
+
+    // offset of the line break ending a line, or the size for the last line
+    size_t line_end(size_t line) const
+    {
+        return line + 1 < line_count() ? line_start(line + 1) - 1 : size();
+    }
+
+    // the line pos is on
+    size_t line_of(size_t pos) const
+    {
+        size_t line = 0;
+        int t = root;
+
+        while (t != NIL)
+        {
+            const node_t &node = nodes[t];
+            size_t before = bytes(node.left);
+
+            if (pos < before)
+            {
+                t = node.left;
+
+                continue;
+            }
+
+            line += newlines(node.left);
+            pos -= before;
+
+            if (pos <= node.length)
+            {
+                return line + count_newlines(node.added, node.start, node.start + pos);
+            }
+
+            line += node.newlines;
+            pos -= node.length;
+            t = node.right;
+        }
+
+        return line;
+    }
+
+    // copies [from, to) onto the end of out
+    void copy(size_t from, size_t to, std::string &out) const
+    {
+        copy(root, from, to, 0, out);
+    }
+
+private:
+    static constexpr int NIL = -1;
+
+    struct node_t
+    {
+        int left;
+        int right;
+        uint32_t priority;
+        bool added;
+        size_t start;
+        size_t length;
+        size_t newlines;
+
+        // totals for this node and everything under it
+        size_t total_bytes;
+        size_t total_newlines;
+    };
+
+    std::string_view original;
+    std::string added;
+    std::vector<size_t> original_newlines;
+    std::vector<size_t> added_newlines;
+    std::vector<node_t> nodes;
+    std::vector<int> free_nodes;
+    int root = NIL;
+    uint32_t seed = 0x9E3779B9;
+
+    size_t bytes(int t) const
+    {
+        return t == NIL ? 0 : nodes[t].total_bytes;
+    }
+
+    size_t newlines(int t) const
+    {
+        return t == NIL ? 0 : nodes[t].total_newlines;
+    }
+
+    size_t count_newlines(bool in_added, size_t from, size_t to) const
+    {
+        const auto &index = in_added ? added_newlines : original_newlines;
+
+        return std::lower_bound(index.begin(), index.end(), to) - std::lower_bound(index.begin(), index.end(), from);
+    }
+
+    int new_node(bool in_added, size_t start, size_t length)
+    {
+        if (length == 0)
+        {
+            return NIL;
+        }
+
+        // xorshift, the priorities only need to look random to keep the tree balanced
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        node_t node = { NIL, NIL, seed, in_added, start, length, count_newlines(in_added, start, start + length) };
+        int t;
+
+        if (free_nodes.empty())
+        {
+            t = nodes.size();
+            nodes.push_back(node);
+        }
+        else
+        {
+            t = free_nodes.back();
+            free_nodes.pop_back();
+            nodes[t] = node;
+        }
+
+        update(t);
+
+        return t;
+    }
+
+    void release(int t)
+    {
+        if (t != NIL)
+        {
+            release(nodes[t].left);
+            release(nodes[t].right);
+            free_nodes.push_back(t);
+        }
+    }
+
+    void update(int t)
+    {
+        node_t &node = nodes[t];
+
+        node.total_bytes = bytes(node.left) + node.length + bytes(node.right);
+        node.total_newlines = newlines(node.left) + node.newlines + newlines(node.right);
+    }
+
+    int merge(int left, int right)
+    {
+        if (left == NIL || right == NIL)
+        {
+            return left == NIL ? right : left;
+        }
+
+        if (nodes[left].priority > nodes[right].priority)
+        {
+            nodes[left].right = merge(nodes[left].right, right);
+            update(left);
+
+            return left;
+        }
+
+        nodes[right].left = merge(left, nodes[right].left);
+        update(right);
+
+        return right;
+    }
+
+    // splits t into the first pos bytes and the rest, cutting a piece in two if needed
+    void split(int t, size_t pos, int &left, int &right)
+    {
+        if (t == NIL)
+        {
+            left = right = NIL;
+
+            return;
+        }
+
+        size_t before = bytes(nodes[t].left);
+        int part;
+
+        if (pos <= before)
+        {
+            split(nodes[t].left, pos, left, part);
+            nodes[t].left = part;
+            right = t;
+        }
+        else if (pos >= before + nodes[t].length)
+        {
+            split(nodes[t].right, pos - before - nodes[t].length, part, right);
+            nodes[t].right = part;
+            left = t;
+        }
+        else
+        {
+            size_t cut = pos - before;
+            int tail = new_node(nodes[t].added, nodes[t].start + cut, nodes[t].length - cut);
+
+            nodes[t].length = cut;
+            nodes[t].newlines = count_newlines(nodes[t].added, nodes[t].start, nodes[t].start + cut);
+            right = merge(tail, nodes[t].right);
+            nodes[t].right = NIL;
+            left = t;
+        }
+
+        update(t);
+    }
+
+    void copy(int t, size_t from, size_t to, size_t offset, std::string &out) const
+    {
+        if (t == NIL || from >= to)
+        {
+            return;
+        }
+
+        const node_t &node = nodes[t];
+        size_t start = offset + bytes(node.left);
+        size_t end = start + node.length;
+
+        if (from < start)
+        {
+            copy(node.left, from, to, offset, out);
+        }
+
+        if (from < end && to > start)
+        {
+            const char *source = node.added ? added.data() : original.data();
+            size_t a = std::max(from, start) - start;
+            size_t b = std::min(to, end) - start;
+
+            out.append(source + node.start + a, b - a);
+        }
+
+        if (to > end)
+        {
+            copy(node.right, from, to, end, out);
+        }
+    }
+};
+
+namespace libquest
+{
+    // keys
+
+    // longest escape sequence we are willing to buffer before giving up on it
+    #define MAX_ESCAPE_SEQUENCE 32
+
+    // maps the final byte of a CSI or SS3 sequence, e.g. the 'A' in ESC[A, to a key
+    static const std::array<key_code, 128> final_byte_keys = []
+    {
+        std::array<key_code, 128> keys {};
+
+        keys['A'] = KEY_UP;
+        keys['B'] = KEY_DOWN;
+        keys['C'] = KEY_RIGHT;
+        keys['D'] = KEY_LEFT;
+        keys['H'] = KEY_HOME;
+        keys['F'] = KEY_END;
+        keys['P'] = KEY_F1;
+        keys['Q'] = KEY_F2;
+        keys['R'] = KEY_F3;
+        keys['S'] = KEY_F4;
+        keys['Z'] = KEY_TAB;
+
+        return keys;
+    }();
+
+    // maps the number in a CSI sequence ending in '~', e.g. the 5 in ESC[5~, to a key
+    static const std::array<key_code, 25> tilde_keys =
+    {
+        KEY_NONE, KEY_HOME, KEY_INSERT, KEY_DELETE, KEY_END, KEY_PAGE_UP, KEY_PAGE_DOWN, KEY_HOME, KEY_END,
+        KEY_NONE, KEY_NONE, KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_NONE, KEY_F6, KEY_F7, KEY_F8,
+        KEY_F9, KEY_F10, KEY_NONE, KEY_F11, KEY_F12
+    };
+
+    static bool is_text_byte(unsigned char c)
+    {
+        return c >= 0x20 && c != 0x7F;
+    }
+
+    // moves end back to the start of a UTF-8 sequence that has been cut off
+    static size_t utf8_boundary(const char *data, size_t start, size_t end)
+    {
+        for (size_t i = end; i > start && end - i < 4; i--)
+        {
+            unsigned char c = data[i - 1];
+
+            if ((c & 0xC0) == 0x80)
+            {
+                continue;
+            }
+
+            size_t expected = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+
+            return end - (i - 1) < expected ? i - 1 : end;
+        }
+
+        return end;
+    }
+
+    size_t key_decoder_t::decode_escape(const char *data, size_t len, bool final, key_event_t &event) const
+    {
+        event = {};
+
+        if (len < 2)
+        {
+            if (!final)
+            {
+                return 0;
+            }
+
+            event.key = KEY_ESCAPE;
+
+            return 1;
+        }
+
+        char type = data[1];
+
+        if (type == '[' || type == 'O')
+        {
+            size_t i = 2;
+
+            while (i < len && i < MAX_ESCAPE_SEQUENCE && (unsigned char)data[i] >= 0x20 && (unsigned char)data[i] < 0x40)
+            {
+                i++;
+            }
+
+            if (i == len && !final)
+            {
+                return 0;
+            }
+
+            unsigned char final_byte = i < len ? data[i] : 0;
+
+            if (final_byte < 0x40 || final_byte > 0x7E)
+            {
+                if (final)
+                {
+                    event.key = KEY_ESCAPE;
+
+                    return 1;
+                }
+
+                // malformed, drop everything up to the offending byte
+                return i;
+            }
+
+            int params[2] = { 0, 0 };
+            int param_count = 0;
+
+            for (size_t p = 2; p < i; p++)
+            {
+                if (data[p] == ';')
+                {
+                    param_count++;
+                }
+                else if (data[p] >= '0' && data[p] <= '9' && param_count < 2)
+                {
+                    params[param_count] = params[param_count] * 10 + (data[p] - '0');
+                }
+            }
+
+            if (final_byte == '~')
+            {
+                if (params[0] == 200)
+                {
+                    event.key = KEY_PASTE_BEGIN;
+                }
+                else if (params[0] == 201)
+                {
+                    event.key = KEY_PASTE_END;
+                }
+                else if (params[0] < tilde_keys.size())
+                {
+                    event.key = tilde_keys[params[0]];
+                }
+            }
+            else
+            {
+                event.key = final_byte_keys[final_byte];
+
+                if (final_byte == 'Z')
+                {
+                    event.modifiers |= KEY_MOD_SHIFT;
+                }
+            }
+
+            // xterm encodes modifiers as 1 + shift + alt * 2 + ctrl * 4
+            if (params[1] > 1)
+            {
+                event.modifiers |= (params[1] - 1) & (KEY_MOD_SHIFT | KEY_MOD_ALT | KEY_MOD_CTRL);
+            }
+
+            return i + 1;
+        }
+
+        unsigned char c = data[1];
+
+        if (c < 0x80 && c != 0x1B)
+        {
+            event.key = KEY_CHAR;
+            event.ch = c < 0x20 ? c + 0x60 : c;
+            event.modifiers = c < 0x20 ? KEY_MOD_ALT | KEY_MOD_CTRL : KEY_MOD_ALT;
+
+            return 2;
+        }
+
+        event.key = KEY_ESCAPE;
+
+        return 1;
+    }
+
+    size_t key_decoder_t::decode_paste(const char *data, size_t len, bool final, key_event_t &event)
+    {
+        static const std::string_view paste_end = "\x1b[201~";
+
+        std::string_view pending(data, len);
+        size_t end = pending.find(paste_end);
+
+        event = {};
+
+        if (end == 0)
+        {
+            in_paste = false;
+            event.key = KEY_PASTE_END;
+
+            return paste_end.size();
+        }
+
+        if (end == std::string_view::npos)
+        {
+            end = len;
+
+            // hold back anything that could be the start of the end marker
+            if (!final)
+            {
+                for (size_t n = std::min(len, paste_end.size() - 1); n > 0; n--)
+                {
+                    if (pending.substr(len - n) == paste_end.substr(0, n))
+                    {
+                        end = len - n;
+
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (end > 0)
+        {
+            event.key = KEY_TEXT;
+            event.text = pending.substr(0, end);
+        }
+
+        return end;
+    }
+
+    size_t key_decoder_t::decode(const char *data, size_t len, bool final, const key_handler_t &handler, bool &stopped)
+    {
+        size_t i = 0;
+
+        stopped = false;
+
+        while (i < len)
+        {
+            unsigned char c = data[i];
+            key_event_t event;
+            size_t next = i + 1;
+
+            if (in_paste)
+            {
+                size_t n = decode_paste(data + i, len - i, final, event);
+
+                if (n == 0)
+                {
+                    break;
+                }
+
+                next = i + n;
+            }
+            else if (is_text_byte(c))
+            {
+                next = i;
+
+                while (next < len && is_text_byte(data[next]))
+                {
+                    next++;
+                }
+
+                if (next == len && !final)
+                {
+                    next = utf8_boundary(data, i, next);
+
+                    if (next == i)
+                    {
+                        break;
+                    }
+                }
+
+                event.key = KEY_TEXT;
+                event.text = std::string_view(data + i, next - i);
+            }
+            else if (c == 0x1B)
+            {
+                size_t n = decode_escape(data + i, len - i, final, event);
+
+                if (n == 0)
+                {
+                    break;
+                }
+
+                next = i + n;
+                in_paste = event.key == KEY_PASTE_BEGIN;
+            }
+            else if (c == '\n' || c == '\r')
+            {
+                event.key = KEY_ENTER;
+            }
+            else if (c == '\t')
+            {
+                event.key = KEY_TAB;
+            }
+            else if (c == 0x7F || c == 0x08)
+            {
+                event.key = KEY_BACKSPACE;
+            }
+            else
+            {
+                event.key = KEY_CHAR;
+                event.ch = c + 0x60;
+                event.modifiers = KEY_MOD_CTRL;
+            }
+
+            i = next;
+
+            if (event.key != KEY_NONE && !handler(event))
+            {
+                stopped = true;
+
+                break;
+            }
+        }
+
+        return i;
+    }
+
+    // validation
+
+    bool required_t::check(std::string_view value, size_t, std::string &error)
+    {
+        if (value.find_first_not_of(" \t") == std::string_view::npos)
+        {
+            error = "a value is required";
+
+            return false;
+        }
+
+        return true;
+    }
+
+    bool length_t::check(std::string_view value, size_t, std::string &error)
+    {
+        size_t len = std::count_if(value.begin(), value.end(), [](char c) { return (c & 0xC0) != 0x80; });
+
+        if (len < min)
+        {
+            error = "must be at least " + std::to_string(min) + " characters long";
+
+            return false;
+        }
+        else if (len > max)
+        {
+            error = "must be at most " + std::to_string(max) + " characters long";
+
+            return false;
+        }
+
+        return true;
+    }
+
+    bool number_range_t::check(std::string_view value, size_t changed_from, std::string &error)
+    {
+        size_t start = std::min({ changed_from, value.size(), parse_states.size() - 1 });
+
+        parse_states.resize(start + 1);
+
+        for (size_t i = start; i < value.size(); i++)
+        {
+            parse_state_t state = parse_states.back();
+            char c = value[i];
+
+            if (!state.valid)
+            {
+            }
+            else if (c >= '0' && c <= '9')
+            {
+                // past 19 digits only the magnitude still matters
+                if (state.mantissa <= (UINT64_MAX - 9) / 10)
+                {
+                    state.mantissa = state.mantissa * 10 + (c - '0');
+                    state.decimals += state.point;
+                }
+                else if (!state.point)
+                {
+                    state.dropped++;
+                }
+
+                state.has_digits = true;
+            }
+            else if (c == '.' && !state.point)
+            {
+                state.point = true;
+            }
+            else if ((c == '-' || c == '+') && i == 0)
+            {
+                state.negative = c == '-';
+            }
+            else
+            {
+                state.valid = false;
+            }
+
+            parse_states.push_back(state);
+        }
+
+        const parse_state_t &state = parse_states.back();
+
+        if (!state.valid || !state.has_digits)
+        {
+            error = "must be a number";
+
+            return false;
+        }
+
+        double number = state.mantissa;
+        double scale = 1;
+
+        for (int i = std::abs(state.dropped - state.decimals); i > 0; i--)
+        {
+            scale *= 10;
+        }
+
+        number = state.dropped >= state.decimals ? number * scale : number / scale;
+        number = state.negative ? -number : number;
+
+        if (number < min || number > max)
+        {
+            std::ostringstream ss;
+
+            ss << "must be between " << min << " and " << max;
+            error = ss.str();
+
+            return false;
+        }
+
+        return true;
+    }
+
+    bool pattern_t::check(std::string_view value, size_t, std::string &error)
+    {
+        if (!std::regex_match(value.begin(), value.end(), regex))
+        {
+            error = message;
+
+            return false;
+        }
+
+        return true;
+    }
+
+    static uint64_t hash_string(std::string_view str)
+    {
+        uint64_t hash = allow_list_t::hash_seed;
+
+        for (char c : str)
+        {
+            hash = allow_list_t::hash_byte(hash, c);
+        }
+
+        return hash;
+    }
+
+    allow_list_t::allow_list_t(const std::vector<std::string> &entries)
+    {
+        size_t total = 0;
+        size_t capacity = 16;
+
+        for (auto &entry : entries)
+        {
+            total += entry.size();
+        }
+
+        // keep the table at most half full so probe sequences stay short
+        while (capacity < entries.size() * 2)
+        {
+            capacity *= 2;
+        }
+
+        data.reserve(total);
+        offsets.reserve(entries.size() + 1);
+        offsets.push_back(0);
+        slots.assign(capacity, 0);
+        slot_hashes.assign(capacity, 0);
+
+        for (auto &entry : entries)
+        {
+            uint64_t hash = hash_string(entry);
+
+            if (contains(entry, hash))
+            {
+                continue;
+            }
+
+            data.append(entry);
+            offsets.push_back(data.size());
+
+            size_t slot = hash & (capacity - 1);
+
+            while (slots[slot] != 0)
+            {
+                slot = (slot + 1) & (capacity - 1);
+            }
+
+            slots[slot] = offsets.size() - 1;
+            slot_hashes[slot] = hash;
+        }
+    }
+
+    bool allow_list_t::contains(std::string_view value) const
+    {
+        return contains(value, hash_string(value));
+    }
+
+    bool allow_list_t::contains(std::string_view value, uint64_t value_hash) const
+    {
+        size_t mask = slots.size() - 1;
+
+        for (size_t slot = value_hash & mask; slots[slot] != 0; slot = (slot + 1) & mask)
+        {
+            if (slot_hashes[slot] == value_hash)
+            {
+                size_t index = slots[slot] - 1;
+                std::string_view entry(data.data() + offsets[index], offsets[index + 1] - offsets[index]);
+
+                if (entry == value)
+                {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    bool one_of_t::check(std::string_view value, size_t changed_from, std::string &error)
+    {
+        size_t start = std::min({ changed_from, value.size(), prefix_hashes.size() - 1 });
+
+        prefix_hashes.resize(start + 1);
+
+        for (size_t i = start; i < value.size(); i++)
+        {
+            prefix_hashes.push_back(allow_list_t::hash_byte(prefix_hashes.back(), value[i]));
+        }
+
+        if (!list->contains(value, prefix_hashes.back()))
+        {
+            error = "is not one of the allowed values";
+
+            return false;
+        }
+
+        return true;
+    }
+
+    // Every validator sees every edit, even after one has failed, so that their
+    // incremental state stays in step with the value. The first error wins.
+    static bool run_validators(const validators_t &validators, std::string_view value, size_t changed_from, std::string &error)
+    {
+        bool valid = true;
+
+        error.clear();
+
+        for (auto &validator : validators)
+        {
+            if (valid)
+            {
+                valid = validator->check(value, changed_from, error);
+            }
+            else
+            {
+                std::string ignored;
+
+                validator->check(value, changed_from, ignored);
+            }
+        }
+
+        return valid;
+    }
+
+    // autocompletion
+
+    struct completion_file_header_t
+    {
+        char magic[8];
+        uint64_t count;
+        uint64_t data_size;
+    };
+
+    static const char completion_file_magic[8] = { 'L', 'Q', 'I', 'N', 'D', 'E', 'X', '1' };
+
+    completion_index_t::completion_index_t(std::vector<std::string> entries)
+    {
+        std::sort(entries.begin(), entries.end());
+        entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+        size_t total = 0;
+
+        for (auto &entry : entries)
+        {
+            total += entry.size();
+        }
+
+        owned_data.reserve(total);
+        owned_offsets.reserve(entries.size() + 1);
+        owned_offsets.push_back(0);
+
+        for (auto &entry : entries)
+        {
+            owned_data.insert(owned_data.end(), entry.begin(), entry.end());
+            owned_offsets.push_back(owned_data.size());
+        }
+
+        data = owned_data.data();
+        offsets = owned_offsets.data();
+        count = entries.size();
+    }
+
+    completion_index_t::~completion_index_t()
+    {
+        if (mapping)
+        {
+            munmap(mapping, mapping_size);
+        }
+    }
+
+    std::shared_ptr<const completion_index_t> completion_index_t::load(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+
+        struct stat st;
+        void *mapping = MAP_FAILED;
+
+        if (fstat(fd, &st) == 0 && st.st_size >= sizeof(completion_file_header_t))
+        {
+            mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+
+        close(fd);
+
+        if (mapping == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        auto header = (const completion_file_header_t *)mapping;
+        size_t offsets_size = (header->count + 1) * sizeof(uint64_t);
+        auto offsets = (const uint64_t *)(header + 1);
+
+        // the counts are checked against the file size one at a time, so their sum cannot overflow
+        bool valid = memcmp(header->magic, completion_file_magic, sizeof(completion_file_magic)) == 0 &&
+                     header->count < st.st_size / sizeof(uint64_t) && header->data_size <= st.st_size &&
+                     sizeof(*header) + offsets_size + header->data_size == st.st_size;
+
+        // every entry has to lie within the data, after the one before it
+        for (size_t i = 0; valid && i <= header->count; i++)
+        {
+            valid = offsets[i] <= header->data_size && (i == 0 || offsets[i] >= offsets[i - 1]);
+        }
+
+        if (!valid || offsets[header->count] != header->data_size)
+        {
+            munmap(mapping, st.st_size);
+
+            return nullptr;
+        }
+
+        std::shared_ptr<completion_index_t> index(new completion_index_t());
+
+        index->mapping = mapping;
+        index->mapping_size = st.st_size;
+        index->count = header->count;
+        index->offsets = offsets;
+        index->data = (const char *)offsets + offsets_size;
+
+        return index;
+    }
+
+    bool completion_index_t::save(const std::string &path) const
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        completion_file_header_t header;
+
+        memcpy(header.magic, completion_file_magic, sizeof(header.magic));
+        header.count = count;
+        header.data_size = offsets[count];
+
+        file.write((const char *)&header, sizeof(header));
+        file.write((const char *)offsets, (count + 1) * sizeof(uint64_t));
+        file.write(data, offsets[count]);
+
+        return file.good();
+    }
+
+    completion_index_t::range_t completion_index_t::narrow(range_t range, size_t depth, char c) const
+    {
+        // within the range entries are ordered by their byte at depth, with
+        // entries that end at depth first
+        auto key = [&](size_t index)
+        {
+            size_t len = offsets[index + 1] - offsets[index];
+
+            return depth < len ? (int)(unsigned char)data[offsets[index] + depth] : -1;
+        };
+
+        int target = (unsigned char)c;
+        size_t low = range.begin;
+        size_t high = range.end;
+
+        while (low < high)
+        {
+            size_t mid = low + (high - low) / 2;
+
+            if (key(mid) < target)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+
+        size_t begin = low;
+
+        high = range.end;
+
+        while (low < high)
+        {
+            size_t mid = low + (high - low) / 2;
+
+            if (key(mid) <= target)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+
+        return { begin, low };
+    }
+
+    completion_index_t::range_t completion_index_t::find(std::string_view prefix) const
+    {
+        range_t range = all();
+
+        for (size_t i = 0; i < prefix.size() && range.size() > 0; i++)
+        {
+            range = narrow(range, i, prefix[i]);
+        }
+
+        return range;
+    }
+
+    std::string_view completion_index_t::common_prefix(range_t range) const
+    {
+        if (range.size() == 0)
+        {
+            return std::string_view();
+        }
+
+        // the entries are sorted, so the first and last share the least
+        std::string_view first = at(range.begin);
+        std::string_view last = at(range.end - 1);
+
+        return first.substr(0, std::mismatch(first.begin(), first.end(), last.begin(), last.end()).first - first.begin());
+    }
+
+    // history
+
+    #define HISTORY_HEADER_SIZE 64
+    #define HISTORY_BLOCK_SIZE 4096
+    #define HISTORY_BLOOM_WORDS 64
+
+    // length, key hash, the entry and the length again so the ring can be walked backwards
+    #define HISTORY_RECORD_OVERHEAD 12
+
+    struct history_t::file_header_t
+    {
+        char magic[8];
+        uint64_t capacity;
+
+        // logical offsets that only ever grow, the ring position is offset % capacity
+        std::atomic<uint64_t> head;
+        std::atomic<uint64_t> tail;
+    };
+
+    struct history_t::block_summary_t
+    {
+        // the logical block this summary was last reset for
+        std::atomic<uint64_t> block;
+        std::atomic<uint64_t> first_record;
+        std::atomic<uint64_t> bloom[HISTORY_BLOOM_WORDS];
+    };
+
+    static const char history_file_magic[8] = { 'L', 'Q', 'H', 'I', 'S', 'T', '0', '1' };
+
+    static uint32_t hash_key(std::string_view key)
+    {
+        uint32_t hash = 0x811c9dc5;
+
+        for (char c : key)
+        {
+            hash = (hash ^ (unsigned char)c) * 0x01000193;
+        }
+
+        return hash;
+    }
+
+    static size_t trigram_bit(const char *str)
+    {
+        uint32_t trigram = ((unsigned char)str[0] << 16) | ((unsigned char)str[1] << 8) | (unsigned char)str[2];
+
+        return (trigram * 0x9E3779B1u) >> (32 - 12);
+    }
+
+    std::shared_ptr<history_t> history_t::open(const std::string &path, size_t capacity)
+    {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+
+        static_assert(sizeof(file_header_t) <= HISTORY_HEADER_SIZE);
+
+        std::shared_ptr<history_t> history(new history_t());
+        struct stat st;
+
+        history->fd = fd;
+
+        // whoever gets here first creates the file, everyone else waits for them
+        flock(fd, LOCK_EX);
+
+        if (fstat(fd, &st) != 0)
+        {
+            flock(fd, LOCK_UN);
+
+            return nullptr;
+        }
+
+        bool create = st.st_size == 0;
+        uint64_t ring_size = std::max<uint64_t>(capacity, HISTORY_BLOCK_SIZE * 2) / HISTORY_BLOCK_SIZE * HISTORY_BLOCK_SIZE;
+
+        if (create)
+        {
+            history->mapping_size = HISTORY_HEADER_SIZE + ring_size / HISTORY_BLOCK_SIZE * sizeof(block_summary_t) + ring_size;
+
+            if (ftruncate(fd, history->mapping_size) != 0)
+            {
+                flock(fd, LOCK_UN);
+
+                return nullptr;
+            }
+        }
+        else
+        {
+            history->mapping_size = st.st_size;
+        }
+
+        if (history->mapping_size >= HISTORY_HEADER_SIZE)
+        {
+            history->mapping = mmap(nullptr, history->mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+
+        if (history->mapping == nullptr || history->mapping == MAP_FAILED)
+        {
+            history->mapping = nullptr;
+            flock(fd, LOCK_UN);
+
+            return nullptr;
+        }
+
+        history->header = (file_header_t *)history->mapping;
+
+        if (create)
+        {
+            memcpy(history->header->magic, history_file_magic, sizeof(history_file_magic));
+            history->header->capacity = ring_size;
+            history->header->head = 0;
+            history->header->tail = 0;
+        }
+
+        history->capacity = history->header->capacity;
+        history->block_count = history->capacity / HISTORY_BLOCK_SIZE;
+        history->summaries = (block_summary_t *)((char *)history->mapping + HISTORY_HEADER_SIZE);
+        history->ring = (char *)(history->summaries + history->block_count);
+
+        if (create)
+        {
+            for (uint64_t i = 0; i < history->block_count; i++)
+            {
+                history->summaries[i].block = UINT64_MAX;
+            }
+        }
+
+        flock(fd, LOCK_UN);
+
+        if (memcmp(history->header->magic, history_file_magic, sizeof(history_file_magic)) != 0 ||
+            history->capacity % HISTORY_BLOCK_SIZE != 0 ||
+            HISTORY_HEADER_SIZE + history->block_count * sizeof(block_summary_t) + history->capacity != history->mapping_size)
+        {
+            return nullptr;
+        }
+
+        return history;
+    }
+
+    history_t::~history_t()
+    {
+        if (mapping)
+        {
+            munmap(mapping, mapping_size);
+        }
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    void history_t::read(uint64_t pos, void *out, size_t len) const
+    {
+        size_t offset = pos % capacity;
+        size_t first = std::min<size_t>(len, capacity - offset);
+
+        memcpy(out, ring + offset, first);
+        memcpy((char *)out + first, ring, len - first);
+    }
+
+    void history_t::write(uint64_t pos, const void *in, size_t len)
+    {
+        size_t offset = pos % capacity;
+        size_t first = std::min<size_t>(len, capacity - offset);
+
+        memcpy(ring + offset, in, first);
+        memcpy(ring, (const char *)in + first, len - first);
+    }
+
+    uint32_t history_t::read_u32(uint64_t pos) const
+    {
+        uint32_t value;
+
+        read(pos, &value, sizeof(value));
+
+        return value;
+    }
+
+    bool history_t::append(std::string_view key, std::string_view entry)
+    {
+        uint64_t size = HISTORY_RECORD_OVERHEAD + entry.size();
+
+        if (entry.empty() || size > capacity / 2)
+        {
+            return false;
+        }
+
+        flock(fd, LOCK_EX);
+
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+
+        // drop the oldest records until there is room, before anything is overwritten
+        while (head + size - tail > capacity)
+        {
+            tail += HISTORY_RECORD_OVERHEAD + read_u32(tail);
+        }
+
+        // searches check the tail after copying a record, so it has to move before anything is overwritten
+        header->tail.store(tail, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        uint64_t block = head / HISTORY_BLOCK_SIZE;
+        block_summary_t &summary = summaries[block % block_count];
+
+        if (summary.block.load(std::memory_order_relaxed) != block)
+        {
+            summary.block.store(UINT64_MAX, std::memory_order_relaxed);
+
+            for (auto &word : summary.bloom)
+            {
+                word.store(0, std::memory_order_relaxed);
+            }
+
+            summary.first_record.store(head, std::memory_order_relaxed);
+            summary.block.store(block, std::memory_order_release);
+        }
+
+        for (size_t i = 0; i + 3 <= entry.size(); i++)
+        {
+            size_t bit = trigram_bit(entry.data() + i);
+
+            summary.bloom[bit / 64].fetch_or(1ull << (bit % 64), std::memory_order_relaxed);
+        }
+
+        uint32_t len = entry.size();
+        uint32_t key_hash = hash_key(key);
+
+        write(head, &len, sizeof(len));
+        write(head + 4, &key_hash, sizeof(key_hash));
+        write(head + 8, entry.data(), entry.size());
+        write(head + 8 + entry.size(), &len, sizeof(len));
+
+        header->head.store(head + size, std::memory_order_release);
+
+        flock(fd, LOCK_UN);
+
+        return true;
+    }
+
+    history_t::cursor_t history_t::end() const
+    {
+        return header->head.load(std::memory_order_acquire);
+    }
+
+    bool history_t::previous(std::string_view key, cursor_t &cursor, std::string &entry) const
+    {
+        return search(key, std::string_view(), cursor, entry);
+    }
+
+    bool history_t::search(std::string_view key, std::string_view query, cursor_t &cursor, std::string &entry) const
+    {
+        uint32_t key_hash = hash_key(key);
+        uint64_t query_bloom[HISTORY_BLOOM_WORDS] = {};
+        bool use_bloom = query.size() >= 3;
+
+        for (size_t i = 0; i + 3 <= query.size(); i++)
+        {
+            size_t bit = trigram_bit(query.data() + i);
+
+            query_bloom[bit / 64] |= 1ull << (bit % 64);
+        }
+
+        cursor = std::min(cursor, end());
+
+        while (true)
+        {
+            uint64_t tail = header->tail.load(std::memory_order_acquire);
+
+            if (cursor < tail + HISTORY_RECORD_OVERHEAD)
+            {
+                return false;
+            }
+
+            uint64_t len = read_u32(cursor - 4);
+            uint64_t start = cursor - HISTORY_RECORD_OVERHEAD - len;
+
+            if (len > capacity || start < tail)
+            {
+                return false;
+            }
+
+            uint64_t block = start / HISTORY_BLOCK_SIZE;
+            const block_summary_t &summary = summaries[block % block_count];
+
+            if (use_bloom && summary.block.load(std::memory_order_acquire) == block)
+            {
+                bool may_match = true;
+
+                for (int i = 0; i < HISTORY_BLOOM_WORDS && may_match; i++)
+                {
+                    may_match = (summary.bloom[i].load(std::memory_order_relaxed) & query_bloom[i]) == query_bloom[i];
+                }
+
+                uint64_t first = summary.first_record.load(std::memory_order_relaxed);
+
+                // nothing that starts in this block matches, skip all of it at once
+                if (!may_match && first <= start && first >= tail)
+                {
+                    cursor = first;
+
+                    continue;
+                }
+            }
+
+            if (read_u32(start + 4) == key_hash)
+            {
+                entry.resize(len);
+                read(start + 8, entry.data(), len);
+
+                // a writer lapped us while we were copying; the fence keeps the copy before the tail is read again
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (header->tail.load(std::memory_order_relaxed) > start)
+                {
+                    return false;
+                }
+
+                if (query.empty() || entry.find(query) != std::string::npos)
+                {
+                    cursor = start;
+
+                    return true;
+                }
+            }
+
+            cursor = start;
+        }
+    }
+
+    // line editing
+
+    // One line of input following a prompt, with the terminal cursor kept on
+    // it. Edits are drawn by draw, which only redraws from where the text first
+    // changed to the end of the line, and a line wider than the terminal scrolls
+    // sideways to keep the cursor in view.
+    class line_editor_t
+    {
+    public:
+        // where the last key changed the text from, npos if it did not
+        size_t changed_from = std::string::npos;
+
+        explicit line_editor_t(size_t prompt_width)
+        : prompt_width(prompt_width), columns(std::max(terminal_columns(), prompt_width + 2) - prompt_width - 1)
+        {
+        }
+
+        size_t size() const
+        {
+            return buffer.size();
+        }
+
+        std::string_view text()
+        {
+            return buffer.view();
+        }
+
+        // handles editing and cursor movement, returns false for keys it has no use for
+        bool handle(const key_event_t &event)
+        {
+            bool ctrl = event.modifiers == KEY_MOD_CTRL;
+            bool alt = event.modifiers == KEY_MOD_ALT;
+
+            changed_from = std::string::npos;
+
+            switch (event.key)
+            {
+            case KEY_TEXT:
+                insert(event.text);
+                return true;
+            case KEY_PASTE_BEGIN:
+                pasting = true;
+                paste_from = cursor;
+                return true;
+            case KEY_PASTE_END:
+                pasting = false;
+                changed_from = paste_from;
+                render(paste_from);
+                return true;
+            case KEY_BACKSPACE:
+                erase(previous_cluster(cursor), cursor);
+                return true;
+            case KEY_DELETE:
+                erase(cursor, following_cluster(cursor));
+                return true;
+            case KEY_LEFT:
+                move_to(event.modifiers ? word_start(cursor) : previous_cluster(cursor));
+                return true;
+            case KEY_RIGHT:
+                move_to(event.modifiers ? word_end(cursor) : following_cluster(cursor));
+                return true;
+            case KEY_HOME:
+                move_to(0);
+                return true;
+            case KEY_END:
+                move_to(size());
+                return true;
+            case KEY_CHAR:
+                break;
+            default:
+                return false;
+            }
+
+            if (ctrl && event.ch == 'a')
+            {
+                move_to(0);
+            }
+            else if (ctrl && event.ch == 'e')
+            {
+                move_to(size());
+            }
+            else if (ctrl && event.ch == 'b')
+            {
+                move_to(previous_cluster(cursor));
+            }
+            else if (ctrl && event.ch == 'f')
+            {
+                move_to(following_cluster(cursor));
+            }
+            else if (alt && event.ch == 'b')
+            {
+                move_to(word_start(cursor));
+            }
+            else if (alt && event.ch == 'f')
+            {
+                move_to(word_end(cursor));
+            }
+            else if (ctrl && event.ch == 'd')
+            {
+                erase(cursor, following_cluster(cursor));
+            }
+            else if (ctrl && event.ch == 'k')
+            {
+                kill(cursor, size());
+            }
+            else if (ctrl && event.ch == 'u')
+            {
+                kill(0, cursor);
+            }
+            else if ((ctrl && event.ch == 'w') || (alt && event.ch == 0x7F))
+            {
+                kill(word_start(cursor), cursor);
+            }
+            else if (alt && event.ch == 'd')
+            {
+                kill(cursor, word_end(cursor));
+            }
+            else if (ctrl && event.ch == 'y')
+            {
+                insert(killed);
+            }
+            else
+            {
+                return false;
+            }
+
+            return true;
+        }
+
+        // inserts at the cursor, control characters such as pasted newlines become spaces
+        void insert(std::string_view text)
+        {
+            size_t from = cursor;
+
+            if (std::any_of(text.begin(), text.end(), [](unsigned char c) { return c < 0x20 || c == 0x7F; }))
+            {
+                std::string cleaned(text);
+
+                std::replace_if(cleaned.begin(), cleaned.end(), [](unsigned char c) { return c < 0x20 || c == 0x7F; }, ' ');
+                buffer.insert(cursor, cleaned);
+            }
+            else
+            {
+                buffer.insert(cursor, text);
+            }
+
+            cursor += text.size();
+
+            // a paste is drawn once it has all arrived
+            if (!pasting)
+            {
+                changed_from = from;
+                render(from);
+            }
+        }
+
+        // replaces the text and puts the cursor at the end, redrawing only what differs
+        void set_text(std::string_view text)
+        {
+            size_t common = 0;
+
+            while (common < text.size() && common < size() && buffer.at(common) == text[common])
+            {
+                common++;
+            }
+
+            buffer.erase(common, size());
+            buffer.insert(common, text.substr(common));
+            cursor = size();
+            scroll = std::min(scroll, common);
+            changed_from = common;
+            render(common);
+        }
+
+        // brings the line on screen up to date with the edits since the last call
+        void draw()
+        {
+            if (!stale)
+            {
+                return;
+            }
+
+            size_t from = stale_from;
+
+            stale = false;
+            stale_from = std::string::npos;
+
+            if (scroll_to_cursor())
+            {
+                from = scroll;
+            }
+            else if (from != std::string::npos)
+            {
+                // an edit left of where the line has since scrolled to moved everything in view
+                from = std::max(from, scroll);
+            }
+
+            if (from != std::string::npos)
+            {
+                size_t column = width_between(scroll, from);
+
+                move_to_column(prompt_width + column);
+
+                if (column < columns)
+                {
+                    size_t width;
+
+                    scratch.clear();
+                    buffer.copy(from, std::min(size(), from + (columns - column) * 4 + 64), scratch);
+                    std::cout.write(scratch.data(), fit_width(scratch, columns - column, width));
+                }
+
+                std::cout << "\x1b[K";
+            }
+
+            move_to_column(prompt_width + width_between(scroll, cursor));
+        }
+
+    private:
+        gap_buffer_t buffer;
+        size_t cursor = 0;
+        size_t scroll = 0;
+        size_t prompt_width;
+        size_t columns;
+        bool pasting = false;
+        size_t paste_from = 0;
+        bool stale = false;
+        size_t stale_from = std::string::npos;
+        std::pmr::string killed { working_memory() };
+        std::pmr::string scratch { working_memory() };
+
+        void move_to(size_t pos)
+        {
+            cursor = pos;
+            render(std::string::npos);
+        }
+
+        void erase(size_t from, size_t to)
+        {
+            if (from >= to)
+            {
+                return;
+            }
+
+            buffer.erase(from, to);
+            cursor = from;
+            scroll = std::min(scroll, from);
+            changed_from = from;
+            render(from);
+        }
+
+        void kill(size_t from, size_t to)
+        {
+            if (from < to)
+            {
+                killed.clear();
+                buffer.copy(from, to, killed);
+                erase(from, to);
+            }
+        }
+
+        size_t previous_cluster(size_t pos)
+        {
+            // clusters are found from a known boundary, or from a little way
+            // back when the cursor is at the left edge of a scrolled line
+            size_t start = scroll < pos ? scroll : pos - std::min<size_t>(pos, 64);
+
+            while (start > 0 && (buffer.at(start) & 0xC0) == 0x80)
+            {
+                start--;
+            }
+
+            scratch.clear();
+            buffer.copy(start, pos, scratch);
+
+            size_t last = 0;
+
+            for (size_t i = 0; i < scratch.size(); i = next_cluster(scratch, i))
+            {
+                last = i;
+            }
+
+            return start + last;
+        }
+
+        size_t following_cluster(size_t pos)
+        {
+            scratch.clear();
+            buffer.copy(pos, std::min(size(), pos + 64), scratch);
+
+            return pos + (scratch.empty() ? 0 : next_cluster(scratch, 0));
+        }
+
+        size_t word_start(size_t pos) const
+        {
+            while (pos > 0 && buffer.at(pos - 1) == ' ')
+            {
+                pos--;
+            }
+
+            while (pos > 0 && buffer.at(pos - 1) != ' ')
+            {
+                pos--;
+            }
+
+            return pos;
+        }
+
+        size_t word_end(size_t pos) const
+        {
+            while (pos < size() && buffer.at(pos) == ' ')
+            {
+                pos++;
+            }
+
+            while (pos < size() && buffer.at(pos) != ' ')
+            {
+                pos++;
+            }
+
+            return pos;
+        }
+
+        size_t width_between(size_t from, size_t to)
+        {
+            scratch.clear();
+            buffer.copy(from, to, scratch);
+
+            return measure_width(scratch.data(), scratch.data() + scratch.size());
+        }
+
+        // moves scroll so the cursor is in view, halfway across when it has to
+        // jump, and returns whether it moved
+        bool scroll_to_cursor()
+        {
+            if (cursor >= scroll && width_between(scroll, cursor) < columns)
+            {
+                return false;
+            }
+
+            size_t start = cursor < scroll ? 0 : scroll;
+            size_t remaining = width_between(start, cursor);
+            size_t pos = 0;
+
+            while (pos < scratch.size() && remaining > columns / 2)
+            {
+                size_t next = next_cluster(scratch, pos);
+
+                remaining -= std::min(remaining, measure_width(scratch.data() + pos, scratch.data() + next));
+                pos = next;
+            }
+
+            scroll = start + pos;
+
+            return true;
+        }
+
+        static void move_to_column(size_t column)
+        {
+            std::cout << "\r";
+
+            if (column > 0)
+            {
+                std::cout << "\x1b[" << column << "C";
+            }
+        }
+
+        // notes that the line needs redrawing from offset from to the right
+        // edge, or only the cursor placing when from is npos
+        void render(size_t from)
+        {
+            stale = true;
+            stale_from = std::min(stale_from, from);
+        }
+    };
+
+    // questions
+
+    void set_max_frame_rate(int fps)
+    {
+        min_frame_interval = fps > 0 ? std::chrono::steady_clock::duration(std::chrono::seconds(1)) / fps : std::chrono::steady_clock::duration::zero();
+    }
+
+    std::string to_string(const answer_t &answer)
+    {
+        if (auto text = std::get_if<std::string>(&answer))
+        {
+            return *text;
+        }
+        else if (auto yes = std::get_if<bool>(&answer))
+        {
+            return *yes ? "yes" : "no";
+        }
+        else if (auto selection = std::get_if<selection_t>(&answer))
+        {
+            return std::string(selection->text);
+        }
+
+        return std::string();
+    }
+
+    // asks for a line of input and leaves the answer in result, which is cleared first
+    static void run_input(std::string &result, std::string_view question_text, std::string_view default_option, const validators_t &validators,
+                          const completion_index_t *completions, history_t *history)
+    {
+        STATS(stats_prompt_t stats_prompt(QUESTION_INPUT));
+        forget_term_style();
+
+        std::string error;
+        result.clear();
+
+        bool valid = run_validators(validators, result, 0, error);
+        line_editor_t editor(display_width(question_text) + 3);
+
+        // the line below the prompt shows validation errors or the history search
+        std::string status;
+        std::string shown_status;
+        const char *status_style = STYLE_ERROR;
+
+        // ranges[i] holds the completions of the first i bytes of the result
+        std::vector<completion_index_t::range_t> ranges;
+        completion_index_t::range_t shown_range;
+        int highlighted = -1;
+        int shown_highlight = -1;
+        int rows = completions ? 1 + MAX_SUGGESTIONS : 1;
+
+        // entries recalled with up, down walks back through them to the draft
+        struct recalled_t
+        {
+            history_t::cursor_t cursor;
+            std::string entry;
+        };
+
+        std::vector<recalled_t> recalled;
+        std::string draft;
+
+        bool searching = false;
+        std::string query;
+        std::string match;
+        history_t::cursor_t match_start = 0;
+        history_t::cursor_t match_end = 0;
+
+        if (completions)
+        {
+            ranges.push_back(completions->all());
+        }
+
+        // keep lines free below the prompt for the status line and suggestions
+        for (int i = 0; i < rows; i++)
+        {
+            std::cout << "\n";
+        }
+
+        std::cout << "\x1b[" << rows << "A";
+
+        auto print_prompt = [&]()
+        {
+            change_term_style(STYLE1);
+            std::cout << "? ";
+            change_term_style(STYLE2);
+            std::cout << question_text << " ";
+            change_term_style(STYLE_CLEAR);
+        };
+
+        auto suggestions = [&]()
+        {
+            completion_index_t::range_t range;
+
+            if (completions && editor.size() > 0 && !searching)
+            {
+                range = ranges.back();
+                range.end = std::min(range.end, range.begin + MAX_SUGGESTIONS);
+            }
+
+            return range;
+        };
+
+        auto redraw_below = [&]()
+        {
+            auto range = suggestions();
+            bool status_changed = status != shown_status;
+            bool suggestions_changed = range.begin != shown_range.begin || range.end != shown_range.end || highlighted != shown_highlight;
+
+            if (!status_changed && !suggestions_changed)
+            {
+                return;
+            }
+
+            std::cout << "\x1b" "7" << "\x1b[1B";
+
+            if (status_changed)
+            {
+                std::cout << "\r\x1b[2K";
+
+                if (!status.empty())
+                {
+                    change_term_style(status_style);
+                    std::cout << status;
+                    change_term_style(STYLE_CLEAR);
+                }
+
+                shown_status = status;
+            }
+
+            if (suggestions_changed)
+            {
+                for (int i = 0; i < MAX_SUGGESTIONS; i++)
+                {
+                    std::cout << "\x1b[1B\r\x1b[2K";
+
+                    if (i < range.size())
+                    {
+                        change_term_style(i == highlighted ? STYLE4 : STYLE5);
+                        std::cout << (i == highlighted ? "> " : "  ") << completions->at(range.begin + i);
+                        change_term_style(STYLE_CLEAR);
+                    }
+                }
+
+                shown_range = range;
+                shown_highlight = highlighted;
+            }
+
+            std::cout << "\x1b" "8";
+        };
+
+        auto show_error = [&](const std::string &message)
+        {
+            status = message.empty() ? std::string() : "✘ " + message;
+            status_style = STYLE_ERROR;
+        };
+
+        auto edited = [&](size_t changed_from)
+        {
+            // only gather the text into one piece when something needs to look at it
+            std::string_view value = validators.empty() && !completions ? std::string_view() : editor.text();
+
+            valid = run_validators(validators, value, changed_from, error);
+
+            if (completions)
+            {
+                ranges.resize(std::min(changed_from, ranges.size() - 1) + 1);
+
+                for (size_t i = ranges.size() - 1; i < value.size(); i++)
+                {
+                    ranges.push_back(completions->narrow(ranges.back(), i, value[i]));
+                }
+            }
+
+            highlighted = -1;
+
+            // an empty value is only complained about once it is submitted
+            show_error(editor.size() == 0 ? std::string() : error);
+        };
+
+        auto replace_result = [&](std::string_view text)
+        {
+            editor.set_text(text);
+            edited(editor.changed_from);
+        };
+
+        auto search = [&](history_t::cursor_t from)
+        {
+            history_t::cursor_t cursor = from;
+            std::string entry;
+            bool found = !query.empty() && history->search(question_text, query, cursor, entry);
+
+            if (found)
+            {
+                match = std::move(entry);
+                match_start = cursor;
+                match_end = cursor + HISTORY_RECORD_OVERHEAD + match.size();
+            }
+            else if (query.empty())
+            {
+                match.clear();
+                match_start = match_end = history->end();
+            }
+
+            status = std::string(found || query.empty() ? "" : "failing ") + "reverse-i-search `" + query + "': " + match;
+            status_style = STYLE5;
+        };
+
+        // returns true when the key was used up by the search
+        auto handle_search = [&](const key_event_t &event)
+        {
+            switch (event.key)
+            {
+            case KEY_TEXT:
+                query.append(event.text);
+                search(match_end);
+                return true;
+            case KEY_BACKSPACE:
+                if (!query.empty())
+                {
+                    erase_last_char(query, 0);
+                }
+                search(history->end());
+                return true;
+            case KEY_CHAR:
+                if (event.ch == 'r' && event.modifiers == KEY_MOD_CTRL)
+                {
+                    search(match_start);
+                    return true;
+                }
+                else if (event.ch == 'g' && event.modifiers == KEY_MOD_CTRL)
+                {
+                    searching = false;
+                    show_error(std::string());
+                    return true;
+                }
+                break;
+            case KEY_ESCAPE:
+                searching = false;
+                show_error(std::string());
+                return true;
+            default:
+                break;
+            }
+
+            // anything else takes the match and is then handled as usual
+            searching = false;
+            status.clear();
+
+            if (!match.empty())
+            {
+                replace_result(match);
+            }
+
+            return false;
+        };
+
+        print_prompt();
+        std::cout << BRACKETED_PASTE_ON;
+
+        on_key([&](const key_event_t &event)
+        {
+            if (searching && handle_search(event))
+            {
+                return true;
+            }
+
+            int shown = suggestions().size();
+
+            switch (event.key)
+            {
+            case KEY_TAB:
+                if (highlighted >= 0)
+                {
+                    replace_result(completions->at(ranges.back().begin + highlighted));
+                }
+                else if (shown > 0)
+                {
+                    std::string_view prefix = completions->common_prefix(ranges.back());
+
+                    if (prefix.size() > editor.size())
+                    {
+                        replace_result(prefix);
+                    }
+                }
+                break;
+            case KEY_DOWN:
+                if (shown > 0)
+                {
+                    highlighted = highlighted + 1 < shown ? highlighted + 1 : 0;
+                }
+                else if (!recalled.empty())
+                {
+                    recalled.pop_back();
+                    replace_result(recalled.empty() ? draft : recalled.back().entry);
+                }
+                break;
+            case KEY_UP:
+                if (shown > 0)
+                {
+                    highlighted = highlighted > 0 ? highlighted - 1 : shown - 1;
+                }
+                else if (history)
+                {
+                    recalled_t older { recalled.empty() ? history->end() : recalled.back().cursor };
+
+                    if (history->previous(question_text, older.cursor, older.entry))
+                    {
+                        if (recalled.empty())
+                        {
+                            draft = editor.text();
+                        }
+
+                        recalled.push_back(std::move(older));
+                        replace_result(recalled.back().entry);
+                    }
+                }
+                break;
+            case KEY_ENTER:
+                if (highlighted >= 0)
+                {
+                    replace_result(completions->at(ranges.back().begin + highlighted));
+                }
+
+                if (editor.size() == 0 && !default_option.empty())
+                {
+                    result = default_option;
+
+                    if (run_validators(validators, result, 0, error))
+                    {
+                        return false;
+                    }
+
+                    // the default was rejected, so put the validators back in step
+                    // with the empty value but keep the default's error to show
+                    std::string ignored;
+
+                    result.clear();
+                    valid = run_validators(validators, result, 0, ignored);
+                }
+                else if (valid)
+                {
+                    result = editor.text();
+
+                    return false;
+                }
+
+                show_error(error);
+                break;
+            case KEY_EOF:
+                result = editor.text();
+                return false;
+            default:
+                if (event.key == KEY_CHAR && event.ch == 'r' && event.modifiers == KEY_MOD_CTRL && history)
+                {
+                    searching = true;
+                    query.clear();
+                    match.clear();
+                    search(history->end());
+                }
+                else if (editor.handle(event) && editor.changed_from != std::string::npos)
+                {
+                    recalled.clear();
+                    edited(editor.changed_from);
+                }
+                break;
+            }
+
+            return true;
+        },
+        [&]()
+        {
+            editor.draw();
+            redraw_below();
+        });
+
+        std::cout << BRACKETED_PASTE_OFF;
+
+        if (history && !result.empty())
+        {
+            history->append(question_text, result);
+        }
+
+        // clear the prompt along with everything below it
+        std::cout << "\r\x1b[J";
+
+        change_term_style(STYLE1);
+        std::cout << "? ";
+        change_term_style(STYLE2);
+        std::cout << question_text << " ";
+        change_term_style(STYLE3);
+        std::cout << result << std::endl;
+        change_term_style(STYLE_CLEAR);
+    }
+
+    std::string ask_input(std::string_view question_text, std::string_view default_option, const validators_t &validators, const completion_index_t *completions, history_t *history)
+    {
+        std::string result;
+
+        run_input(result, question_text, default_option, validators, completions, history);
+
+        return result;
+    }
+
+    // Terminals send the line breaks of a paste as CR, or as CRLF. Hands text
+    // to append a piece at a time with each of them turned into '\n'. A paste
+    // can arrive in several pieces, so after_cr carries a CR that ended one
+    // piece over to the next, where a LF straight after it is dropped.
+    template <typename F>
+    static void append_pasted_text(std::string_view text, bool &after_cr, F &&append)
+    {
+        if (text.empty())
+        {
+            return;
+        }
+
+        size_t start = after_cr && text.front() == '\n' ? 1 : 0;
+
+        after_cr = false;
+
+        while (start < text.size())
+        {
+            size_t end = text.find('\r', start);
+
+            if (end == std::string_view::npos)
+            {
+                append(text.substr(start));
+
+                return;
+            }
+
+            append(text.substr(start, end - start));
+            append(std::string_view("\n"));
+            start = end + 1;
+
+            if (start == text.size())
+            {
+                after_cr = true;
+            }
+            else if (text[start] == '\n')
+            {
+                start++;
+            }
+        }
+    }
+
+    // The editor keeps a window of lines below the question with a status line
+    // under it, and only ever draws the lines that are inside the window.
+    static std::string edit_multiline(std::string_view question_text, std::string_view default_option)
+    {
+        piece_table_t text(default_option);
+        size_t columns = terminal_columns() - 1;
+        size_t height = std::min<size_t>(std::max<size_t>(text.line_count(), 10), std::max<size_t>(terminal_rows(), 6) - 3);
+
+        size_t cursor = 0;
+        size_t goal_column = 0;
+        size_t top = 0;
+        size_t left = 0;
+        size_t screen_row = 0;
+
+        bool pasting = false;
+        bool paste_after_cr = false;
+        bool going_to_line = false;
+        std::string line_number;
+        std::string scratch;
+
+        // the lines the keys since the last frame changed
+        size_t stale_first = SIZE_MAX;
+        size_t stale_last = 0;
+
+        change_term_style(STYLE1);
+        std::cout << "? ";
+        change_term_style(STYLE2);
+        std::cout << question_text;
+        change_term_style(STYLE3);
+        std::cout << " [Ctrl-D to finish]\n";
+        change_term_style(STYLE_CLEAR);
+
+        // keep the window and the status line free
+        for (size_t i = 0; i < height; i++)
+        {
+            std::cout << "\n";
+        }
+
+        screen_row = height;
+
+        auto go_to_row = [&](size_t row)
+        {
+            if (row < screen_row)
+            {
+                std::cout << "\x1b[" << screen_row - row << "A";
+            }
+            else if (row > screen_row)
+            {
+                std::cout << "\x1b[" << row - screen_row << "B";
+            }
+
+            std::cout << "\r";
+            screen_row = row;
+        };
+
+        auto copy_line = [&](size_t line, size_t limit)
+        {
+            size_t start = text.line_start(line);
+
+            scratch.clear();
+            text.copy(start, std::min(text.line_end(line), start + limit), scratch);
+        };
+
+        // the byte in a line that is at a display column
+        auto column_offset = [&](size_t line, size_t column)
+        {
+            size_t width;
+
+            copy_line(line, column * 4 + 64);
+
+            return text.line_start(line) + fit_width(scratch, column, width);
+        };
+
+        auto cursor_column = [&]()
+        {
+            size_t start = text.line_start(text.line_of(cursor));
+
+            scratch.clear();
+            text.copy(start, cursor, scratch);
+
+            return measure_width(scratch.data(), scratch.data() + scratch.size());
+        };
+
+        auto draw_line = [&](size_t row)
+        {
+            go_to_row(row);
+            std::cout << "\x1b[2K";
+
+            if (top + row >= text.line_count())
+            {
+                return;
+            }
+
+            size_t skipped;
+            size_t width;
+
+            copy_line(top + row, (left + columns) * 4 + 64);
+
+            std::string_view line = scratch;
+            size_t padding = 0;
+
+            line.remove_prefix(fit_width(line, left, skipped));
+
+            // a wide character cut by the left edge leaves a gap
+            if (skipped < left && !line.empty())
+            {
+                size_t next = next_cluster(line, 0);
+
+                padding = skipped + measure_width(line.data(), line.data() + next) - left;
+                line.remove_prefix(next);
+                std::cout << std::string(padding, ' ');
+            }
+
+            std::cout.write(line.data(), fit_width(line, columns - padding, width));
+        };
+
+        auto draw_status = [&]()
+        {
+            go_to_row(height);
+            std::cout << "\x1b[2K";
+            change_term_style(STYLE5);
+
+            if (going_to_line)
+            {
+                std::cout << "go to line: " << line_number;
+            }
+            else
+            {
+                std::cout << "line " << text.line_of(cursor) + 1 << "/" << text.line_count() << ", column " << cursor_column() + 1
+                          << "  Ctrl-G go to line";
+            }
+
+            change_term_style(STYLE_CLEAR);
+        };
+
+        // notes that the lines from first_line to last_line need drawing
+        auto refresh = [&](size_t first_line, size_t last_line)
+        {
+            stale_first = std::min(stale_first, first_line);
+            stale_last = std::max(stale_last, last_line);
+        };
+
+        // draws the stale lines that are in the window, or all of them if it
+        // had to scroll to keep the cursor in view, then the status line
+        auto draw = [&]()
+        {
+            size_t first_line = stale_first;
+            size_t last_line = stale_last;
+            size_t line = text.line_of(cursor);
+            size_t column = cursor_column();
+            size_t old_top = top;
+            size_t old_left = left;
+
+            if (line < top)
+            {
+                top = line;
+            }
+            else if (line >= top + height)
+            {
+                top = line - height + 1;
+            }
+
+            if (column < left || column >= left + columns)
+            {
+                left = column > columns / 2 ? column - columns / 2 : 0;
+            }
+
+            if (top != old_top || left != old_left)
+            {
+                first_line = top;
+                last_line = top + height - 1;
+            }
+
+            for (size_t i = std::max(first_line, top); i <= last_line && i < top + height; i++)
+            {
+                draw_line(i - top);
+            }
+
+            stale_first = SIZE_MAX;
+            stale_last = 0;
+            draw_status();
+
+            // while a line number is typed the cursor stays after it
+            if (going_to_line)
+            {
+                return;
+            }
+
+            go_to_row(line - top);
+
+            if (column > left)
+            {
+                std::cout << "\x1b[" << column - left << "C";
+            }
+        };
+
+        auto insert = [&](std::string_view added)
+        {
+            size_t line = text.line_of(cursor);
+            size_t lines = text.line_count();
+
+            text.insert(cursor, added);
+            cursor += added.size();
+            goal_column = cursor_column();
+            refresh(line, lines == text.line_count() ? line : SIZE_MAX);
+        };
+
+        auto erase = [&](size_t from, size_t to)
+        {
+            if (from < to)
+            {
+                size_t lines = text.line_count();
+
+                text.erase(from, to);
+                cursor = from;
+                goal_column = cursor_column();
+                refresh(text.line_of(from), lines == text.line_count() ? text.line_of(from) : SIZE_MAX);
+            }
+        };
+
+        auto move_to = [&](size_t pos, bool keep_goal = false)
+        {
+            cursor = pos;
+
+            if (!keep_goal)
+            {
+                goal_column = cursor_column();
+            }
+
+            refresh(SIZE_MAX, 0);
+        };
+
+        auto previous_cluster = [&]()
+        {
+            size_t start = text.line_start(text.line_of(cursor));
+
+            if (cursor == start)
+            {
+                return cursor > 0 ? cursor - 1 : 0;
+            }
+
+            scratch.clear();
+            text.copy(start, cursor, scratch);
+
+            size_t last = 0;
+
+            for (size_t i = 0; i < scratch.size(); i = next_cluster(scratch, i))
+            {
+                last = i;
+            }
+
+            return start + last;
+        };
+
+        auto following_cluster = [&]()
+        {
+            scratch.clear();
+            text.copy(cursor, std::min(text.size(), cursor + 64), scratch);
+
+            if (scratch.empty() || scratch[0] == '\n')
+            {
+                return scratch.empty() ? cursor : cursor + 1;
+            }
+
+            return cursor + next_cluster(scratch, 0);
+        };
+
+        auto move_lines = [&](long delta)
+        {
+            long line = std::clamp<long>((long)text.line_of(cursor) + delta, 0, (long)text.line_count() - 1);
+
+            move_to(column_offset(line, goal_column), true);
+        };
+
+        refresh(0, height - 1);
+        draw();
+
+        std::cout << BRACKETED_PASTE_ON;
+
+        on_key([&](const key_event_t &event)
+        {
+            if (pasting)
+            {
+                if (event.key == KEY_TEXT)
+                {
+                    // drawn once the whole paste is in
+                    append_pasted_text(event.text, paste_after_cr, [&](std::string_view piece)
+                    {
+                        text.insert(cursor, piece);
+                        cursor += piece.size();
+                    });
+                }
+                else if (event.key == KEY_PASTE_END)
+                {
+                    pasting = false;
+                    goal_column = cursor_column();
+                    refresh(top, top + height - 1);
+                }
+
+                return true;
+            }
+
+            if (going_to_line)
+            {
+                if (event.key == KEY_TEXT)
+                {
+                    std::copy_if(event.text.begin(), event.text.end(), std::back_inserter(line_number), [](char c) { return c >= '0' && c <= '9'; });
+                }
+                else if (event.key == KEY_BACKSPACE && !line_number.empty())
+                {
+                    line_number.pop_back();
+                }
+                else if (event.key == KEY_ENTER || event.key == KEY_ESCAPE || event.key == KEY_CHAR)
+                {
+                    going_to_line = false;
+
+                    if (event.key == KEY_ENTER && !line_number.empty())
+                    {
+                        // a number too large to hold is past the last line anyway
+                        size_t line = text.line_count();
+                        size_t typed;
+
+                        if (std::from_chars(line_number.data(), line_number.data() + line_number.size(), typed).ec == std::errc())
+                        {
+                            line = std::min(typed, line);
+                        }
+
+                        move_to(text.line_start(line > 0 ? line - 1 : 0));
+                    }
+                }
+                else if (event.key == KEY_EOF)
+                {
+                    return false;
+                }
+
+                return true;
+            }
+
+            size_t line = text.line_of(cursor);
+
+            switch (event.key)
+            {
+            case KEY_PASTE_BEGIN:
+                pasting = true;
+                paste_after_cr = false;
+                break;
+            case KEY_TEXT:
+                insert(event.text);
+                break;
+            case KEY_ENTER:
+                insert("\n");
+                break;
+            case KEY_TAB:
+                insert("    ");
+                break;
+            case KEY_BACKSPACE:
+                erase(previous_cluster(), cursor);
+                break;
+            case KEY_DELETE:
+                erase(cursor, following_cluster());
+                break;
+            case KEY_LEFT:
+                move_to(previous_cluster());
+                break;
+            case KEY_RIGHT:
+                move_to(following_cluster());
+                break;
+            case KEY_UP:
+                move_lines(-1);
+                break;
+            case KEY_DOWN:
+                move_lines(1);
+                break;
+            case KEY_PAGE_UP:
+                move_lines(-(long)height);
+                break;
+            case KEY_PAGE_DOWN:
+                move_lines(height);
+                break;
+            case KEY_HOME:
+                move_to(event.modifiers & KEY_MOD_CTRL ? 0 : text.line_start(line));
+                break;
+            case KEY_END:
+                move_to(event.modifiers & KEY_MOD_CTRL ? text.size() : text.line_end(line));
+                break;
+            case KEY_CHAR:
+                if (event.ch == 'd' && event.modifiers == KEY_MOD_CTRL)
+                {
+                    return false;
+                }
+                else if (event.ch == 'g' && event.modifiers == KEY_MOD_CTRL)
+                {
+                    going_to_line = true;
+                    line_number.clear();
+                }
+                break;
+            case KEY_EOF:
+                return false;
+            default:
+                break;
+            }
+
+            return true;
+        },
+        draw);
+
+        std::cout << BRACKETED_PASTE_OFF;
+
+        std::string result;
+
+        text.copy(0, text.size(), result);
+
+        // clear the question along with the window and status line
+        go_to_row(0);
+        std::cout << "\x1b[1A\r\x1b[J";
+
+        change_term_style(STYLE1);
+        std::cout << "? ";
+        change_term_style(STYLE2);
+        std::cout << question_text << " ";
+        change_term_style(STYLE3);
+
+        // long texts are summed up rather than printed again
+        if (text.line_count() > height)
+        {
+            std::cout << "[" << text.line_count() << " lines, " << text.size() << " bytes]";
+        }
+        else if (!result.empty())
+        {
+            std::cout << "\n" << result;
+        }
+
+        std::cout << std::endl;
+        change_term_style(STYLE_CLEAR);
+
+        return result;
+    }
+
+    // asks for text in either mode and leaves the answer in result
+    static void run_multiline(std::string &result, std::string_view question_text, std::string_view default_option, multiline_mode mode)
+    {
+        STATS(stats_prompt_t stats_prompt(QUESTION_MULTILINE));
+        forget_term_style();
+
+        if (mode == MULTILINE_EDITOR)
+        {
+            result = edit_multiline(question_text, default_option);
+
+            return;
+        }
+
+        // pastes are appended straight into the result, so start with room for a sizeable one
+        result.clear();
+        result.reserve(64 * 1024);
+
+        change_term_style(STYLE1);
+        std::cout << "? ";
+        change_term_style(STYLE2);
+        std::cout << question_text;
+        change_term_style(STYLE3);
+        std::cout << " [Enter 2 empty lines to finish]\n";
+        change_term_style(STYLE_CLEAR);
+        std::cout << BRACKETED_PASTE_ON;
+
+        int blanks = 0;
+        int line_num = 0;
+        int screen_lines = 1;
+        size_t line_start = 0;
+        size_t edit_start = 0;
+        size_t paste_start = 0;
+        bool pasting = false;
+        bool paste_after_cr = false;
+
+        on_key([&](const key_event_t &event)
+        {
+            if (pasting)
+            {
+                if (event.key == KEY_TEXT)
+                {
+                    append_pasted_text(event.text, paste_after_cr, [&](std::string_view piece) { result.append(piece); });
+                }
+                else if (event.key == KEY_PASTE_END)
+                {
+                    // the pasted text is not echoed, a one line summary stands in for it
+                    size_t pasted_lines = std::count(result.begin() + paste_start, result.end(), '\n');
+
+                    change_term_style(STYLE5);
+                    std::cout << "[pasted " << pasted_lines << " lines, " << result.size() - paste_start << " bytes]";
+                    change_term_style(STYLE_CLEAR);
+
+                    pasting = false;
+                    line_num += pasted_lines;
+                    line_start = result.find_last_of('\n') + 1;
+                    edit_start = result.size();
+                    blanks = 0;
+                }
+
+                return true;
+            }
+
+            switch (event.key)
+            {
+            case KEY_PASTE_BEGIN:
+                pasting = true;
+                paste_after_cr = false;
+                paste_start = result.size();
+                break;
+            case KEY_TEXT:
+                result.append(event.text);
+                std::cout << event.text;
+                break;
+            case KEY_BACKSPACE:
+                erase_last_char(result, edit_start);
+                break;
+            case KEY_ENTER:
+                std::cout << "\n";
+                screen_lines++;
+
+                if (result.size() == line_start)
+                {
+                    if (line_num == 0)
+                    {
+                        return false;
+                    }
+
+                    if (++blanks == 2)
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    blanks = 0;
+                }
+
+                line_num++;
+                result.push_back('\n');
+                line_start = edit_start = result.size();
+                break;
+            case KEY_CHAR:
+                if (event.ch == 'd' && event.modifiers == KEY_MOD_CTRL)
+                {
+                    return false;
+                }
+                break;
+            case KEY_EOF:
+                return false;
+            default:
+                break;
+            }
+
+            return true;
+        });
+
+        std::cout << BRACKETED_PASTE_OFF;
+
+        if (result.empty())
+        {
+            result = default_option;
+        }
+
+        erase_term_lines(screen_lines);
+
+        // remove trailing newlines
+        auto start_newline = result.find_last_not_of('\n');
+        auto end_newline = result.find_last_of('\n');
+
+        if(start_newline != std::string::npos && end_newline != std::string::npos)
+        {
+            if(start_newline + 1 < result.size())
+            {
+                start_newline++;
+
+                result.erase(start_newline, end_newline - start_newline + 1);
+            }
+        }
+
+        change_term_style(STYLE1);
+        std::cout << "? ";
+        change_term_style(STYLE2);
+        std::cout << question_text << "\n";
+        change_term_style(STYLE3);
+
+        if(!result.empty())
+        {
+            std::cout << result << "\n";
+        }
+
+        change_term_style(STYLE_CLEAR);
+        std::cout.flush();
+    }
+
+    std::string ask_multiline(std::string_view question_text, std::string_view default_option, multiline_mode mode)
+    {
+        std::string result;
+
+        run_multiline(result, question_text, default_option, mode);
+
+        return result;
+    }
+
+    bool ask_yesno(std::string_view question_text, bool default_option)
+    {
+        STATS(stats_prompt_t stats_prompt(QUESTION_YESNO));
+        forget_term_style();
+
+        std::string input;
+        bool result;
+
+        change_term_style(STYLE1);
+        std::cout << "? ";
+        change_term_style(STYLE2);
+        std::cout << question_text << " ";
+        change_term_style(STYLE5);
+
+        if(default_option)
+        {
+            std::cout << "(Y/n) ";
+        }
+        else
+        {
+            std::cout << "(y/N) ";
+        }
+
+        change_term_style(STYLE_CLEAR);
+
+        std::cout.flush();
+
+        read_line(input);
+
+        std::transform(input.begin(), input.end(), input.begin(), [](char c) { return std::tolower(c); });
+
+        if(input == "y" || input == "yes")
+        {
+            result = true;
+        }
+        else if(input == "n" || input == "no")
+        {
+            result = false;
+        }
+        else
+        {
+            result = default_option;
+        }
+
+        erase_term_lines(1);
+
+        change_term_style(STYLE1);
+        std::cout << "? ";
+        change_term_style(STYLE2);
+        std::cout << question_text << " ";
+        change_term_style(STYLE3);
+        std::cout << (result ? "yes" : "no") << std::endl;
+        change_term_style(STYLE_CLEAR);
+
+        return result;
+    }
+
+    static bool contains_ignoring_case(std::string_view text, std::string_view part)
+    {
+        auto lower_equal = [](char a, char b) { return std::tolower((unsigned char)a) == std::tolower((unsigned char)b); };
+
+        return std::search(text.begin(), text.end(), part.begin(), part.end(), lower_equal) != text.end();
+    }
+
+    // Typing filters the options down to the ones containing the typed text.
+    // The list keeps one row per option so it can be redrawn in place below the prompt.
+    template <typename Options>
+    static selection_t run_select(std::string_view question_text, const Options &options, int selected)
+    {
+        STATS(stats_prompt_t stats_prompt(QUESTION_SELECTION));
+        forget_term_style();
+
+        selection_t result;
+        line_editor_t filter(display_width(question_text) + 3);
+
+        // the options containing the filter, only used once something has been typed
+        std::vector<int> matches;
+        bool filtering = false;
+        size_t filtered_size = 0;
+
+        // set by the keys when the options need drawing again
+        bool moved = false;
+
+        auto shown_count = [&]() -> int
+        {
+            return filtering ? matches.size() : options.size();
+        };
+
+        auto shown = [&](int i)
+        {
+            return filtering ? matches[i] : i;
+        };
+
+        auto change_selection = [&]()
+        {
+            std::cout << "\x1b" "7";
+
+            for (int i = 0; i < options.size(); i++)
+            {
+                std::cout << "\x1b[1B\r\x1b[2K";
+
+                if (i >= shown_count())
+                {
+                    continue;
+                }
+
+                if (shown(i) == selected)
+                {
+                    change_term_style(STYLE4);
+                    std::cout << "> ";
+                }
+                else
+                {
+                    std::cout << "  ";
+                }
+
+                std::cout << options[shown(i)];
+
+                change_term_style(STYLE_CLEAR);
+            }
+
+            std::cout << "\x1b" "8";
+        };
+
+        // keep the rows below the prompt free for the options, then go back up to type in
+        for (int i = 0; i < options.size(); i++)
+        {
+            std::cout << "\n";
+        }
+
+        std::cout << "\x1b[" << options.size() << "A";
+        change_term_style(STYLE1);
+        std::cout << "? ";
+        change_term_style(STYLE2);
+        std::cout << question_text << " ";
+        change_term_style(STYLE_CLEAR);
+
+        change_selection();
+
+        std::cout << BRACKETED_PASTE_ON;
+
+        on_key([&](const key_event_t &event)
+        {
+            int count = shown_count();
+            int position = filtering ? std::find(matches.begin(), matches.end(), selected) - matches.begin() : selected;
+
+            if (event.key == KEY_UP && count > 0)
+            {
+                selected = shown(position > 0 ? position - 1 : count - 1);
+
+                moved = true;
+            }
+            else if (event.key == KEY_DOWN && count > 0)
+            {
+                selected = shown(position + 1 < count ? position + 1 : 0);
+
+                moved = true;
+            }
+            else if ((event.key == KEY_ENTER && count > 0) || event.key == KEY_EOF)
+            {
+                result.index = selected;
+                result.text = options[selected];
+
+                return false;
+            }
+            else if (filter.handle(event) && filter.changed_from != std::string::npos)
+            {
+                std::string_view text = filter.text();
+
+                // text added at the end can only narrow what is already shown
+                if (filtering && filter.changed_from == filtered_size && text.size() > filtered_size)
+                {
+                    std::erase_if(matches, [&](int i) { return !contains_ignoring_case(options[i], text); });
+                }
+                else
+                {
+                    matches.clear();
+
+                    for (int i = 0; i < options.size(); i++)
+                    {
+                        if (contains_ignoring_case(options[i], text))
+                        {
+                            matches.push_back(i);
+                        }
+                    }
+                }
+
+                filtering = !text.empty();
+                filtered_size = text.size();
+
+                if (filtering && !matches.empty() && std::find(matches.begin(), matches.end(), selected) == matches.end())
+                {
+                    selected = matches.front();
+                }
+
+                moved = true;
+            }
+
+            return true;
+        },
+        [&]()
+        {
+            filter.draw();
+
+            if (moved)
+            {
+                change_selection();
+                moved = false;
+            }
+        });
+
+        std::cout << BRACKETED_PASTE_OFF;
+
+        // clear the prompt along with the options below it
+        std::cout << "\r\x1b[J";
+
+        change_term_style(STYLE1);
+        std::cout << "? ";
+        change_term_style(STYLE2);
+        std::cout << question_text << " ";
+        change_term_style(STYLE3);
+        std::cout << result.text << std::endl;
+        change_term_style(STYLE_CLEAR);
+
+        return result;
+    }
+
+    selection_t ask_select(std::string_view question, std::span<const std::string> options, int selected)
+    {
+        return run_select(question, options, selected);
+    }
+
+    selection_t ask_select(std::string_view question, std::span<const std::string_view> options, int selected)
+    {
+        return run_select(question, options, selected);
+    }
+
+    std::string input_t::ask()
+    {
+        return ask_input(question_text, default_option, validators, completions.get(), history.get());
+    }
+
+    std::string multiline_t::ask()
+    {
+        return ask_multiline(question_text, default_option, mode);
+    }
+
+    // the string the previous answer is in is written over
+    static std::string &answer_text(answer_t &answer)
+    {
+        if (!std::holds_alternative<std::string>(answer))
+        {
+            answer.emplace<std::string>();
+        }
+
+        return std::get<std::string>(answer);
+    }
+
+    void input_t::prompt_into(answer_t &answer)
+    {
+        run_input(answer_text(answer), question_text, default_option, validators, completions.get(), history.get());
+    }
+
+    void multiline_t::prompt_into(answer_t &answer)
+    {
+        run_multiline(answer_text(answer), question_text, default_option, mode);
+    }
+
+    bool yesno_t::ask()
+    {
+        return ask_yesno(question_text, default_option);
+    }
+
+    selection_t select_t::ask()
+    {
+        int selected = 0;
+
+        for (int i = 0; i < options.size(); i++)
+        {
+            if (options[i] == default_option)
+            {
+                selected = i;
+
+                break;
+            }
+        }
+
+        return ask_select(question_text, std::span<const std::string>(options), selected);
+    }
+
+    void questionaire_t::run()
+    {
+        answers.resize(questions.size());
+
+        for (size_t i = 0; i < questions.size(); i++)
+        {
+            questions[i]->prompt_into(answers[i]);
+        }
+    }
+
+    // memory
+
+    // blocks up to this size are pooled, which covers the buffers of a table
+    // thousands of rows long, bigger ones go straight to the heap
+    #define WORKING_MEMORY_LARGEST_BLOCK (4 * 1024 * 1024)
+
+    static std::pmr::memory_resource *&working_memory_resource()
+    {
+        static std::pmr::synchronized_pool_resource pool(std::pmr::pool_options { 0, WORKING_MEMORY_LARGEST_BLOCK });
+        static std::pmr::memory_resource *resource = &pool;
+
+        return resource;
+    }
+
+    std::pmr::memory_resource *working_memory()
+    {
+        return working_memory_resource();
+    }
+
+    void set_working_memory(std::pmr::memory_resource *resource)
+    {
+        static std::pmr::memory_resource *pool = working_memory_resource();
+
+        working_memory_resource() = resource ? resource : pool;
+    }
+
+    // text
+
+    size_t display_width(std::string_view text)
+    {
+        return line_width(text);
+    }
+
+    size_t display_width(std::wstring_view text)
+    {
+        return line_width(text);
+    }
+
+    // styles
+
+    // the kinds of colour, kept in the top byte of style_t::foreground and background
+    #define COLOR_BASIC 0x01000000u
+    #define COLOR_256 0x02000000u
+    #define COLOR_RGB 0x03000000u
+
+    // attributes a space shows: underline, inverse and strikethrough
+    #define BLANK_ATTRIBUTES ((1 << 4) | (1 << 7) | (1 << 9))
+
+    template <typename String>
+    static void append_ascii(String &out, const char *text, size_t len)
+    {
+        out.append(text, text + len);
+    }
+
+    // adds ;n to the codes being built up, without the ; for the first one
+    static void append_code(char *&it, uint32_t code)
+    {
+        *it++ = ';';
+        it = std::to_chars(it, it + 10, code).ptr;
+    }
+
+    static void append_color(char *&it, uint32_t color, uint32_t extended)
+    {
+        uint32_t value = color & 0xFFFFFF;
+
+        switch (color & 0xFF000000)
+        {
+        case COLOR_BASIC:
+            append_code(it, value);
+            break;
+        case COLOR_256:
+            append_code(it, extended);
+            append_code(it, 5);
+            append_code(it, value);
+            break;
+        case COLOR_RGB:
+            append_code(it, extended);
+            append_code(it, 2);
+            append_code(it, value >> 16);
+            append_code(it, (value >> 8) & 0xFF);
+            append_code(it, value & 0xFF);
+            break;
+        }
+    }
+
+    template <typename CharT>
+    bool style_writer_t::apply_codes(std::basic_string_view<CharT> params, style_t &style)
+    {
+        uint32_t codes[32];
+        size_t count = 0;
+        uint32_t value = 0;
+
+        for (size_t i = 0; i <= params.size(); i++)
+        {
+            if (i == params.size() || params[i] == ';')
+            {
+                if (count == std::size(codes))
+                {
+                    return false;
+                }
+
+                codes[count++] = value;
+                value = 0;
+            }
+            else if (params[i] >= '0' && params[i] <= '9')
+            {
+                value = std::min<uint32_t>(value * 10 + (params[i] - '0'), 0xFFFFFF);
+            }
+            else
+            {
+                // colon separated sub-parameters and private codes
+                return false;
+            }
+        }
+
+        bool known = true;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t code = codes[i];
+
+            if (code == 0)
+            {
+                style = {};
+            }
+            else if (code >= 1 && code <= 9)
+            {
+                style.attributes |= 1 << code;
+            }
+            else if (code == 22)
+            {
+                style.attributes &= ~((1 << 1) | (1 << 2));
+            }
+            else if (code == 25)
+            {
+                style.attributes &= ~((1 << 5) | (1 << 6));
+            }
+            else if (code == 23 || code == 24 || code == 27 || code == 28 || code == 29)
+            {
+                style.attributes &= ~(1 << (code - 20));
+            }
+            else if ((code >= 30 && code <= 37) || (code >= 90 && code <= 97))
+            {
+                style.foreground = COLOR_BASIC | code;
+            }
+            else if ((code >= 40 && code <= 47) || (code >= 100 && code <= 107))
+            {
+                style.background = COLOR_BASIC | code;
+            }
+            else if (code == 39)
+            {
+                style.foreground = 0;
+            }
+            else if (code == 49)
+            {
+                style.background = 0;
+            }
+            else if ((code == 38 || code == 48) && i + 2 < count && codes[i + 1] == 5 && codes[i + 2] < 256)
+            {
+                (code == 38 ? style.foreground : style.background) = COLOR_256 | codes[i + 2];
+                i += 2;
+            }
+            else if ((code == 38 || code == 48) && i + 4 < count && codes[i + 1] == 2 &&
+                     codes[i + 2] < 256 && codes[i + 3] < 256 && codes[i + 4] < 256)
+            {
+                (code == 38 ? style.foreground : style.background) = COLOR_RGB | codes[i + 2] << 16 | codes[i + 3] << 8 | codes[i + 4];
+                i += 4;
+            }
+            else
+            {
+                known = false;
+            }
+        }
+
+        return known;
+    }
+
+    // Brings the terminal to the wanted style, unless only blank text follows
+    // and it already looks the same for that.
+    template <typename String>
+    void style_writer_t::sync(bool blank, String &out)
+    {
+        if (strip || terminal == wanted)
+        {
+            return;
+        }
+
+        if (blank && terminal.opaque == wanted.opaque && terminal.background == wanted.background &&
+            (terminal.attributes & BLANK_ATTRIBUTES) == (wanted.attributes & BLANK_ATTRIBUTES))
+        {
+            return;
+        }
+
+        // either change what differs, or reset and set everything, whichever is shorter
+        char changes[128];
+        char reset[128];
+        char *changes_end = changes;
+        char *reset_end = reset;
+
+        append_code(reset_end, 0);
+
+        for (int code = 1; code <= 9; code++)
+        {
+            if (wanted.attributes & (1 << code))
+            {
+                append_code(reset_end, code);
+            }
+        }
+
+        append_color(reset_end, wanted.foreground, 38);
+        append_color(reset_end, wanted.background, 48);
+
+        uint16_t attributes = terminal.attributes;
+        uint16_t removed = attributes & ~wanted.attributes;
+
+        // 22 and 25 turn off two attributes each, the one still wanted is set again below
+        if (removed & ((1 << 1) | (1 << 2)))
+        {
+            append_code(changes_end, 22);
+            attributes &= ~((1 << 1) | (1 << 2));
+        }
+
+        if (removed & ((1 << 5) | (1 << 6)))
+        {
+            append_code(changes_end, 25);
+            attributes &= ~((1 << 5) | (1 << 6));
+        }
+
+        for (int code : { 3, 4, 7, 8, 9 })
+        {
+            if (removed & (1 << code))
+            {
+                append_code(changes_end, code + 20);
+                attributes &= ~(1 << code);
+            }
+        }
+
+        for (int code = 1; code <= 9; code++)
+        {
+            if ((wanted.attributes & ~attributes) & (1 << code))
+            {
+                append_code(changes_end, code);
+            }
+        }
+
+        if (terminal.foreground != wanted.foreground)
+        {
+            wanted.foreground ? append_color(changes_end, wanted.foreground, 38) : append_code(changes_end, 39);
+        }
+
+        if (terminal.background != wanted.background)
+        {
+            wanted.background ? append_color(changes_end, wanted.background, 48) : append_code(changes_end, 49);
+        }
+
+        bool use_reset = (terminal.opaque && !wanted.opaque) || reset_end - reset < changes_end - changes;
+        const char *codes = use_reset ? reset : changes;
+        const char *codes_end = use_reset ? reset_end : changes_end;
+
+        append_ascii(out, "\x1b[", 2);
+        append_ascii(out, codes + 1, codes_end - codes - 1);
+        out.push_back('m');
+
+        terminal = wanted;
+    }
+
+    // Without out only the style the text leaves behind is taken on.
+    template <typename CharT, typename String>
+    void style_writer_t::write_text(std::basic_string_view<CharT> text, String *out)
+    {
+        // unstyled text while the terminal is already right is by far the most common
+        if (out && terminal == wanted && text.find(CharT(0x1b)) == std::basic_string_view<CharT>::npos)
+        {
+            out->append(text);
+
+            return;
+        }
+
+        size_t pos = 0;
+
+        while (pos < text.size())
+        {
+            size_t escape = std::min(text.find(CharT(0x1b), pos), text.size());
+
+            if (escape > pos && out)
+            {
+                std::basic_string_view<CharT> segment = text.substr(pos, escape - pos);
+
+                sync(segment.find_first_not_of(CharT(' ')) == std::basic_string_view<CharT>::npos, *out);
+                out->append(segment);
+            }
+
+            if (escape == text.size())
+            {
+                break;
+            }
+
+            // a CSI sequence runs up to its final byte, anything else is ESC and one more character
+            size_t end = escape + 1;
+
+            if (end < text.size() && text[end] == '[')
+            {
+                end++;
+
+                while (end < text.size() && text[end] >= 0x20 && text[end] <= 0x3F)
+                {
+                    end++;
+                }
+
+                if (end < text.size() && text[end] == 'm')
+                {
+                    std::basic_string_view<CharT> params = text.substr(escape + 2, end - escape - 2);
+                    style_t style = wanted;
+
+                    if (!apply_codes(params, style) && !strip && out)
+                    {
+                        // codes that are not understood have to reach the terminal right away
+                        sync(false, *out);
+                        out->append(text.substr(escape, end + 1 - escape));
+                        style.opaque = true;
+                        terminal = style;
+                    }
+
+                    wanted = style;
+                    pos = end + 1;
+
+                    continue;
+                }
+            }
+
+            // other sequences move the cursor or the like and go through as they are
+            end = std::min(end + 1, text.size());
+
+            if (out)
+            {
+                out->append(text.substr(escape, end - escape));
+            }
+
+            pos = end;
+        }
+    }
+
+    void style_writer_t::write(std::string_view text, std::string &out)
+    {
+        write_text(text, &out);
+    }
+
+    void style_writer_t::write(std::wstring_view text, std::wstring &out)
+    {
+        write_text(text, &out);
+    }
+
+    void style_writer_t::write_plain(std::string_view text, std::string &out)
+    {
+        wanted = {};
+        write_text(text, &out);
+    }
+
+    void style_writer_t::write_plain(std::wstring_view text, std::wstring &out)
+    {
+        wanted = {};
+        write_text(text, &out);
+    }
+
+    void style_writer_t::apply(std::string_view text)
+    {
+        write_text(text, (std::string *)nullptr);
+    }
+
+    void style_writer_t::apply(std::wstring_view text)
+    {
+        write_text(text, (std::wstring *)nullptr);
+    }
+
+    void style_writer_t::flush(std::string &out)
+    {
+        sync(false, out);
+    }
+
+    void style_writer_t::finish(std::string &out)
+    {
+        wanted = {};
+        sync(false, out);
+    }
+
+    void style_writer_t::finish(std::wstring &out)
+    {
+        wanted = {};
+        sync(false, out);
+    }
+
+    void style_writer_t::write(std::string_view text, std::pmr::string &out)
+    {
+        write_text(text, &out);
+    }
+
+    void style_writer_t::write(std::wstring_view text, std::pmr::wstring &out)
+    {
+        write_text(text, &out);
+    }
+
+    void style_writer_t::write_plain(std::string_view text, std::pmr::string &out)
+    {
+        wanted = {};
+        write_text(text, &out);
+    }
+
+    void style_writer_t::write_plain(std::wstring_view text, std::pmr::wstring &out)
+    {
+        wanted = {};
+        write_text(text, &out);
+    }
+
+    void style_writer_t::flush(std::pmr::string &out)
+    {
+        sync(false, out);
+    }
+
+    void style_writer_t::finish(std::pmr::string &out)
+    {
+        wanted = {};
+        sync(false, out);
+    }
+
+    void style_writer_t::finish(std::pmr::wstring &out)
+    {
+        wanted = {};
+        sync(false, out);
+    }
+
+    // stats
+
+    void latency_histogram_t::record(std::chrono::microseconds latency)
+    {
+        uint64_t us = std::max<int64_t>(latency.count(), 0);
+        size_t bucket = std::min<size_t>(std::bit_width(us), buckets.size() - 1);
+
+        buckets[bucket]++;
+        count++;
+        total += latency;
+        max = std::max(max, latency);
+    }
+
+    std::chrono::microseconds latency_histogram_t::percentile(double fraction) const
+    {
+        uint64_t wanted = std::ceil(std::clamp(fraction, 0.0, 1.0) * count);
+        uint64_t seen = 0;
+
+        for (size_t i = 0; i < buckets.size(); i++)
+        {
+            seen += buckets[i];
+
+            if (seen >= wanted && seen > 0)
+            {
+                return i == buckets.size() - 1 ? max : std::chrono::microseconds(1ull << i);
+            }
+        }
+
+        return {};
+    }
+
+    bool stats_enabled()
+    {
+        STATS(return true);
+
+        return false;
+    }
+
+    const stats_t &stats()
+    {
+        return stats_data;
+    }
+
+    void reset_stats()
+    {
+        stats_data = {};
+    }
+
+    void set_stats_hook(stats_hook_t hook)
+    {
+        stats_hook = std::move(hook);
+    }
+
+    // tables
+
+    extern const borders_t modern_borders =
+        {
+            L"┌", L"┐", L"└", L"┘", L"─", L"│", L"┬", L"┴", L"├", L"┤", L"┼", L" ", L" "};
+
+    extern const borders_t rounded_borders =
+        {
+            L"╭", L"╮", L"╰", L"╯", L"─", L"│", L"┬", L"┴", L"├", L"┤", L"┼", L" ", L" "};
+
+    extern const borders_t ascii_borders =
+        {
+            L"+", L"+", L"+", L"+", L"-", L"|", L"+", L"+", L"+", L"+", L"+", L" ", L" "};
+
+    // the nth line of a cell, or nothing if it has fewer lines
+    static std::wstring_view get_line(std::wstring_view text, size_t n)
+    {
+        size_t start = 0;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            start = text.find(L'\n', start);
+
+            if (start == std::wstring_view::npos)
+            {
+                return {};
+            }
+
+            start++;
+        }
+
+        return text.substr(start, text.find(L'\n', start) - start);
+    }
+
+    void table_t::set_data(const std::vector<column_t> &data)
+    {
+        columns.clear();
+
+        for (auto &col : data)
+        {
+            wcolumn_t wcol;
+
+            for (auto &row : col)
+            {
+                wcol.push_back(str_to_wstr(row));
+            }
+
+            columns.push_back(wcol);
+        }
+    }
+
+    void table_t::set_data(const std::vector<wcolumn_t> &data)
+    {
+        columns = data;
+    }
+
+    table_t::table_t(int props)
+    : properties(props)
+    {
+    }
+
+    table_t::table_t(int props, const borders_t &b)
+    : properties(props),
+      borders(&b)
+    {
+    }
+
+    table_t::table_t(const std::vector<wcolumn_t> &data, int props)
+    : columns(data),
+      properties(props)
+    {
+    }
+
+    table_t::table_t(const std::vector<wcolumn_t> &data, int props, const borders_t &b)
+    : columns(data),
+      properties(props),
+      borders(&b)
+    {
+    }
+
+    table_t::table_t(const std::vector<wcolumn_t> &data)
+    : columns(data),
+      properties(TABLE_BORDER_VERT | TABLE_HEADER_BORDER)
+    {
+    }
+
+    table_t::table_t(const std::vector<column_t> &data, int props)
+    : properties(props)
+    {
+        set_data(data);
+    }
+
+    table_t::table_t(const std::vector<column_t> &data, int props, const borders_t &b)
+    : properties(props),
+      borders(&b)
+    {
+        set_data(data);
+    }
+
+    table_t::table_t(const std::vector<column_t> &data)
+    : properties(TABLE_BORDER_VERT | TABLE_HEADER_BORDER)
+    {
+        set_data(data);
+    }
+
+    int table_t::get_largest_row_len(int row_index) const
+    {
+        size_t largest_len = 0;
+
+        if (row_index < 0)
+        {
+            return -1;
+        }
+
+        for (const auto &col : columns)
+        {
+            if (row_index >= col.size())
+            {
+                return -1;
+            }
+
+            // it may seem like it is simple as getting row.size() but,
+            // we have the problem of newline characters, escape codes and varying width emojis.
+            std::wstring_view row = col[row_index];
+            size_t len = 0;
+
+            for (size_t start = 0; start <= row.size();)
+            {
+                size_t end = std::min(row.find(L'\n', start), row.size());
+
+                len = std::max(len, line_width(row.substr(start, end - start)));
+                start = end + 1;
+            }
+
+            if (len > largest_len)
+            {
+                largest_len = len;
+            }
+        }
+
+        return largest_len;
+    }
+
+    // the widest cell at each index, over all the rows
+    void table_t::get_widths(std::pmr::vector<int> &widths) const
+    {
+        widths.clear();
+
+        for (auto &col : columns)
+        {
+            while (widths.size() < col.size())
+            {
+                widths.push_back(get_largest_row_len(widths.size()));
+            }
+
+            STATS(stats_data.table.cells += col.size());
+        }
+    }
+
+    std::wstring table_t::get_at_index(int row_index, int col_index) const
+    {
+        if (col_index < 0 && col_index >= columns.size())
+        {
+            return L"";
+        }
+
+        if (row_index < 0 && row_index >= columns[col_index].size())
+        {
+            return L"";
+        }
+
+        auto &col = columns[col_index];
+        auto &row = col[row_index];
+
+        return row;
+    }
+
+    void table_t::append_column(wcolumn_t col)
+    {
+        columns.push_back(col);
+    }
+
+    void table_t::append_column(column_t col)
+    {
+        wcolumn_t wcol;
+
+        for (auto &row : col)
+        {
+            wcol.push_back(str_to_wstr(row));
+        }
+
+        columns.push_back(wcol);
+    }
+
+    // draws the table onto the end of out
+    void table_t::render(std::pmr::wstring &out) const
+    {
+        STATS(stats_timer_t render_timer { stats_data.table.render });
+        STATS(auto start_width = stats_data.table.width);
+        STATS(auto start_layout = stats_data.table.layout);
+
+        // every cell line is padded to the widest cell with its index, so work those out once
+        std::pmr::vector<int> widths(working_memory());
+
+        {
+            STATS(stats_timer_t timer { stats_data.table.width });
+
+            get_widths(widths);
+        }
+
+        std::pmr::wstring line_out(working_memory());
+        std::pmr::wstring spaces(working_memory());
+        style_writer_t writer(properties & TABLE_STRIP_STYLES);
+
+        auto multiply_str = [&](const std::wstring &str, int times) mutable
+        {
+            for (int i = 0; i < times; i++)
+            {
+                out.append(str);
+            }
+        };
+
+        for (int x = 0; x < columns.size(); x++)
+        {
+            auto &col = columns[x];
+
+            if (x == 0)
+            {
+                out.append(borders->top_left);
+
+                for (int y = 0; y < col.size(); y++)
+                {
+                    int len = widths[y];
+
+                    if (properties & TABLE_BORDER_VERT)
+                    {
+                        len += borders->padding_left.size() + borders->vertical_bar.size();
+                    }
+                    else
+                    {
+                        len += borders->padding_left.size() + borders->padding_right.size();
+                    }
+
+                    multiply_str(borders->horizontal_bar, len);
+
+                    if (y != col.size() - 1 && properties & TABLE_BORDER_VERT)
+                    {
+                        out.append(borders->top_intersection);
+                    }
+                }
+
+                out.append(borders->top_right);
+                out.push_back('\n');
+            }
+
+            int total_lines = 0;
+
+            {
+                STATS(stats_timer_t timer { stats_data.table.layout });
+
+                for (int y = 0; y < col.size(); y++)
+                {
+                    int line_count = std::count(col[y].begin(), col[y].end(), L'\n') + 1;
+
+                    if (line_count > total_lines)
+                    {
+                        total_lines = line_count;
+                    }
+                }
+            }
+
+            // cells keep their colours to themselves, the borders and padding are always drawn plain
+            for (int i = 0; i < total_lines; i++)
+            {
+                line_out.clear();
+                writer.write_plain(borders->vertical_bar, line_out);
+
+                for (int y = 0; y < col.size(); y++)
+                {
+                    int row_size = widths[y];
+
+                    if (y != 0 && properties & TABLE_BORDER_VERT)
+                    {
+                        writer.write_plain(borders->vertical_bar, line_out);
+                    }
+
+                    writer.write_plain(borders->padding_left, line_out);
+
+                    std::wstring_view line = get_line(col[y], i);
+
+                    if (!line.empty())
+                    {
+                        // the line goes on in the style the lines above it left
+                        writer.apply(std::wstring_view(col[y]).substr(0, line.data() - col[y].data()));
+                        writer.write(line, line_out);
+                    }
+
+                    int spacing = std::max(0, row_size - (int)line_width(line));
+
+                    spaces.assign(spacing, ' ');
+                    writer.write_plain(spaces, line_out);
+                    writer.write_plain(borders->padding_right, line_out);
+                }
+
+                writer.write_plain(borders->vertical_bar, line_out);
+                writer.finish(line_out);
+
+                out.append(line_out);
+                out.push_back('\n');
+            }
+
+            if (x == columns.size() - 1)
+            {
+                out.append(borders->bottom_left);
+
+                for (int y = 0; y < col.size(); y++)
+                {
+                    int len = widths[y];
+
+                    if (properties & TABLE_BORDER_VERT)
+                    {
+                        len += borders->padding_left.size() + borders->vertical_bar.size();
+                    }
+                    else
+                    {
+                        len += borders->padding_left.size() + borders->padding_right.size();
+                    }
+
+                    multiply_str(borders->horizontal_bar, len);
+
+                    if (y != col.size() - 1 && properties & TABLE_BORDER_VERT)
+                    {
+                        out.append(borders->bottom_intersection);
+                    }
+                }
+
+                out.append(borders->bottom_right);
+                out.push_back('\n');
+            }
+            else if ((properties & TABLE_BORDER_HORIZ) || (properties & TABLE_HEADER_BORDER) || (properties & TABLE_FOOTER_BORDER))
+            {
+                if (!(properties & TABLE_BORDER_HORIZ))
+                {
+                    bool is_header = (properties & TABLE_HEADER_BORDER) && x == 0;
+                    bool is_footer = (properties & TABLE_FOOTER_BORDER) && x == (columns.size() - 2);
+
+                    if(!is_header && !is_footer)
+                    {
+                        continue;
+                    }
+                }
+
+                out.append(borders->left_intersection);
+
+                for (int y = 0; y < col.size(); y++)
+                {
+                    int len = widths[y];
+
+                    if (properties & TABLE_BORDER_VERT)
+                    {
+                        len += borders->padding_left.size() + borders->vertical_bar.size();
+                    }
+                    else
+                    {
+                        len += borders->padding_left.size() + borders->padding_right.size();
+                    }
+
+                    multiply_str(borders->horizontal_bar, len);
+
+                    if (y != col.size() - 1 && properties & TABLE_BORDER_VERT)
+                    {
+                        out.append(borders->intersection);
+                    }
+                }
+
+                out.append(borders->right_intersection);
+                out.push_back('\n');
+            }
+        }
+
+        // the render time is what is left once the other phases are taken out
+        STATS(stats_data.table.renders++);
+        STATS(stats_data.table.render -= (stats_data.table.width - start_width) + (stats_data.table.layout - start_layout));
+    }
+
+    std::wstring table_t::to_wstring() const
+    {
+        std::pmr::wstring text(working_memory());
+
+        render(text);
+
+        return std::wstring(text);
+    }
+
+    std::string table_t::to_string() const
+    {
+        std::string out;
+
+        to_string(out);
+
+        return out;
+    }
+
+    void table_t::to_string(std::string &out) const
+    {
+        std::pmr::wstring text(working_memory());
+
+        render(text);
+        out.clear();
+
+        {
+            STATS(stats_timer_t timer { stats_data.table.transcode });
+
+            append_utf8(text, out);
+        }
+
+        STATS(stats_data.table.bytes += out.size());
+        STATS(stats_publish());
+    }
+
+    void table_t::run() const
+    {
+        std::pmr::wstring text(working_memory());
+        std::pmr::string out(working_memory());
+
+        render(text);
+
+        {
+            STATS(stats_timer_t timer { stats_data.table.transcode });
+
+            append_utf8(text, out);
+        }
+
+        out.push_back('\n');
+
+        std::cout << out;
+        std::cout.flush();
+
+        STATS(stats_data.table.bytes += out.size());
+        STATS(stats_publish());
+    }
+
+    size_t cell_table_t::column_width(size_t column) const
+    {
+        size_t width = 0;
+
+        for (size_t y = 0, rows = row_count(); y < rows; y++)
+        {
+            width = std::max(width, cell_width(y, column));
+        }
+
+        return width;
+    }
+
+    // output is handed to the sink in pieces of about this size
+    #define RENDER_FLUSH_SIZE (64 * 1024)
+
+    void cell_table_t::render(const sink_t &sink) const
+    {
+        render(sink, 0, row_count() - 1);
+    }
+
+    void cell_table_t::render(const sink_t &sink, size_t first_row, size_t count) const
+    {
+        STATS(auto start_time = std::chrono::steady_clock::now());
+        STATS(auto start_width = stats_data.table.width);
+        STATS(auto start_transcode = stats_data.table.transcode);
+
+        size_t rows = row_count();
+        size_t cols = column_count();
+        bool vertical = properties & TABLE_BORDER_VERT;
+        std::pmr::vector<size_t> widths(cols, working_memory());
+        std::pmr::vector<bool> right(cols, working_memory());
+
+        {
+            STATS(stats_timer_t timer { stats_data.table.width });
+
+            for (size_t x = 0; x < cols; x++)
+            {
+                right[x] = right_aligned(x);
+                widths[x] = column_width(x);
+            }
+        }
+
+        STATS(auto start_borders = std::chrono::steady_clock::now());
+
+        std::pmr::string vertical_bar(working_memory());
+        std::pmr::string horizontal_bar(working_memory());
+        std::pmr::string padding_left(working_memory());
+        std::pmr::string padding_right(working_memory());
+
+        append_utf8(borders->vertical_bar, vertical_bar);
+        append_utf8(borders->horizontal_bar, horizontal_bar);
+        append_utf8(borders->padding_left, padding_left);
+        append_utf8(borders->padding_right, padding_right);
+
+        // write_cell takes a std::string, so the output is the one buffer that cannot come from working memory
+        std::string out;
+        std::pmr::string cell(working_memory());
+        std::pmr::string spaces(working_memory());
+        style_writer_t writer(properties & TABLE_STRIP_STYLES);
+
+        STATS(stats_data.table.transcode += std::chrono::steady_clock::now() - start_borders);
+
+        // borders and padding have no codes of their own, so they only need the writer after a styled cell
+        auto plain = [&](std::string_view text)
+        {
+            if (writer.plain())
+            {
+                out.append(text);
+            }
+            else
+            {
+                writer.write_plain(text, out);
+            }
+        };
+
+        out.reserve(RENDER_FLUSH_SIZE);
+
+        auto rule = [&](const std::wstring &left, const std::wstring &middle, const std::wstring &end)
+        {
+            append_utf8(left, out);
+
+            for (size_t x = 0; x < cols; x++)
+            {
+                size_t len = widths[x] + borders->padding_left.size() + (vertical ? borders->vertical_bar.size() : borders->padding_right.size());
+
+                for (size_t i = 0; i < len; i++)
+                {
+                    out.append(horizontal_bar);
+                }
+
+                if (x != cols - 1 && vertical)
+                {
+                    append_utf8(middle, out);
+                }
+            }
+
+            append_utf8(end, out);
+            out.push_back('\n');
+        };
+
+        // pads the cell written to out from start up to the width of its column
+        auto pad = [&](size_t start, size_t x)
+        {
+            std::string_view written = std::string_view(out).substr(start);
+            bool styled = written.find('\x1b') != std::string_view::npos;
+            size_t width = styled ? display_width(written) : measure_width(written.data(), written.data() + written.size());
+            size_t spacing = widths[x] - std::min(widths[x], width);
+
+            if (!styled && writer.plain())
+            {
+                out.insert(right[x] ? start : out.size(), spacing, ' ');
+            }
+            else
+            {
+                // styled cells are written again through the writer
+                cell.assign(written);
+                spaces.assign(spacing, ' ');
+                out.resize(start);
+
+                if (right[x])
+                {
+                    writer.write_plain(spaces, out);
+                    writer.write(cell, out);
+                }
+                else
+                {
+                    writer.write(cell, out);
+                    writer.write_plain(spaces, out);
+                }
+            }
+        };
+
+        // Cells with line breaks are split over as many lines as the row needs,
+        // the way table_t draws them. A line break measures as nothing, so each
+        // line fits in the width measured for the whole cell.
+        std::vector<std::string> texts;
+        std::pmr::vector<size_t> positions(working_memory());
+
+        auto write_lines = [&](size_t y)
+        {
+            size_t height = 1;
+
+            texts.resize(cols);
+            positions.assign(cols, 0);
+
+            for (size_t x = 0; x < cols; x++)
+            {
+                texts[x].clear();
+                write_cell(y, x, texts[x]);
+                height = std::max<size_t>(height, std::count(texts[x].begin(), texts[x].end(), '\n') + 1);
+            }
+
+            for (size_t line = 0; line < height; line++)
+            {
+                plain(vertical_bar);
+
+                for (size_t x = 0; x < cols; x++)
+                {
+                    if (x != 0 && vertical)
+                    {
+                        plain(vertical_bar);
+                    }
+
+                    plain(padding_left);
+
+                    // cells with fewer lines than the row are left blank below their last
+                    std::string_view text = texts[x];
+                    size_t begin = std::min(positions[x], text.size());
+                    size_t end = std::min(text.find('\n', begin), text.size());
+                    size_t start = out.size();
+
+                    out.append(text.substr(begin, end - begin));
+                    positions[x] = end + 1;
+                    pad(start, x);
+                    plain(padding_right);
+                }
+
+                plain(vertical_bar);
+                writer.finish(out);
+                out.push_back('\n');
+            }
+        };
+
+        // the header followed by the rows asked for
+        size_t drawn = rows == 0 ? 0 : 1 + std::min(count, rows - 1 - std::min(first_row, rows - 1));
+
+        for (size_t i = 0; i < drawn; i++)
+        {
+            size_t y = i == 0 ? 0 : first_row + i;
+
+            if (i == 0)
+            {
+                rule(borders->top_left, borders->top_intersection, borders->top_right);
+            }
+
+            // cells keep their colours to themselves, the borders and padding are always drawn plain
+            size_t row_start = out.size();
+            style_writer_t row_writer = writer;
+            bool multiline = false;
+
+            plain(vertical_bar);
+
+            for (size_t x = 0; x < cols && !multiline; x++)
+            {
+                if (x != 0 && vertical)
+                {
+                    plain(vertical_bar);
+                }
+
+                plain(padding_left);
+
+                // the cell is measured once it has been written, so it is only pulled once
+                size_t start = out.size();
+
+                write_cell(y, x, out);
+
+                // a row with a line break in it is started over and drawn a line at a time
+                multiline = std::string_view(out).substr(start).find('\n') != std::string_view::npos;
+
+                if (!multiline)
+                {
+                    pad(start, x);
+                    plain(padding_right);
+                }
+            }
+
+            if (multiline)
+            {
+                out.resize(row_start);
+                writer = row_writer;
+                write_lines(y);
+            }
+            else
+            {
+                plain(vertical_bar);
+                writer.finish(out);
+                out.push_back('\n');
+            }
+
+            if (i == drawn - 1)
+            {
+                rule(borders->bottom_left, borders->bottom_intersection, borders->bottom_right);
+            }
+            else if ((properties & TABLE_BORDER_HORIZ) ||
+                     ((properties & TABLE_HEADER_BORDER) && y == 0) ||
+                     ((properties & TABLE_FOOTER_BORDER) && y == rows - 2))
+            {
+                rule(borders->left_intersection, borders->intersection, borders->right_intersection);
+            }
+
+            if (out.size() >= RENDER_FLUSH_SIZE)
+            {
+                STATS(stats_data.table.bytes += out.size());
+                sink(out);
+                out.clear();
+            }
+        }
+
+        if (!out.empty())
+        {
+            STATS(stats_data.table.bytes += out.size());
+            sink(out);
+        }
+
+        // the render time is what is left once the other phases are taken out
+        STATS(stats_data.table.renders++);
+        STATS(stats_data.table.cells += drawn * cols);
+        STATS(stats_data.table.render += std::chrono::steady_clock::now() - start_time - (stats_data.table.width - start_width) - (stats_data.table.transcode - start_transcode));
+        STATS(stats_publish());
+    }
+
+    std::string cell_table_t::to_string() const
+    {
+        std::string out;
+
+        render([&](std::string_view piece) { out.append(piece); });
+
+        return out;
+    }
+
+    void cell_table_t::run() const
+    {
+        render([](std::string_view piece) { std::cout << piece; });
+        std::cout << std::endl;
+    }
+
+    table_view_t::table_view_t(size_t rows, size_t columns, cell_writer_t writer, width_hint_t width_hint, int props, const borders_t &b)
+    : cell_table_t(props, b),
+      rows(rows),
+      columns(columns),
+      writer(std::move(writer)),
+      width_hint(std::move(width_hint))
+    {
+    }
+
+    size_t table_view_t::cell_width(size_t row, size_t column) const
+    {
+        scratch.clear();
+        writer(row, column, scratch);
+
+        return display_width(scratch);
+    }
+
+    void table_view_t::write_cell(size_t row, size_t column, std::string &out) const
+    {
+        writer(row, column, out);
+    }
+
+    size_t table_view_t::column_width(size_t column) const
+    {
+        size_t width = width_hint ? width_hint(column) : 0;
+
+        return width > 0 ? width : cell_table_t::column_width(column);
+    }
+
+    // table export
+
+    // characters a format cannot take as they are: control characters, which
+    // include ESC and line breaks, everything from DEL up, which has to be
+    // encoded as UTF-8, and whatever the format itself gives a meaning to
+    template <export_format F>
+    static bool export_special(uint32_t c)
+    {
+        bool special = c < 0x20 || c >= 0x7F;
+
+        if constexpr (F == EXPORT_CSV)
+        {
+            special |= c == '"' || c == ',';
+        }
+        else if constexpr (F == EXPORT_TSV)
+        {
+            special |= c == '\\';
+        }
+        else if constexpr (F == EXPORT_JSONL)
+        {
+            special |= c == '"' || c == '\\';
+        }
+        else
+        {
+            special |= c == '|';
+        }
+
+        return special;
+    }
+
+    // the most bytes one character can turn into, which is \u001b in JSON
+    #define EXPORT_MAX_CHAR_SIZE 6
+
+    // Collects the output of an export in a buffer that is handed to the sink
+    // whenever it fills up, so there is no allocation per cell.
+    struct export_buffer_t
+    {
+        const table_t::sink_t &sink;
+        std::string data = std::string(RENDER_FLUSH_SIZE * 2, '\0');
+        size_t size = 0;
+
+        // makes room for n more bytes and returns where they go
+        char *reserve(size_t n)
+        {
+            if (size + n > data.size())
+            {
+                flush();
+
+                if (n > data.size())
+                {
+                    data.resize(n);
+                }
+            }
+
+            return data.data() + size;
+        }
+
+        void append(std::string_view text)
+        {
+            memcpy(reserve(text.size()), text.data(), text.size());
+            size += text.size();
+        }
+
+        void flush()
+        {
+            if (size > 0)
+            {
+                sink(std::string_view(data.data(), size));
+                size = 0;
+            }
+        }
+    };
+
+    // Writes a cell to p, leaving out its escape codes and escaping whatever
+    // the format needs escaped, and returns where it ends. A CSV cell is quoted
+    // when it has to be. There has to be room for EXPORT_MAX_CHAR_SIZE bytes a
+    // character and two more.
+    template <export_format F>
+    static char *export_cell(std::wstring_view cell, char *p)
+    {
+        char *start = p;
+        const wchar_t *it = cell.data();
+        const wchar_t *end = it + cell.size();
+        bool quote = false;
+
+        while (it < end)
+        {
+            // Plain text is checked and narrowed 16 characters at a time. The
+            // loops have a fixed count, no branches and work on local copies
+            // that cannot alias, so they become vector instructions once optimised.
+            while (end - it >= 16)
+            {
+                uint32_t block[16];
+                char narrowed[16];
+                unsigned special = 0;
+
+                memcpy(block, it, sizeof(block));
+
+                for (int i = 0; i < 16; i++)
+                {
+                    special |= export_special<F>(block[i]);
+                }
+
+                if (special)
+                {
+                    break;
+                }
+
+                for (int i = 0; i < 16; i++)
+                {
+                    narrowed[i] = (char)block[i];
+                }
+
+                memcpy(p, narrowed, sizeof(narrowed));
+                p += 16;
+                it += 16;
+            }
+
+            // at most 15 characters to the end, or the block the special one is in
+            for (const wchar_t *block_end = std::min(end, it + 16); it < block_end;)
+            {
+                uint32_t c = *it++;
+
+                if (!export_special<F>(c))
+                {
+                    *p++ = (char)c;
+                }
+                else if (c == 0x1b)
+                {
+                    // a CSI sequence runs up to its final byte, anything else is ESC and one more character
+                    if (it < end && *it == '[')
+                    {
+                        it++;
+
+                        while (it < end && *it >= 0x20 && *it <= 0x3F)
+                        {
+                            it++;
+                        }
+                    }
+
+                    it = std::min(it + 1, end);
+                    block_end = std::min(end, it + 16);
+                }
+                else if (c >= 0x80)
+                {
+                    if (c < 0x800)
+                    {
+                        *p++ = (char)(0xC0 | (c >> 6));
+                    }
+                    else
+                    {
+                        if (c < 0x10000)
+                        {
+                            *p++ = (char)(0xE0 | (c >> 12));
+                        }
+                        else
+                        {
+                            *p++ = (char)(0xF0 | (c >> 18));
+                            *p++ = (char)(0x80 | ((c >> 12) & 0x3F));
+                        }
+
+                        *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                    }
+
+                    *p++ = (char)(0x80 | (c & 0x3F));
+                }
+                else if constexpr (F == EXPORT_CSV)
+                {
+                    // line breaks and separators only need the cell quoted, quotes are doubled as well
+                    quote |= c == '"' || c == ',' || c == '\n' || c == '\r';
+                    *p++ = (char)c;
+
+                    if (c == '"')
+                    {
+                        *p++ = '"';
+                    }
+                }
+                else if constexpr (F == EXPORT_TSV)
+                {
+                    const char *escaped = c == '\t' ? "\\t" : c == '\n' ? "\\n" : c == '\r' ? "\\r" : c == '\\' ? "\\\\" : nullptr;
+
+                    if (escaped)
+                    {
+                        *p++ = escaped[0];
+                        *p++ = escaped[1];
+                    }
+                    else
+                    {
+                        *p++ = (char)c;
+                    }
+                }
+                else if constexpr (F == EXPORT_JSONL)
+                {
+                    const char *escaped = c == '"' ? "\\\"" : c == '\\' ? "\\\\" : c == '\n' ? "\\n" : c == '\r' ? "\\r" : c == '\t' ? "\\t" : nullptr;
+
+                    if (escaped)
+                    {
+                        *p++ = escaped[0];
+                        *p++ = escaped[1];
+                    }
+                    else if (c < 0x20)
+                    {
+                        static const char hex[] = "0123456789abcdef";
+
+                        memcpy(p, "\\u00", 4);
+                        p[4] = hex[c >> 4];
+                        p[5] = hex[c & 0xF];
+                        p += 6;
+                    }
+                    else
+                    {
+                        *p++ = (char)c;
+                    }
+                }
+                else
+                {
+                    // a table row has to stay on one line
+                    if (c == '|')
+                    {
+                        *p++ = '\\';
+                        *p++ = '|';
+                    }
+                    else if (c == '\n')
+                    {
+                        memcpy(p, "<br>", 4);
+                        p += 4;
+                    }
+                    else if (c != '\r')
+                    {
+                        *p++ = (char)c;
+                    }
+                }
+            }
+        }
+
+        if (quote)
+        {
+            memmove(start + 1, start, p - start);
+            *start = '"';
+            p++;
+            *p++ = '"';
+        }
+
+        return p;
+    }
+
+    template <export_format F>
+    static void export_cell(std::wstring_view cell, export_buffer_t &out)
+    {
+        char *start = out.reserve(cell.size() * EXPORT_MAX_CHAR_SIZE + 2);
+
+        out.size += export_cell<F>(cell, start) - start;
+    }
+
+    // the start of a JSON object member up to the opening quote of its value
+    static std::string export_key(std::wstring_view name)
+    {
+        std::string key(name.size() * EXPORT_MAX_CHAR_SIZE + 8, '\0');
+        char *p = key.data();
+
+        *p++ = '"';
+        p = export_cell<EXPORT_JSONL>(name, p);
+        memcpy(p, "\":\"", 3);
+        key.resize(p + 3 - key.data());
+
+        return key;
+    }
+
+    template <export_format F>
+    static void export_rows(const std::vector<wcolumn_t> &rows, std::span<const int> widths, export_buffer_t &out)
+    {
+        // the header gives the keys of every JSON object, written out once
+        std::vector<std::string> keys;
+
+        if constexpr (F == EXPORT_JSONL)
+        {
+            for (size_t y = 0; !rows.empty() && y < rows[0].size(); y++)
+            {
+                keys.push_back(export_key(rows[0][y]));
+            }
+        }
+
+        for (size_t x = F == EXPORT_JSONL ? 1 : 0; x < rows.size(); x++)
+        {
+            const wcolumn_t &row = rows[x];
+
+            if constexpr (F == EXPORT_JSONL)
+            {
+                out.append("{");
+            }
+            else if constexpr (F == EXPORT_MARKDOWN)
+            {
+                out.append("|");
+            }
+
+            for (size_t y = 0; y < row.size(); y++)
+            {
+                if constexpr (F == EXPORT_CSV || F == EXPORT_TSV)
+                {
+                    if (y > 0)
+                    {
+                        out.append(F == EXPORT_CSV ? "," : "\t");
+                    }
+                }
+                else if constexpr (F == EXPORT_JSONL)
+                {
+                    if (y > 0)
+                    {
+                        out.append(",");
+                    }
+
+                    // cells past the end of the header are keyed by their index
+                    out.append(y < keys.size() ? keys[y] : export_key(std::to_wstring(y)));
+                }
+                else
+                {
+                    out.append(" ");
+                }
+
+                export_cell<F>(row[y], out);
+
+                if constexpr (F == EXPORT_JSONL)
+                {
+                    out.append("\"");
+                }
+                else if constexpr (F == EXPORT_MARKDOWN)
+                {
+                    size_t width = line_width(std::wstring_view(row[y]));
+
+                    for (size_t i = width; i < (size_t)std::max(widths[y], 3); i++)
+                    {
+                        out.append(" ");
+                    }
+
+                    out.append(" |");
+                }
+            }
+
+            if constexpr (F == EXPORT_JSONL)
+            {
+                out.append("}");
+            }
+
+            out.append("\n");
+
+            // the line under the header
+            if (F == EXPORT_MARKDOWN && x == 0)
+            {
+                out.append("|");
+
+                for (size_t y = 0; y < row.size(); y++)
+                {
+                    out.append(" ");
+
+                    for (int i = 0; i < std::max(widths[y], 3); i++)
+                    {
+                        out.append("-");
+                    }
+
+                    out.append(" |");
+                }
+
+                out.append("\n");
+            }
+        }
+
+        out.flush();
+    }
+
+    void table_t::export_to(export_format format, const sink_t &sink) const
+    {
+        export_buffer_t out { sink };
+
+        switch (format)
+        {
+        case EXPORT_CSV:
+            export_rows<EXPORT_CSV>(columns, {}, out);
+            break;
+        case EXPORT_TSV:
+            export_rows<EXPORT_TSV>(columns, {}, out);
+            break;
+        case EXPORT_JSONL:
+            export_rows<EXPORT_JSONL>(columns, {}, out);
+            break;
+        case EXPORT_MARKDOWN:
+        {
+            std::pmr::vector<int> widths(working_memory());
+
+            get_widths(widths);
+            export_rows<EXPORT_MARKDOWN>(columns, widths, out);
+            break;
+        }
+        }
+    }
+
+    std::string table_t::export_to(export_format format) const
+    {
+        std::string out;
+
+        export_to(format, [&](std::string_view piece) { out.append(piece); });
+
+        return out;
+    }
+
+    // string tables
+
+    string_table_t::string_table_t(std::vector<std::string> headers, int props, const borders_t &b)
+    : cell_table_t(props, b),
+      headers(std::move(headers)),
+      columns(this->headers.size())
+    {
+    }
+
+    void string_table_t::append_row(std::span<const std::string_view> cells)
+    {
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            append(columns[i], i < cells.size() ? cells[i] : std::string_view());
+        }
+
+        rows++;
+    }
+
+    void string_table_t::append_row(std::initializer_list<std::string_view> cells)
+    {
+        append_row(std::span<const std::string_view>(cells.begin(), cells.size()));
+    }
+
+    void string_table_t::reserve(size_t count)
+    {
+        for (auto &column : columns)
+        {
+            if (column.encoded)
+            {
+                column.codes.reserve(count);
+            }
+            else
+            {
+                column.ends.reserve(count);
+            }
+        }
+    }
+
+    bool string_table_t::dictionary_encoded(size_t column) const
+    {
+        return columns[column].encoded;
+    }
+
+    size_t string_table_t::dictionary_size(size_t column) const
+    {
+        return columns[column].encoded ? columns[column].value_ends.size() : 0;
+    }
+
+    size_t string_table_t::memory_bytes() const
+    {
+        size_t bytes = 0;
+
+        for (auto &column : columns)
+        {
+            bytes += column.codes.capacity() * sizeof(uint16_t) + column.values.capacity() + column.value_ends.capacity() * sizeof(uint32_t) +
+                     column.value_widths.capacity() * sizeof(uint32_t) + column.slots.capacity() * sizeof(uint16_t) + column.data.capacity() +
+                     column.ends.capacity() * sizeof(size_t);
+        }
+
+        return bytes;
+    }
+
+    void string_table_t::append(string_column_t &column, std::string_view cell)
+    {
+        if (column.encoded)
+        {
+            size_t mask = column.slots.size() - 1;
+            size_t slot = column.slots.empty() ? 0 : std::hash<std::string_view>()(cell) & mask;
+
+            while (!column.slots.empty() && column.slots[slot] != 0)
+            {
+                size_t code = column.slots[slot] - 1;
+
+                if (column.value(code) == cell)
+                {
+                    column.codes.push_back(code);
+
+                    return;
+                }
+
+                slot = (slot + 1) & mask;
+            }
+
+            size_t count = column.value_ends.size();
+
+            // a column with mostly different values gains nothing from a dictionary
+            if (count < DICTIONARY_MAX_VALUES && (count < DICTIONARY_MIN_VALUES || count <= rows / 2) && column.values.size() + cell.size() <= UINT32_MAX)
+            {
+                size_t width = display_width(cell);
+
+                column.values.append(cell);
+                column.value_ends.push_back(column.values.size());
+                column.value_widths.push_back(width);
+                column.width = std::max(column.width, width);
+                column.codes.push_back(count);
+
+                // kept at most half full, so probes stay short
+                if (column.slots.size() < (count + 1) * 2)
+                {
+                    grow_slots(column);
+                }
+                else
+                {
+                    column.slots[slot] = count + 1;
+                }
+
+                return;
+            }
+
+            decode(column);
+        }
+
+        column.width = std::max(column.width, display_width(cell));
+        column.data.append(cell);
+        column.ends.push_back(column.data.size());
+    }
+
+    // doubles the slots and puts every value back in
+    void string_table_t::grow_slots(string_column_t &column)
+    {
+        column.slots.assign(std::max<size_t>(16, column.slots.size() * 2), 0);
+
+        size_t mask = column.slots.size() - 1;
+
+        for (size_t code = 0; code < column.value_ends.size(); code++)
+        {
+            size_t slot = std::hash<std::string_view>()(column.value(code)) & mask;
+
+            while (column.slots[slot] != 0)
+            {
+                slot = (slot + 1) & mask;
+            }
+
+            column.slots[slot] = code + 1;
+        }
+    }
+
+    // writes every cell out as a plain string and drops the dictionary
+    void string_table_t::decode(string_column_t &column)
+    {
+        size_t size = 0;
+
+        for (uint16_t code : column.codes)
+        {
+            size += column.value(code).size();
+        }
+
+        column.data.reserve(size);
+        column.ends.reserve(std::max(column.codes.capacity(), column.codes.size() + 1));
+
+        for (uint16_t code : column.codes)
+        {
+            column.data.append(column.value(code));
+            column.ends.push_back(column.data.size());
+        }
+
+        column.encoded = false;
+        column.codes = std::vector<uint16_t>();
+        column.values = std::string();
+        column.value_ends = std::vector<uint32_t>();
+        column.value_widths = std::vector<uint32_t>();
+        column.slots = std::vector<uint16_t>();
+    }
+
+    std::string_view string_table_t::cell(size_t row, size_t column) const
+    {
+        if (row == 0)
+        {
+            return headers[column];
+        }
+
+        const string_column_t &cells = columns[column];
+
+        if (cells.encoded)
+        {
+            return cells.value(cells.codes[row - 1]);
+        }
+
+        size_t start = row > 1 ? cells.ends[row - 2] : 0;
+
+        return std::string_view(cells.data).substr(start, cells.ends[row - 1] - start);
+    }
+
+    size_t string_table_t::cell_width(size_t row, size_t column) const
+    {
+        if (row > 0 && columns[column].encoded)
+        {
+            return columns[column].value_widths[columns[column].codes[row - 1]];
+        }
+
+        return display_width(cell(row, column));
+    }
+
+    void string_table_t::write_cell(size_t row, size_t column, std::string &out) const
+    {
+        out.append(cell(row, column));
+    }
+
+    size_t string_table_t::column_width(size_t column) const
+    {
+        return std::max(columns[column].width, display_width(headers[column]));
+    }
+
+    // spilling tables
+
+    std::shared_ptr<spill_table_t> spill_table_t::create(std::vector<std::string> headers, size_t memory_limit, int props, const borders_t &b)
+    {
+        const char *directory = getenv("TMPDIR");
+        std::string path = std::string(directory && *directory ? directory : "/tmp") + "/libquest_table_XXXXXX";
+        int fd = mkstemp(path.data());
+
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+
+        // the file goes away with the last descriptor, even if the process dies
+        unlink(path.c_str());
+
+        std::shared_ptr<spill_table_t> table(new spill_table_t(props, b));
+
+        table->fd = fd;
+        table->headers = std::move(headers);
+        table->widths.resize(table->headers.size());
+        table->memory_limit = memory_limit;
+
+        // leave room for a few chunks to be mapped at once next to the one being filled
+        table->chunk_limit = std::clamp<size_t>(memory_limit / 8, 64 * 1024, 4 * 1024 * 1024);
+        table->open_offsets.push_back(0);
+
+        for (size_t i = 0; i < table->headers.size(); i++)
+        {
+            table->widths[i] = display_width(table->headers[i]);
+        }
+
+        return table;
+    }
+
+    spill_table_t::~spill_table_t()
+    {
+        for (auto &mapping : mappings)
+        {
+            munmap((void *)mapping.data, mapping.size);
+        }
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    bool spill_table_t::append_row(std::initializer_list<std::string_view> cells)
+    {
+        return append_row(std::span<const std::string_view>(cells.begin(), cells.size()));
+    }
+
+    bool spill_table_t::append_row(std::span<const std::string_view> cells)
+    {
+        for (size_t i = 0; i < headers.size(); i++)
+        {
+            std::string_view cell = i < cells.size() ? cells[i] : std::string_view();
+
+            widths[i] = std::max(widths[i], display_width(cell));
+            open_data.append(cell);
+            open_offsets.push_back(open_data.size());
+        }
+
+        rows++;
+
+        if (open_data.size() + open_offsets.size() * sizeof(uint32_t) >= chunk_limit)
+        {
+            return flush();
+        }
+
+        return true;
+    }
+
+    // A chunk is its cell offsets followed by the cells, starting on a page
+    // boundary so that it can be mapped on its own.
+    bool spill_table_t::flush()
+    {
+        if (rows == open_first_row)
+        {
+            return true;
+        }
+
+        size_t page = sysconf(_SC_PAGESIZE);
+        chunk_t chunk = { (file_size + page - 1) / page * page, open_offsets.size() * sizeof(uint32_t) + open_data.size(), open_first_row };
+
+        struct iovec parts[] =
+        {
+            { open_offsets.data(), open_offsets.size() * sizeof(uint32_t) },
+            { open_data.data(), open_data.size() }
+        };
+
+        if (pwritev(fd, parts, 2, chunk.offset) != (ssize_t)chunk.size)
+        {
+            return false;
+        }
+
+        chunks.push_back(chunk);
+        file_size = chunk.offset + chunk.size;
+        open_first_row = rows;
+        open_offsets.assign(1, 0);
+        open_data.clear();
+
+        return true;
+    }
+
+    const char *spill_table_t::map_chunk(size_t index) const
+    {
+        for (auto &mapping : mappings)
+        {
+            if (mapping.chunk == index)
+            {
+                mapping.last_used = ++clock;
+
+                return mapping.data;
+            }
+        }
+
+        const chunk_t &chunk = chunks[index];
+
+        // unmap the least recently used chunks until this one fits next to the chunk being filled
+        while (!mappings.empty() && mapped_bytes + chunk.size + chunk_limit > memory_limit)
+        {
+            auto oldest = std::min_element(mappings.begin(), mappings.end(), [](const mapping_t &a, const mapping_t &b) { return a.last_used < b.last_used; });
+
+            munmap((void *)oldest->data, oldest->size);
+            mapped_bytes -= oldest->size;
+            mappings.erase(oldest);
+        }
+
+        void *data = mmap(nullptr, chunk.size, PROT_READ, MAP_PRIVATE, fd, chunk.offset);
+
+        if (data == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        madvise(data, chunk.size, MADV_SEQUENTIAL);
+        mappings.push_back({ index, (const char *)data, chunk.size, ++clock });
+        mapped_bytes += chunk.size;
+
+        return (const char *)data;
+    }
+
+    std::string_view spill_table_t::cell(size_t row, size_t column) const
+    {
+        if (row == 0)
+        {
+            return headers[column];
+        }
+
+        row--;
+
+        if (row >= open_first_row)
+        {
+            size_t i = (row - open_first_row) * headers.size() + column;
+
+            return std::string_view(open_data).substr(open_offsets[i], open_offsets[i + 1] - open_offsets[i]);
+        }
+
+        size_t index = std::upper_bound(chunks.begin(), chunks.end(), row, [](size_t row, const chunk_t &chunk) { return row < chunk.first_row; }) - chunks.begin() - 1;
+        size_t next_row = index + 1 < chunks.size() ? chunks[index + 1].first_row : open_first_row;
+        const char *data = map_chunk(index);
+
+        if (!data)
+        {
+            return {};
+        }
+
+        const uint32_t *offsets = (const uint32_t *)data;
+        const char *cells = data + ((next_row - chunks[index].first_row) * headers.size() + 1) * sizeof(uint32_t);
+        size_t i = (row - chunks[index].first_row) * headers.size() + column;
+
+        return std::string_view(cells + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+    size_t spill_table_t::cell_width(size_t row, size_t column) const
+    {
+        return display_width(cell(row, column));
+    }
+
+    void spill_table_t::write_cell(size_t row, size_t column, std::string &out) const
+    {
+        out.append(cell(row, column));
+    }
+
+    size_t spill_table_t::column_width(size_t column) const
+    {
+        return widths[column];
+    }
+
+    spill_table_t::memory_stats_t spill_table_t::memory_stats() const
+    {
+        memory_stats_t stats;
+
+        stats.limit = memory_limit;
+        stats.rows = rows;
+        stats.chunks = chunks.size();
+        stats.file_bytes = file_size;
+        stats.buffered_bytes = open_data.capacity() + open_offsets.capacity() * sizeof(uint32_t);
+        stats.mapped_bytes = mapped_bytes;
+        stats.index_bytes = chunks.capacity() * sizeof(chunk_t) + widths.capacity() * sizeof(size_t);
+
+        return stats;
+    }
+
+    // concurrent tables
+
+    concurrent_table_t::concurrent_table_t(std::vector<std::string> headers, size_t visible_rows, int max_fps, sink_t sink, int props, const borders_t &b)
+    : cell_table_t(props, b),
+      columns(headers.size()),
+      visible_rows(visible_rows),
+      frame_interval(1000000 / std::max(max_fps, 1)),
+      sink(sink ? std::move(sink) : [](std::string_view piece) { std::cout << piece << std::flush; })
+    {
+        for (const std::string &header : headers)
+        {
+            widths.push_back(display_width(header));
+        }
+
+        rows.push_back(std::move(headers));
+        thread = std::thread([this]() { render_loop(); });
+    }
+
+    concurrent_table_t::~concurrent_table_t()
+    {
+        stop();
+
+        // rows pushed after stopping are never drawn
+        for (row_node_t *node = pending.exchange(nullptr); node;)
+        {
+            row_node_t *next = node->next;
+
+            delete node;
+            node = next;
+        }
+    }
+
+    void concurrent_table_t::push_row(std::vector<std::string> cells)
+    {
+        cells.resize(columns);
+
+        row_node_t *node = new row_node_t { pending.load(std::memory_order_relaxed), std::move(cells) };
+
+        // the release makes the cells visible to the render thread along with the node
+        while (!pending.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void concurrent_table_t::push_row(std::initializer_list<std::string_view> cells)
+    {
+        push_row(std::vector<std::string>(cells.begin(), cells.end()));
+    }
+
+    void concurrent_table_t::stop()
+    {
+        {
+            std::lock_guard lock(mutex);
+
+            stopping = true;
+        }
+
+        wake.notify_one();
+
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    void concurrent_table_t::render_loop()
+    {
+        stats_background = true;
+
+        std::unique_lock lock(mutex);
+        auto next_frame = std::chrono::steady_clock::now();
+        bool dirty = true;
+
+        while (true)
+        {
+            bool last = wake.wait_until(lock, next_frame, [&]() { return stopping; });
+
+            lock.unlock();
+
+            dirty |= take_pending();
+
+            if (dirty)
+            {
+                draw();
+                dirty = false;
+            }
+
+            lock.lock();
+
+            if (last)
+            {
+                break;
+            }
+
+            // a frame that ran long pushes the next one back rather than making it up
+            next_frame = std::max(next_frame + frame_interval, std::chrono::steady_clock::now());
+        }
+    }
+
+    bool concurrent_table_t::take_pending()
+    {
+        row_node_t *node = pending.exchange(nullptr, std::memory_order_acquire);
+
+        if (!node)
+        {
+            return false;
+        }
+
+        // the list comes newest first
+        row_node_t *oldest = nullptr;
+
+        while (node)
+        {
+            row_node_t *next = node->next;
+
+            node->next = oldest;
+            oldest = node;
+            node = next;
+        }
+
+        while (oldest)
+        {
+            row_node_t *next = oldest->next;
+
+            for (size_t x = 0; x < columns; x++)
+            {
+                widths[x] = std::max(widths[x], display_width(oldest->cells[x]));
+            }
+
+            rows.push_back(std::move(oldest->cells));
+            delete oldest;
+            oldest = next;
+        }
+
+        return true;
+    }
+
+    void concurrent_table_t::draw()
+    {
+        size_t data_rows = rows.size() - 1;
+        size_t first_row = data_rows > visible_rows ? data_rows - visible_rows : 0;
+
+        frame.clear();
+
+        // go back over the previous frame, the whole frame is then handed to the sink at once
+        if (drawn_lines > 0)
+        {
+            frame.append("\x1b[").append(std::to_string(drawn_lines)).append("A\r\x1b[J");
+        }
+
+        size_t start = frame.size();
+
+        render([&](std::string_view piece) { frame.append(piece); }, first_row, visible_rows);
+
+        // rows wider than the terminal wrap, and the next frame has to go back over those lines too
+        drawn_lines = wrapped_lines(std::string_view(frame).substr(start), terminal_columns());
+
+        sink(frame);
+        frame_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // shared tables
+
+    // The segment starts with the header, then the widest cell of every
+    // column and the headers, each as its length and text. The row index and
+    // the ring of records come after that, on an 8 byte boundary.
+    #define SHARED_TABLE_HEADER_SIZE 64
+
+    struct shared_table_t::segment_header_t
+    {
+        char magic[8];
+        uint32_t columns;
+        uint32_t headers_size;
+        uint64_t capacity;
+        uint64_t max_rows;
+
+        // the number of the next row to be written and of the oldest one still in the ring
+        std::atomic<uint64_t> head;
+        std::atomic<uint64_t> tail;
+        std::atomic<uint32_t> finished;
+    };
+
+    // the offset of a row's record in the ring, which only ever grows, and its size
+    struct shared_table_t::row_entry_t
+    {
+        std::atomic<uint64_t> sequence;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    static const char shared_table_magic[8] = { 'L', 'Q', 'T', 'A', 'B', 'L', '0', '1' };
+
+    static size_t shared_table_entries_offset(size_t columns, size_t headers_size)
+    {
+        return (SHARED_TABLE_HEADER_SIZE + columns * sizeof(uint32_t) + headers_size + 7) / 8 * 8;
+    }
+
+    // Creates the segment and takes a lock on it that lasts as long as the
+    // writer does. A segment already under the name that nobody holds the
+    // lock on was left behind by a writer that died, and is replaced; one
+    // that is locked, or still being set up, makes this fail with EEXIST.
+    static int create_segment(const std::string &name)
+    {
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+
+            if (fd >= 0)
+            {
+                flock(fd, LOCK_EX);
+
+                return fd;
+            }
+
+            if (errno != EEXIST)
+            {
+                return -1;
+            }
+
+            fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+
+            // it went away in the meantime, so try again
+            if (fd < 0)
+            {
+                continue;
+            }
+
+            struct stat st;
+            bool stale = flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &st) == 0 && st.st_size > 0;
+
+            close(fd);
+
+            if (!stale)
+            {
+                errno = EEXIST;
+
+                return -1;
+            }
+
+            // readers that still have it open keep it, and see it finished
+            shm_unlink(name.c_str());
+        }
+
+        errno = EEXIST;
+
+        return -1;
+    }
+
+    std::shared_ptr<shared_table_t> shared_table_t::create(const std::string &name, std::vector<std::string> headers, size_t capacity, size_t max_rows,
+                                                           int props, const borders_t &b)
+    {
+        static_assert(sizeof(segment_header_t) <= SHARED_TABLE_HEADER_SIZE);
+
+        size_t headers_size = 0;
+
+        for (const std::string &header : headers)
+        {
+            headers_size += sizeof(uint32_t) + header.size();
+        }
+
+        capacity = std::max<size_t>(capacity, 4096) / 8 * 8;
+        max_rows = std::max<size_t>(max_rows, 1);
+
+        int fd = create_segment(name);
+
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+
+        // from here on the table owns the name, so failing unlinks it again
+        std::shared_ptr<shared_table_t> table(new shared_table_t(props, b));
+
+        table->fd = fd;
+        table->name = name;
+        table->writer = true;
+        table->mapping_size = shared_table_entries_offset(headers.size(), headers_size) + max_rows * sizeof(row_entry_t) + capacity;
+
+        if (ftruncate(fd, table->mapping_size) != 0)
+        {
+            return nullptr;
+        }
+
+        table->mapping = mmap(nullptr, table->mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (table->mapping == MAP_FAILED)
+        {
+            table->mapping = nullptr;
+
+            return nullptr;
+        }
+
+        // the segment starts out zeroed, so the widths, head and tail start at 0
+        segment_header_t *header = (segment_header_t *)table->mapping;
+        char *text = (char *)table->mapping + SHARED_TABLE_HEADER_SIZE + headers.size() * sizeof(uint32_t);
+
+        header->columns = headers.size();
+        header->headers_size = headers_size;
+        header->capacity = capacity;
+        header->max_rows = max_rows;
+
+        for (const std::string &header_text : headers)
+        {
+            uint32_t len = header_text.size();
+
+            memcpy(text, &len, sizeof(len));
+            memcpy(text + sizeof(len), header_text.data(), len);
+            text += sizeof(len) + len;
+        }
+
+        row_entry_t *entries = (row_entry_t *)((char *)table->mapping + shared_table_entries_offset(headers.size(), headers_size));
+
+        // no row has the number UINT64_MAX, so an entry never written matches none
+        for (size_t i = 0; i < max_rows; i++)
+        {
+            entries[i].sequence.store(UINT64_MAX, std::memory_order_relaxed);
+        }
+
+        // readers take the segment for a table once the magic is there, so it goes in last
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(header->magic, shared_table_magic, sizeof(shared_table_magic));
+
+        if (!table->map())
+        {
+            return nullptr;
+        }
+
+        return table;
+    }
+
+    std::shared_ptr<shared_table_t> shared_table_t::open(const std::string &name, int props, const borders_t &b)
+    {
+        int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<shared_table_t> table(new shared_table_t(props, b));
+        struct stat st;
+
+        table->fd = fd;
+        table->name = name;
+
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < SHARED_TABLE_HEADER_SIZE)
+        {
+            return nullptr;
+        }
+
+        table->mapping_size = st.st_size;
+        table->mapping = mmap(nullptr, table->mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (table->mapping == MAP_FAILED)
+        {
+            table->mapping = nullptr;
+
+            return nullptr;
+        }
+
+        if (!table->map())
+        {
+            return nullptr;
+        }
+
+        table->refresh();
+
+        return table;
+    }
+
+    // finds the parts of the segment and checks that they fit in the mapping
+    bool shared_table_t::map()
+    {
+        header = (segment_header_t *)mapping;
+
+        if (memcmp(header->magic, shared_table_magic, sizeof(shared_table_magic)) != 0)
+        {
+            return false;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        columns = header->columns;
+        capacity = header->capacity;
+        max_rows = header->max_rows;
+
+        size_t entries_offset = shared_table_entries_offset(columns, header->headers_size);
+
+        if (max_rows == 0 || capacity == 0 || capacity % 8 != 0 || entries_offset + max_rows * sizeof(row_entry_t) + capacity != mapping_size)
+        {
+            return false;
+        }
+
+        widths = (std::atomic<uint32_t> *)((char *)mapping + SHARED_TABLE_HEADER_SIZE);
+        entries = (row_entry_t *)((char *)mapping + entries_offset);
+        ring = (char *)(entries + max_rows);
+
+        const char *text = (const char *)(widths + columns);
+        const char *text_end = text + header->headers_size;
+
+        for (size_t i = 0; i < columns; i++)
+        {
+            uint32_t len;
+
+            if (text_end - text < (ptrdiff_t)sizeof(len))
+            {
+                return false;
+            }
+
+            memcpy(&len, text, sizeof(len));
+            text += sizeof(len);
+
+            if (text_end - text < (ptrdiff_t)len)
+            {
+                return false;
             }
 
-            line_num++;
-            result.append(line + "\n");
+            headers.emplace_back(text, len);
+            header_widths.push_back(display_width(headers.back()));
+            text += len;
         }
 
-        if (result.empty())
+        return true;
+    }
+
+    shared_table_t::~shared_table_t()
+    {
+        if (writer && header)
         {
-            result = default_option;
+            header->finished.store(1, std::memory_order_release);
         }
 
-        erase_term_lines(line_num + 2);
+        if (writer)
+        {
+            shm_unlink(name.c_str());
+        }
 
-        // remove trailing newlines
-        auto start_newline = result.find_last_not_of('\n');
-        auto end_newline = result.find_last_of('\n');
+        if (mapping)
+        {
+            munmap(mapping, mapping_size);
+        }
 
-        if(start_newline != std::string::npos && end_newline != std::string::npos)
+        if (fd >= 0)
         {
-            if(start_newline + 1 < result.size())
-            {
-                start_newline++;
+            close(fd);
+        }
+    }
 
-                result.erase(start_newline, end_newline - start_newline + 1);
-            }
+    bool shared_table_t::append_row(std::initializer_list<std::string_view> cells)
+    {
+        return append_row(std::span<const std::string_view>(cells.begin(), cells.size()));
+    }
+
+    // A record is the end of every cell's text, the width of every cell and
+    // then the text, rounded up to 8 bytes. Records never wrap around the end
+    // of the ring, so that every cell can be read in one piece.
+    bool shared_table_t::append_row(std::span<const std::string_view> cells)
+    {
+        size_t text_size = 0;
+
+        for (size_t i = 0; i < columns && i < cells.size(); i++)
+        {
+            text_size += cells[i].size();
         }
 
-        change_term_style(STYLE1);
-        std::cout << "? ";
-        change_term_style(STYLE2);
-        std::cout << question_text << "\n";
-        change_term_style(STYLE3);
+        uint64_t size = (columns * 2 * sizeof(uint32_t) + text_size + 7) / 8 * 8;
 
-        if(!result.empty())
+        if (!writer || size > capacity / 2)
         {
-            std::cout << result << "\n";
+            return false;
         }
 
-        change_term_style(STYLE_CLEAR);
-        std::cout.flush();
+        uint64_t at = data_head;
 
-        return result;
+        if (at % capacity + size > capacity)
+        {
+            at += capacity - at % capacity;
+        }
+
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+
+        // drop the oldest rows the record would overwrite, or whose index entry it needs
+        while (tail < head && (head - tail >= max_rows || entries[tail % max_rows].offset + capacity < at + size))
+        {
+            tail++;
+        }
+
+        // readers check the tail after reading a row, so it has to move before anything is overwritten
+        header->tail.store(tail, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        row_entry_t &entry = entries[head % max_rows];
+        char *data = ring + at % capacity;
+        uint32_t *ends = (uint32_t *)data;
+        uint32_t *cell_widths = ends + columns;
+        char *text = (char *)(cell_widths + columns);
+        uint32_t end = 0;
+
+        for (size_t i = 0; i < columns; i++)
+        {
+            std::string_view cell = i < cells.size() ? cells[i] : std::string_view();
+            uint32_t width = display_width(cell);
+
+            memcpy(text + end, cell.data(), cell.size());
+            end += cell.size();
+            ends[i] = end;
+            cell_widths[i] = width;
+
+            if (width > widths[i].load(std::memory_order_relaxed))
+            {
+                widths[i].store(width, std::memory_order_relaxed);
+            }
+        }
+
+        entry.offset = at;
+        entry.size = size;
+        entry.sequence.store(head, std::memory_order_release);
+        header->head.store(head + 1, std::memory_order_release);
+        data_head = at + size;
+
+        // the writer always sees what it has written
+        first = tail;
+        last = head + 1;
+
+        return true;
     }
 
-    std::string yesno_t::run()
+    size_t shared_table_t::refresh()
     {
-        std::string result;
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        size_t added = head - last;
 
-        change_term_style(STYLE1);
-        std::cout << "? ";
-        change_term_style(STYLE2);
-        std::cout << question_text << " ";
-        change_term_style(STYLE5);
+        // the writer may have moved on between the two loads
+        first = std::min(tail, head);
+        last = head;
 
-        if(default_option)
+        return added;
+    }
+
+    bool shared_table_t::finished() const
+    {
+        if (header->finished.load(std::memory_order_acquire))
         {
-            std::cout << "(Y/n) ";
+            return true;
         }
-        else
+
+        // a writer that crashed never set the flag, but the lock it held went with it
+        if (writer || flock(fd, LOCK_SH | LOCK_NB) != 0)
         {
-            std::cout << "(y/N) ";
+            return false;
         }
 
-        change_term_style(STYLE_CLEAR);
+        // let go straight away, so that a new writer can take the name over
+        flock(fd, LOCK_UN);
 
-        std::cout.flush();
+        return true;
+    }
 
-        getline(std::cin, result);
+    // the record of a row, or nullptr if it has been overwritten
+    const char *shared_table_t::record(uint64_t sequence, uint64_t &size) const
+    {
+        const row_entry_t &entry = entries[sequence % max_rows];
+
+        if (sequence >= last || entry.sequence.load(std::memory_order_acquire) != sequence)
+        {
+            return nullptr;
+        }
 
-        std::transform(result.begin(), result.end(), result.begin(), [](char c) { return std::tolower(c); });
+        uint64_t at = entry.offset % capacity;
 
-        if(result == "y" || result == "yes")
+        size = entry.size;
+
+        // the entry may be in the middle of being written over, so never trust it to stay within the ring
+        if (size < columns * 2 * sizeof(uint32_t) || at + size > capacity)
         {
-            result = "yes";
+            return nullptr;
         }
-        else if(result == "n" || result == "no")
+
+        return ring + at;
+    }
+
+    std::string_view shared_table_t::cell(size_t row, size_t column) const
+    {
+        if (row == 0)
         {
-            result = "no";
+            return headers[column];
         }
-        else
+
+        uint64_t size;
+        const char *data = record(first + row - 1, size);
+
+        if (!data)
         {
-            result = default_option ? "yes" : "no";
+            return {};
         }
 
-        erase_term_lines(1);
+        const uint32_t *ends = (const uint32_t *)data;
+        uint32_t start = column > 0 ? ends[column - 1] : 0;
+        uint32_t end = ends[column];
 
-        change_term_style(STYLE1);
-        std::cout << "? ";
-        change_term_style(STYLE2);
-        std::cout << question_text << " ";
-        change_term_style(STYLE3);
-        std::cout << result << std::endl;
-        change_term_style(STYLE_CLEAR);
+        if (start > end || end > size - columns * 2 * sizeof(uint32_t))
+        {
+            return {};
+        }
 
-        return result;
+        return std::string_view(data + columns * 2 * sizeof(uint32_t) + start, end - start);
     }
 
-    std::string select_t::run()
+    bool shared_table_t::current(size_t row) const
     {
-        std::string result;
-        int selected = 0;
+        if (row == 0)
+        {
+            return true;
+        }
 
-        change_term_style(STYLE1);
-        std::cout << "? ";
-        change_term_style(STYLE2);
-        std::cout << question_text << "\n";
-        change_term_style(STYLE_CLEAR);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        return header->tail.load(std::memory_order_relaxed) <= first + row - 1;
+    }
 
-        auto change_selection = [&](int sel = -1)
+    size_t shared_table_t::cell_width(size_t row, size_t column) const
+    {
+        if (row == 0)
         {
-            if (sel >= 0)
-            {
-                erase_term_lines(options.size());
-            }
+            return header_widths[column];
+        }
 
-            for (int i = 0; i < options.size(); i++)
-            {
-                if ((sel == -1 && (options[i] == default_option || (i == 0 && default_option.empty()))) || sel == i)
-                {
-                    change_term_style(STYLE4);
-                    std::cout << "> ";
-                }
-                else
-                {
-                    std::cout << "  ";
-                }
+        uint64_t size;
+        const char *data = record(first + row - 1, size);
 
-                std::cout << options[i] << "\n";
+        if (!data)
+        {
+            return 0;
+        }
 
-                change_term_style(STYLE_CLEAR);
-            }
-        };
+        uint32_t width = ((const uint32_t *)data)[columns + column];
 
-        change_selection();
+        return current(row) ? width : 0;
+    }
 
-        on_key([&](int key)
+    void shared_table_t::write_cell(size_t row, size_t column, std::string &out) const
+    {
+        size_t start = out.size();
+
+        out.append(cell(row, column));
+
+        if (!current(row))
         {
-            if (key == KEY_UP)
-            {
-                if (selected > 0)
-                {
-                    selected--;
-                }
-                else
-                {
-                    selected = options.size() - 1;
-                }
+            out.resize(start);
+        }
+    }
 
-                change_selection(selected);
-            }
-            else if (key == KEY_DOWN)
-            {
-                if (selected < options.size() - 1)
-                {
-                    selected++;
-                }
-                else
-                {
-                    selected = 0;
-                }
+    size_t shared_table_t::column_width(size_t column) const
+    {
+        return std::max<size_t>(header_widths[column], widths[column].load(std::memory_order_relaxed));
+    }
 
-                change_selection(selected);
-            }
-            else if (key == '\n')
-            {
-                result = options[selected];
+    // tree tables
 
-                erase_term_lines(options.size() + 1);
+    tree_table_t::tree_table_t(std::vector<std::string> headers, int props, const borders_t &b)
+    : cell_table_t(props, b),
+      columns(headers.size())
+    {
+        std::vector<std::string_view> cells(headers.begin(), headers.end());
 
-                change_term_style(STYLE1);
-                std::cout << "? ";
-                change_term_style(STYLE2);
-                std::cout << question_text << " ";
-                change_term_style(STYLE3);
-                std::cout << result << std::endl;
-                change_term_style(STYLE_CLEAR);
+        nodes.push_back({ npos });
+        nodes[root].expanded = true;
 
-                return false;
-            }
+        for (std::string_view header : cells)
+        {
+            text.append(header);
+            cell_ends.push_back(text.size());
+        }
 
-            return true;
-        });
+        cell_widths.resize(columns);
+        summaries.resize(columns);
+        show(root);
+    }
 
-        return result;
+    size_t tree_table_t::add_row(size_t parent, std::initializer_list<std::string_view> cells, bool load_later)
+    {
+        return add_row(parent, std::span<const std::string_view>(cells.begin(), cells.size()), load_later);
     }
 
-    void questionaire_t::run()
+    size_t tree_table_t::add_row(size_t parent, std::span<const std::string_view> cells, bool load_later)
     {
-        answers.clear();
+        size_t node = nodes.size();
 
-        for(auto& question : questions)
+        nodes.push_back({ parent });
+        nodes[node].depth = nodes[parent].depth + 1;
+        nodes[node].load_later = load_later;
+
+        for (size_t i = 0; i < columns; i++)
         {
-            answers.push_back(question->run());
+            text.append(i < cells.size() ? cells[i] : std::string_view());
+            cell_ends.push_back(text.size());
         }
-    }
 
-    // tables
+        cell_widths.resize(cell_widths.size() + columns);
+        summaries.resize(summaries.size() + columns);
 
-    extern const borders_t modern_borders =
+        if (nodes[parent].last_child == npos)
         {
-            L"┌", L"┐", L"└", L"┘", L"─", L"│", L"┬", L"┴", L"├", L"┤", L"┼", L" ", L" "};
-
-    extern const borders_t rounded_borders =
+            nodes[parent].first_child = node;
+        }
+        else
         {
-            L"╭", L"╮", L"╰", L"╯", L"─", L"│", L"┬", L"┴", L"├", L"┤", L"┼", L" ", L" "};
+            nodes[nodes[parent].last_child].next_sibling = node;
+        }
 
-    extern const borders_t ascii_borders =
+        nodes[parent].last_child = node;
+
+        // a row that goes under a collapsed one waits to be measured until it is shown
+        if (nodes[parent].expanded && shown(parent))
         {
-            L"+", L"+", L"+", L"+", L"-", L"|", L"+", L"+", L"+", L"+", L"+", L" ", L" "};
+            show(node);
+            resize_ancestors(node, 0);
+            cached_row = 0;
+            cached_node = root;
+        }
 
-    void table_t::set_data(const std::vector<column_t> &data)
+        return node;
+    }
+
+    void tree_table_t::set_loader(loader_t loader)
     {
-        columns.clear();
+        this->loader = std::move(loader);
+    }
 
-        for (auto &col : data)
+    void tree_table_t::expand(size_t node)
+    {
+        if (nodes[node].expanded)
         {
-            wcolumn_t wcol;
+            return;
+        }
 
-            for (auto &row : col)
+        // the children come in while the row is still collapsed, so they are not measured one by one
+        if (nodes[node].load_later)
+        {
+            nodes[node].load_later = false;
+
+            if (loader)
             {
-                wcol.push_back(str_to_wstr(row));
+                loader(*this, node);
             }
+        }
 
-            columns.push_back(wcol);
+        nodes[node].expanded = true;
+
+        if (shown(node))
+        {
+            size_t old_rows = nodes[node].shown_rows;
+
+            show(node);
+            resize_ancestors(node, old_rows);
+            cached_row = 0;
+            cached_node = root;
         }
     }
 
-    void table_t::set_data(const std::vector<wcolumn_t> &data)
+    void tree_table_t::collapse(size_t node)
     {
-        columns = data;
-    }
+        if (node == root || !nodes[node].expanded)
+        {
+            return;
+        }
 
-    table_t::table_t(int props)
-    : properties(props)
-    {
-    }
+        nodes[node].expanded = false;
 
-    table_t::table_t(int props, const borders_t &b)
-    : properties(props),
-      borders(&b)
-    {
-    }
+        if (shown(node))
+        {
+            size_t old_rows = nodes[node].shown_rows;
 
-    table_t::table_t(const std::vector<wcolumn_t> &data, int props)
-    : columns(data),
-      properties(props)
-    {
+            summarise(node);
+            resize_ancestors(node, old_rows);
+            cached_row = 0;
+            cached_node = root;
+        }
     }
 
-    table_t::table_t(const std::vector<wcolumn_t> &data, int props, const borders_t &b)
-    : columns(data),
-      properties(props),
-      borders(&b)
+    std::string_view tree_table_t::cell(size_t node, size_t column) const
     {
-    }
+        size_t i = node * columns + column;
+        size_t start = i == 0 ? 0 : cell_ends[i - 1];
 
-    table_t::table_t(const std::vector<wcolumn_t> &data)
-    : columns(data),
-      properties(TABLE_BORDER_VERT | TABLE_HEADER_BORDER)
-    {
+        return std::string_view(text).substr(start, cell_ends[i] - start);
     }
 
-    table_t::table_t(const std::vector<column_t> &data, int props)
-    : properties(props)
+    // true while every row above the node is expanded
+    bool tree_table_t::shown(size_t node) const
     {
-        set_data(data);
+        for (size_t up = nodes[node].parent; up != npos; up = nodes[up].parent)
+        {
+            if (!nodes[up].expanded)
+            {
+                return false;
+            }
+        }
+
+        return true;
     }
 
-    table_t::table_t(const std::vector<column_t> &data, int props, const borders_t &b)
-    : properties(props),
-      borders(&b)
+    // the node on the row after the one node is shown on, npos after the last row
+    size_t tree_table_t::next_shown(size_t node) const
     {
-        set_data(data);
+        if (nodes[node].expanded && nodes[node].first_child != npos)
+        {
+            return nodes[node].first_child;
+        }
+
+        for (; node != root; node = nodes[node].parent)
+        {
+            if (nodes[node].next_sibling != npos)
+            {
+                return nodes[node].next_sibling;
+            }
+        }
+
+        return npos;
     }
 
-    table_t::table_t(const std::vector<column_t> &data)
-    : properties(TABLE_BORDER_VERT | TABLE_HEADER_BORDER)
+    // Measures what a node is about to show that has not been measured yet
+    // and works out its rows and widths from those of its children, going
+    // down only into the rows that are expanded.
+    void tree_table_t::show(size_t node)
     {
-        set_data(data);
+        if (!nodes[node].measured)
+        {
+            for (size_t x = 0; x < columns; x++)
+            {
+                // the first column of a row has its indent and marker in front, two columns per level
+                cell_widths[node * columns + x] = display_width(cell(node, x)) + (x == 0 ? nodes[node].depth * 2 : 0);
+            }
+
+            nodes[node].measured = true;
+        }
+
+        if (nodes[node].expanded)
+        {
+            for (size_t child = nodes[node].first_child; child != npos; child = nodes[child].next_sibling)
+            {
+                show(child);
+            }
+        }
+
+        summarise(node);
     }
 
-    int table_t::get_largest_row_len(int row_index) const
+    // works out a node's rows and widths from its own cells and its children's summaries
+    void tree_table_t::summarise(size_t node)
     {
-        size_t largest_len = 0;
+        uint32_t *summary = &summaries[node * columns];
 
-        if (row_index < 0)
+        std::copy_n(&cell_widths[node * columns], columns, summary);
+        nodes[node].shown_rows = 1;
+
+        if (!nodes[node].expanded)
         {
-            return -1;
+            return;
         }
 
-        for (const auto &col : columns)
+        for (size_t child = nodes[node].first_child; child != npos; child = nodes[child].next_sibling)
         {
-            if (row_index >= col.size())
+            const uint32_t *child_summary = &summaries[child * columns];
+
+            for (size_t x = 0; x < columns; x++)
             {
-                return -1;
+                summary[x] = std::max(summary[x], child_summary[x]);
             }
 
-            // it may seem like it is simple as getting row.size() but,
-            // we have the problem of newline characters, escape codes and varying width emojis.
-            auto &row = col[row_index];
-            size_t len = 0;
-            size_t line_count = std::count(row.begin(), row.end(), L'\n') + 1;
-            auto it = row.begin();
+            nodes[node].shown_rows += nodes[child].shown_rows;
+        }
+    }
+
+    // Passes a change in what a shown node shows up to the root. When it
+    // grew, the rows above only need to take in its widths; when it shrank,
+    // they are summarised again from their children.
+    void tree_table_t::resize_ancestors(size_t node, size_t old_rows)
+    {
+        size_t new_rows = nodes[node].shown_rows;
+        const uint32_t *summary = &summaries[node * columns];
 
-            for (int i = 0; i < line_count; i++)
+        for (size_t up = nodes[node].parent; up != npos; up = nodes[up].parent)
+        {
+            if (new_rows >= old_rows)
             {
-                size_t line_len = 0;
+                uint32_t *up_summary = &summaries[up * columns];
 
-                for (; it != row.end(); it++)
+                for (size_t x = 0; x < columns; x++)
                 {
-                    if (*it == L'\n')
-                    {
-                        it++;
-
-                        break;
-                    }
-                    else if (*it == L'\u001B')
-                    {
-                        it++;
+                    up_summary[x] = std::max(up_summary[x], summary[x]);
+                }
 
-                        if (*it == L'[')
-                        {
-                            it++;
+                nodes[up].shown_rows += new_rows - old_rows;
+            }
+            else
+            {
+                summarise(up);
+            }
+        }
+    }
 
-                            while (it != row.end() && *it != 'm')
-                            {
-                                it++;
-                            }
+    size_t tree_table_t::node_at(size_t row) const
+    {
+        if (row >= row_count())
+        {
+            return npos;
+        }
 
-                            continue;
-                        }
-                    }
+        if (row == cached_row + 1)
+        {
+            cached_node = next_shown(cached_node);
+            cached_row = row;
+        }
+        else if (row != cached_row)
+        {
+            size_t node = root;
 
-                    line_len += std::max(0, get_wchar_width(*it));
-                }
+            // go down through the children, skipping the ones whose rows all come before
+            for (size_t skip = row; skip > 0;)
+            {
+                skip--;
+                node = nodes[node].first_child;
 
-                if(line_len > len)
+                while (skip >= nodes[node].shown_rows)
                 {
-                    len = line_len;
+                    skip -= nodes[node].shown_rows;
+                    node = nodes[node].next_sibling;
                 }
             }
 
-            if (len > largest_len)
-            {
-                largest_len = len;
-            }
+            cached_node = node;
+            cached_row = row;
         }
 
-        return largest_len;
+        return cached_node;
     }
 
-    std::wstring table_t::get_at_index(int row_index, int col_index) const
+    size_t tree_table_t::row_of(size_t node) const
     {
-        if (col_index < 0 && col_index >= columns.size())
+        if (!shown(node))
         {
-            return L"";
+            return npos;
         }
 
-        if (row_index < 0 && row_index >= columns[col_index].size())
+        size_t row = 0;
+
+        for (; node != root; node = nodes[node].parent)
         {
-            return L"";
-        }
+            row++;
 
-        auto &col = columns[col_index];
-        auto &row = col[row_index];
+            for (size_t sibling = nodes[nodes[node].parent].first_child; sibling != node; sibling = nodes[sibling].next_sibling)
+            {
+                row += nodes[sibling].shown_rows;
+            }
+        }
 
         return row;
     }
 
-    void table_t::append_column(wcolumn_t col)
+    size_t tree_table_t::cell_width(size_t row, size_t column) const
     {
-        columns.push_back(col);
+        return cell_widths[node_at(row) * columns + column];
     }
 
-    void table_t::append_column(column_t col)
+    void tree_table_t::write_cell(size_t row, size_t column, std::string &out) const
     {
-        wcolumn_t wcol;
+        size_t node = node_at(row);
 
-        for (auto &row : col)
+        if (column != 0 || node == root)
         {
-            wcol.push_back(str_to_wstr(row));
+            out.append(cell(node, column));
+
+            return;
         }
 
-        columns.push_back(wcol);
+        bool ascii = borders == &ascii_borders;
+
+        out.append((nodes[node].depth - 1) * 2, ' ');
+
+        if (!expandable(node))
+        {
+            out.append("  ");
+        }
+        else if (nodes[node].expanded)
+        {
+            out.append(ascii ? "- " : "▾ ");
+        }
+        else
+        {
+            out.append(ascii ? "+ " : "▸ ");
+        }
+
+        if (node == selected)
+        {
+            out.append(STYLE4).append(cell(node, column)).append(STYLE_CLEAR);
+        }
+        else
+        {
+            out.append(cell(node, column));
+        }
     }
 
-    std::wstring table_t::to_wstring() const
+    size_t tree_table_t::browse(size_t height)
     {
-        std::wstringstream ss;
-        auto multiply_str = [&](const std::wstring &str, int times) mutable
+        // the header and the rules around it and below the rows take up four
+        // lines, and the terminal cursor waits on the line after the frame
+        height = height > 0 ? height : std::max<size_t>(terminal_rows(), 8) - 5;
+
+        size_t cursor = 1;
+        size_t top = 1;
+        size_t result = npos;
+        size_t drawn_lines = 0;
+        bool done = false;
+        std::string frame;
+
+        auto draw = [&]()
         {
-            for (int i = 0; i < times; i++)
+            size_t rows = row_count() - 1;
+
+            // keep the cursor in view without leaving rows at the bottom empty
+            cursor = std::min(cursor, rows);
+            top = std::min(top, rows + 1 > height ? rows + 1 - height : 1);
+            top = std::clamp<size_t>(top, cursor + 1 > height ? cursor + 1 - height : 1, std::max<size_t>(cursor, 1));
+            selected = cursor > 0 && !done ? node_at(cursor) : npos;
+            frame.clear();
+
+            // go back over the previous frame, then draw the new one in its place
+            if (drawn_lines > 0)
             {
-                ss << str;
+                frame.append("\x1b[").append(std::to_string(drawn_lines)).append("A\r\x1b[J");
             }
+
+            size_t start = frame.size();
+
+            render([&](std::string_view piece) { frame.append(piece); }, top - 1, height);
+
+            drawn_lines = wrapped_lines(std::string_view(frame).substr(start), terminal_columns());
+            std::cout << frame;
         };
 
-        for (int x = 0; x < columns.size(); x++)
+        draw();
+
+        on_key([&](const key_event_t &event)
         {
-            auto &col = columns[x];
+            size_t rows = row_count() - 1;
+            size_t node = cursor > 0 ? node_at(cursor) : npos;
 
-            if (x == 0)
+            switch (event.key)
             {
-                ss << borders->top_left;
-
-                for (int y = 0; y < col.size(); y++)
+            case KEY_UP:
+                cursor = std::max<size_t>(cursor, 2) - 1;
+                break;
+            case KEY_DOWN:
+                cursor = std::min(cursor + 1, rows);
+                break;
+            case KEY_PAGE_UP:
+                cursor = std::max(cursor, height + 1) - height;
+                break;
+            case KEY_PAGE_DOWN:
+                cursor = std::min(cursor + height, rows);
+                break;
+            case KEY_HOME:
+                cursor = 1;
+                break;
+            case KEY_END:
+                cursor = rows;
+                break;
+            case KEY_RIGHT:
+                if (node != npos && expandable(node) && !nodes[node].expanded)
+                {
+                    expand(node);
+                }
+                else if (node != npos && nodes[node].first_child != npos)
+                {
+                    cursor++;
+                }
+                break;
+            case KEY_LEFT:
+                if (node != npos && nodes[node].expanded)
+                {
+                    collapse(node);
+                }
+                else if (node != npos && nodes[node].parent != root)
+                {
+                    cursor = row_of(nodes[node].parent);
+                }
+                break;
+            case KEY_TEXT:
+                if (event.text == " " && node != npos && expandable(node))
                 {
-                    int len = get_largest_row_len(y);
+                    nodes[node].expanded ? collapse(node) : expand(node);
+                }
+                else if (event.text == "q")
+                {
+                    return false;
+                }
+                break;
+            case KEY_ENTER:
+                result = node;
+                return false;
+            case KEY_ESCAPE:
+            case KEY_EOF:
+                return false;
+            default:
+                break;
+            }
 
-                    if (properties & TABLE_BORDER_VERT)
-                    {
-                        len += borders->padding_left.size() + borders->vertical_bar.size();
-                    }
-                    else
-                    {
-                        len += borders->padding_left.size() + borders->padding_right.size();
-                    }
+            return true;
+        },
+        draw);
 
-                    multiply_str(borders->horizontal_bar, len);
+        // the last frame stays on the terminal, without the selection
+        done = true;
+        draw();
+        std::cout.flush();
 
-                    if (y != col.size() - 1 && properties & TABLE_BORDER_VERT)
-                    {
-                        ss << borders->top_intersection;
-                    }
-                }
+        return result;
+    }
 
-                ss << borders->top_right << "\n";
-            }
+    // progress
 
-            int total_lines = 0;
+    static const char *const spinner_frames[] = { "⠋", "⠙", "⠹", "⠸", "⠼", "⠴", "⠦", "⠧", "⠇", "⠏" };
 
-            for (int y = 0; y < col.size(); y++)
-            {
-                int line_count = std::count(col[y].begin(), col[y].end(), L'\n') + 1;
+    // the bar shrinks within these to leave room for the label and the counts
+    #define PROGRESS_BAR_MIN_WIDTH 10
+    #define PROGRESS_BAR_MAX_WIDTH 40
 
-                if (line_count > total_lines)
-                {
-                    total_lines = line_count;
-                }
-            }
+    progress_t::progress_t(int max_fps, sink_t sink)
+    : frame_interval(1000000 / std::max(max_fps, 1)),
+      sink(sink ? std::move(sink) : [](std::string_view piece) { std::cout << piece << std::flush; })
+    {
+        thread = std::thread([this]() { render_loop(); });
+    }
 
-            for (int i = 0; i < total_lines; i++)
-            {
-                ss << borders->vertical_bar;
+    progress_t::~progress_t()
+    {
+        stop();
+    }
 
-                for (int y = 0; y < col.size(); y++)
-                {
-                    int row_size = get_largest_row_len(y);
+    progress_bar_t &progress_t::add_bar(std::string label, uint64_t total)
+    {
+        auto bar = std::make_unique<progress_bar_t>(std::move(label), total);
+        progress_bar_t &added = *bar;
+        std::lock_guard lock(mutex);
 
-                    if (y != 0 && properties & TABLE_BORDER_VERT)
-                    {
-                        ss << borders->vertical_bar;
-                    }
+        widgets.emplace_back(std::move(bar));
 
-                    ss << borders->padding_left;
+        return added;
+    }
 
-                    int current_row_size = 0;
-                    int newline_index = 0;
+    spinner_t &progress_t::add_spinner(std::string label)
+    {
+        auto spinner = std::make_unique<spinner_t>(std::move(label));
+        spinner_t &added = *spinner;
+        std::lock_guard lock(mutex);
 
-                    for (auto it = col[y].begin(); it != col[y].end(); it++)
-                    {
-                        const auto &c = *it;
+        widgets.emplace_back(std::move(spinner));
 
-                        if (total_lines != 1)
-                        {
-                            if (*it == L'\n')
-                            {
-                                newline_index++;
-
-                                continue;
-                            }
-                            else if (newline_index != i)
-                            {
-                                continue;
-                            }
-                        }
+        return added;
+    }
 
-                        if (c == L'\n')
-                        {
-                            break;
-                        }
-                        else if (c == L'\u001B')
-                        {
-                            ss << c;
-                            it++;
+    void progress_t::stop()
+    {
+        {
+            std::lock_guard lock(mutex);
 
-                            if (*it == L'[')
-                            {
-                                ss << *(it++);
+            stopping = true;
+        }
 
-                                while (it != col[y].end() && *it != 'm')
-                                {
-                                    ss << *it;
-                                    it++;
-                                }
+        wake.notify_one();
 
-                                ss << *it;
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
 
-                                continue;
-                            }
-                        }
+    void progress_t::render_loop()
+    {
+        std::unique_lock lock(mutex);
+        auto next_frame = std::chrono::steady_clock::now();
 
-                        current_row_size++;
+        while (true)
+        {
+            bool last = wake.wait_until(lock, next_frame, [&]() { return stopping; });
 
-                        row_size -= std::max(0, get_wchar_width(c) - 1); /* in case theres a double width character */
+            // the lines are built while the widgets cannot change, the terminal is written without holding anyone up
+            build_lines(terminal_columns());
+            lock.unlock();
+            draw();
+            lock.lock();
 
-                        ss << c;
-                    }
+            if (last)
+            {
+                break;
+            }
 
-                    int spacing = std::max(0, row_size - current_row_size);
+            next_frame = std::max(next_frame + frame_interval, std::chrono::steady_clock::now());
+        }
+    }
 
-                    ss << std::wstring(spacing, ' ') << borders->padding_right;
-                }
+    // called with the lock held
+    void progress_t::build_lines(size_t columns)
+    {
+        const char *spinner = spinner_frames[spinner_frame++ % std::size(spinner_frames)];
 
-                ss << borders->vertical_bar << "\n";
-            }
+        lines.clear();
 
-            if (x == columns.size() - 1)
+        for (auto &widget : widgets)
+        {
+            if (auto *bar = std::get_if<std::unique_ptr<progress_bar_t>>(&widget))
             {
-                ss << borders->bottom_left;
+                uint64_t total = (*bar)->total;
+                uint64_t done = std::min((*bar)->value(), total);
+                bool finished = (*bar)->finished.load(std::memory_order_relaxed) || done == total;
+                uint64_t percent = total ? done * 100 / total : 100;
 
-                for (int y = 0; y < col.size(); y++)
+                char counts[64];
+                int counts_len = snprintf(counts, sizeof(counts), " %3d%% %llu/%llu", (int)percent, (unsigned long long)done, (unsigned long long)total);
+
+                size_t used = 2 + display_width((*bar)->label) + 1 + counts_len;
+                size_t width = std::clamp<size_t>(columns > used ? columns - used - 1 : 0, PROGRESS_BAR_MIN_WIDTH, PROGRESS_BAR_MAX_WIDTH);
+                size_t filled = total ? done * width / total : width;
+
+                if (finished)
                 {
-                    int len = get_largest_row_len(y);
+                    lines.append(STYLE1 "✓ ");
+                }
+                else
+                {
+                    lines.append(STYLE4).append(spinner).append(" ");
+                }
 
-                    if (properties & TABLE_BORDER_VERT)
-                    {
-                        len += borders->padding_left.size() + borders->vertical_bar.size();
-                    }
-                    else
-                    {
-                        len += borders->padding_left.size() + borders->padding_right.size();
-                    }
+                lines.append(STYLE2).append((*bar)->label).append(" " STYLE4);
 
-                    multiply_str(borders->horizontal_bar, len);
+                for (size_t i = 0; i < filled; i++)
+                {
+                    lines.append("█");
+                }
 
-                    if (y != col.size() - 1 && properties & TABLE_BORDER_VERT)
-                    {
-                        ss << borders->bottom_intersection;
-                    }
+                lines.append(STYLE5);
+
+                for (size_t i = filled; i < width; i++)
+                {
+                    lines.append("░");
                 }
 
-                ss << borders->bottom_right << "\n";
+                lines.append(STYLE3).append(counts, counts_len).append(STYLE_CLEAR "\n");
             }
-            else if ((properties & TABLE_BORDER_HORIZ) || (properties & TABLE_HEADER_BORDER) || (properties & TABLE_FOOTER_BORDER))
+            else
             {
-                if (!(properties & TABLE_BORDER_HORIZ))
-                {
-                    bool is_header = (properties & TABLE_HEADER_BORDER) && x == 0;
-                    bool is_footer = (properties & TABLE_FOOTER_BORDER) && x == (columns.size() - 2);
+                auto &spin = std::get<std::unique_ptr<spinner_t>>(widget);
+                bool finished = spin->finished.load(std::memory_order_relaxed);
+                uint64_t ticks = spin->value();
 
-                    if(!is_header && !is_footer)
-                    {
-                        continue;
-                    }
+                if (finished)
+                {
+                    lines.append(STYLE1 "✓ ");
                 }
-
-                ss << borders->left_intersection;
-
-                for (int y = 0; y < col.size(); y++)
+                else
                 {
-                    int len = get_largest_row_len(y);
-
-                    if (properties & TABLE_BORDER_VERT)
-                    {
-                        len += borders->padding_left.size() + borders->vertical_bar.size();
-                    }
-                    else
-                    {
-                        len += borders->padding_left.size() + borders->padding_right.size();
-                    }
+                    lines.append(STYLE4).append(spinner).append(" ");
+                }
 
-                    multiply_str(borders->horizontal_bar, len);
+                lines.append(STYLE2).append(spin->label);
 
-                    if (y != col.size() - 1 && properties & TABLE_BORDER_VERT)
-                    {
-                        ss << borders->intersection;
-                    }
+                if (ticks > 0)
+                {
+                    lines.append(STYLE3 " ").append(std::to_string(ticks));
                 }
 
-                ss << borders->right_intersection << "\n";
+                lines.append(STYLE_CLEAR "\n");
             }
         }
-
-        return ss.str();
     }
 
-    std::string table_t::to_string() const
+    void progress_t::draw()
     {
-        return wstr_to_str(to_wstring());
-    }
+        // nothing changed since the last frame
+        if (lines == previous_lines)
+        {
+            return;
+        }
 
-    void table_t::run() const
-    {
-        std::cout << to_string() << std::endl;
+        frame.clear();
+
+        if (drawn_lines > 0)
+        {
+            frame.append("\x1b[").append(std::to_string(drawn_lines)).append("A\r\x1b[J");
+        }
+
+        // the lines set every style in full, the writer cuts that down to what changes
+        style_writer_t writer;
+
+        writer.write(lines, frame);
+        writer.finish(frame);
+        sink(frame);
+
+        // a label too long for the terminal wraps onto more lines, which the next frame has to go back over too
+        drawn_lines = wrapped_lines(lines, terminal_columns());
+
+        std::swap(lines, previous_lines);
+        frame_count.fetch_add(1, std::memory_order_relaxed);
     }
 }
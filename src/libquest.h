@@ -1,11 +1,110 @@
 #pragma once
 
 #include <initializer_list>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <ranges>
+#include <regex>
+#include <type_traits>
+#include <variant>
 #include <vector>
+#include <tuple>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
 
 namespace libquest
 {
+    // Keys
+
+    enum key_code
+    {
+        KEY_NONE,
+        KEY_TEXT, // a run of printable characters, see key_event_t::text
+        KEY_CHAR, // a single control or alt modified character, see key_event_t::ch
+        KEY_ENTER,
+        KEY_TAB,
+        KEY_BACKSPACE,
+        KEY_ESCAPE,
+        KEY_UP,
+        KEY_DOWN,
+        KEY_RIGHT,
+        KEY_LEFT,
+        KEY_HOME,
+        KEY_END,
+        KEY_INSERT,
+        KEY_DELETE,
+        KEY_PAGE_UP,
+        KEY_PAGE_DOWN,
+        KEY_F1,
+        KEY_F2,
+        KEY_F3,
+        KEY_F4,
+        KEY_F5,
+        KEY_F6,
+        KEY_F7,
+        KEY_F8,
+        KEY_F9,
+        KEY_F10,
+        KEY_F11,
+        KEY_F12,
+        KEY_PASTE_BEGIN,
+        KEY_PASTE_END,
+        KEY_EOF
+    };
+
+    enum
+    {
+        KEY_MOD_SHIFT = 0b1,
+        KEY_MOD_ALT = 0b10,
+        KEY_MOD_CTRL = 0b100,
+    };
+
+    struct key_event_t
+    {
+        key_code key = KEY_NONE;
+        int modifiers = 0;
+        int ch = 0;
+
+        // only valid for the duration of the callback
+        std::string_view text;
+    };
+
+    using key_handler_t = std::function<bool(const key_event_t&)>;
+
+    // Turns raw terminal input into key events. Printable input is delivered
+    // as whole runs of text rather than one event per byte, and any escape
+    // sequence that is cut off at the end of the data is left unconsumed so
+    // that it can be completed by the next read.
+    class key_decoder_t
+    {
+    public:
+        // Decodes events from data until the handler returns false or the data
+        // runs out. Returns the number of bytes consumed. When final is set the
+        // data is treated as complete, so a trailing lone ESC becomes KEY_ESCAPE.
+        //
+        // Between KEY_PASTE_BEGIN and KEY_PASTE_END (bracketed paste) everything,
+        // including newlines and control characters, is delivered as KEY_TEXT.
+        size_t decode(const char *data, size_t len, bool final, const key_handler_t &handler, bool &stopped);
+
+    private:
+        bool in_paste = false;
+
+        size_t decode_escape(const char *data, size_t len, bool final, key_event_t &event) const;
+        size_t decode_paste(const char *data, size_t len, bool final, key_event_t &event);
+    };
+
     enum question_type
     {
         QUESTION_BASE_CLASS,
@@ -15,6 +114,309 @@ namespace libquest
         QUESTION_SELECTION
     };
 
+    struct selection_t
+    {
+        int index = -1;
+
+        // refers to the option stored in the select_t that produced it
+        std::string_view text;
+    };
+
+    // yes/no questions answer with a bool, selections with a selection_t and
+    // everything else with a std::string
+    using answer_t = std::variant<std::monostate, std::string, bool, selection_t>;
+
+    std::string to_string(const answer_t &answer);
+
+    // Validation
+
+    class validator_t
+    {
+    public:
+        virtual ~validator_t()
+        {
+        }
+
+        // Called after every edit. Everything in value before changed_from is
+        // unchanged since the previous call, so validators can keep per-prefix
+        // state and only redo the work for the part that changed. Returns false
+        // and sets error when the value is not acceptable.
+        virtual bool check(std::string_view value, size_t changed_from, std::string &error) = 0;
+    };
+
+    using validators_t = std::vector<std::shared_ptr<validator_t>>;
+
+    class required_t : public validator_t
+    {
+    public:
+        bool check(std::string_view value, size_t changed_from, std::string &error) override;
+    };
+
+    // limits the number of characters, not bytes
+    class length_t : public validator_t
+    {
+    public:
+        size_t min;
+        size_t max;
+
+        length_t(size_t min_len, size_t max_len)
+            : min(min_len),
+              max(max_len)
+        {
+        }
+
+        bool check(std::string_view value, size_t changed_from, std::string &error) override;
+    };
+
+    class number_range_t : public validator_t
+    {
+    public:
+        double min;
+        double max;
+
+        number_range_t(double min_val, double max_val)
+            : min(min_val),
+              max(max_val)
+        {
+        }
+
+        bool check(std::string_view value, size_t changed_from, std::string &error) override;
+
+    private:
+        // The digits are kept as an integer and divided by a power of ten once
+        // at the end, so a decimal such as 0.3 comes out as the double closest to it.
+        struct parse_state_t
+        {
+            uint64_t mantissa = 0;
+
+            // digits after the point in the mantissa, and digits before it that did not fit
+            int decimals = 0;
+            int dropped = 0;
+            bool point = false;
+            bool negative = false;
+            bool has_digits = false;
+            bool valid = true;
+        };
+
+        // parse_states[i] is the state after reading the first i bytes
+        std::vector<parse_state_t> parse_states { parse_state_t() };
+    };
+
+    // the pattern has to match the whole value, it is compiled once on construction
+    class pattern_t : public validator_t
+    {
+    public:
+        std::string message;
+
+        pattern_t(const std::string &pattern, std::string msg = "does not match the expected format")
+            : message(msg),
+              regex(pattern, std::regex::optimize)
+        {
+        }
+
+        bool check(std::string_view value, size_t changed_from, std::string &error) override;
+
+    private:
+        std::regex regex;
+    };
+
+    // A prebuilt hash index over a set of strings. The entries are stored back
+    // to back in one buffer and looked up through an open addressing table, so
+    // a list with millions of entries costs a handful of allocations and one
+    // probe per lookup. It is immutable once built and can be shared between
+    // questions.
+    class allow_list_t
+    {
+    public:
+        allow_list_t(const std::vector<std::string> &entries);
+
+        size_t size() const
+        {
+            return offsets.size() - 1;
+        }
+
+        bool contains(std::string_view value) const;
+        bool contains(std::string_view value, uint64_t value_hash) const;
+
+        // FNV-1a, which can be extended one byte at a time
+        static constexpr uint64_t hash_seed = 0xcbf29ce484222325ull;
+
+        static uint64_t hash_byte(uint64_t hash, unsigned char c)
+        {
+            return (hash ^ c) * 0x100000001b3ull;
+        }
+
+    private:
+        std::string data;
+        std::vector<uint32_t> offsets;
+        std::vector<uint64_t> slot_hashes;
+        std::vector<uint32_t> slots; // entry index + 1, 0 when empty
+    };
+
+    class one_of_t : public validator_t
+    {
+    public:
+        std::shared_ptr<const allow_list_t> list;
+
+        one_of_t(std::shared_ptr<const allow_list_t> allowed)
+            : list(allowed)
+        {
+        }
+
+        bool check(std::string_view value, size_t changed_from, std::string &error) override;
+
+    private:
+        // prefix_hashes[i] is the hash of the first i bytes
+        std::vector<uint64_t> prefix_hashes { allow_list_t::hash_seed };
+    };
+
+    // Autocompletion
+
+    // A sorted, deduplicated set of strings searched by prefix. The entries are
+    // stored back to back in one buffer with a table of offsets into it, which
+    // is also the layout written by save(), so a prebuilt index can be mapped
+    // with load() and used without parsing. It is immutable once built and can
+    // be shared between questions.
+    class completion_index_t
+    {
+    public:
+        struct range_t
+        {
+            size_t begin = 0;
+            size_t end = 0;
+
+            size_t size() const
+            {
+                return end - begin;
+            }
+        };
+
+        completion_index_t(std::vector<std::string> entries);
+        completion_index_t(const completion_index_t &) = delete;
+        completion_index_t &operator=(const completion_index_t &) = delete;
+        ~completion_index_t();
+
+        // maps an index written by save(), returns nullptr if the file is not one
+        static std::shared_ptr<const completion_index_t> load(const std::string &path);
+        bool save(const std::string &path) const;
+
+        size_t size() const
+        {
+            return count;
+        }
+
+        std::string_view at(size_t index) const
+        {
+            return std::string_view(data + offsets[index], offsets[index + 1] - offsets[index]);
+        }
+
+        range_t all() const
+        {
+            return { 0, count };
+        }
+
+        // Every entry in range shares the same first depth bytes. Returns the
+        // part of range whose next byte is c, searching only inside range.
+        range_t narrow(range_t range, size_t depth, char c) const;
+        range_t find(std::string_view prefix) const;
+
+        // the longest prefix shared by every entry in range
+        std::string_view common_prefix(range_t range) const;
+
+    private:
+        std::vector<char> owned_data;
+        std::vector<uint64_t> owned_offsets;
+
+        const char *data = nullptr;
+        const uint64_t *offsets = nullptr;
+        size_t count = 0;
+
+        void *mapping = nullptr;
+        size_t mapping_size = 0;
+
+        completion_index_t()
+        {
+        }
+    };
+
+    // History
+
+    // Input history kept in a memory mapped file that several processes can
+    // share. The file holds a fixed size ring of records; appends take an
+    // exclusive flock, while readers go without locks and check afterwards
+    // that what they read had not been overwritten. Every block of the ring
+    // carries a trigram bloom filter of the records starting in it, which lets
+    // search() skip whole blocks that cannot match. Opening the file only maps
+    // it, so it costs the same whatever the size of the history.
+    class history_t
+    {
+    public:
+        // a position between two records, end() is just after the newest one
+        using cursor_t = uint64_t;
+
+        // creates the file with room for capacity bytes of records if it does not exist yet
+        static std::shared_ptr<history_t> open(const std::string &path, size_t capacity = 8 * 1024 * 1024);
+
+        history_t(const history_t &) = delete;
+        history_t &operator=(const history_t &) = delete;
+        ~history_t();
+
+        bool append(std::string_view key, std::string_view entry);
+
+        cursor_t end() const;
+
+        // Finds the newest entry for key that ends at or before cursor, and
+        // moves the cursor to the start of it. Returns false if there is none.
+        bool previous(std::string_view key, cursor_t &cursor, std::string &entry) const;
+
+        // like previous(), but only for entries that contain query
+        bool search(std::string_view key, std::string_view query, cursor_t &cursor, std::string &entry) const;
+
+    private:
+        struct file_header_t;
+        struct block_summary_t;
+
+        int fd = -1;
+        void *mapping = nullptr;
+        size_t mapping_size = 0;
+
+        file_header_t *header = nullptr;
+        block_summary_t *summaries = nullptr;
+        char *ring = nullptr;
+        uint64_t capacity = 0;
+        uint64_t block_count = 0;
+
+        history_t()
+        {
+        }
+
+        uint32_t read_u32(uint64_t pos) const;
+        void read(uint64_t pos, void *out, size_t len) const;
+        void write(uint64_t pos, const void *in, size_t len);
+    };
+
+    // How ask_multiline takes its text. Append mode reads lines until two blank
+    // ones. The editor opens the default as the text to edit, can move anywhere
+    // in it and is finished with Ctrl-D.
+    enum multiline_mode
+    {
+        MULTILINE_APPEND,
+        MULTILINE_EDITOR
+    };
+
+    // The prompts behind every question type. Both the question classes and the
+    // static questions below render through these.
+    std::string ask_input(std::string_view question, std::string_view default_option = {}, const validators_t &validators = {}, const completion_index_t *completions = nullptr, history_t *history = nullptr);
+    std::string ask_multiline(std::string_view question, std::string_view default_option = {}, multiline_mode mode = MULTILINE_APPEND);
+    bool ask_yesno(std::string_view question, bool default_option = false);
+    selection_t ask_select(std::string_view question, std::span<const std::string> options, int selected = 0);
+    selection_t ask_select(std::string_view question, std::span<const std::string_view> options, int selected = 0);
+
+    // Keys that arrive while a prompt is busy are all applied before it draws
+    // again, so a burst of them costs one frame. Above zero this also keeps the
+    // prompts from drawing more than fps frames a second, 0 lifts the limit.
+    void set_max_frame_rate(int fps);
+
     class question_t
     {
     protected:
@@ -29,6 +431,25 @@ namespace libquest
         {
         }
 
+        virtual ~question_t()
+        {
+        }
+
+        // The built-in questions override prompt(). A question that only
+        // overrides run() is asked through it, with its text as the answer.
+        virtual answer_t prompt()
+        {
+            return run();
+        }
+
+        // asks again, writing the answer over the previous one so that text
+        // answers can reuse the memory they already had
+        virtual void prompt_into(answer_t &answer)
+        {
+            answer = prompt();
+        }
+
+        // the answer as text, yes/no questions give "yes" or "no"
         virtual std::string run()
         {
             return std::string();
@@ -44,21 +465,31 @@ namespace libquest
     {
     public:
         std::vector<question_t*> questions;
-        std::vector<std::string> answers;
+
+        // kept between runs, each run writes over the answers of the one before
+        std::pmr::vector<answer_t> answers;
 
         questionaire_t()
         {
         }
 
-        questionaire_t(std::initializer_list<question_t*> l)
+        explicit questionaire_t(std::pmr::memory_resource *resource)
+        :
+        answers(resource)
+        {
+        }
+
+        questionaire_t(std::initializer_list<question_t*> l, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
         :
-        questions(l)
+        questions(l),
+        answers(resource)
         {
         }
 
-        questionaire_t(const std::vector<question_t*>& quests)
+        questionaire_t(const std::vector<question_t*>& quests, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
         :
-        questions(quests)
+        questions(quests),
+        answers(resource)
         {
         }
 
@@ -84,6 +515,28 @@ namespace libquest
     {
     public:
         std::string default_option;
+        validators_t validators;
+        std::shared_ptr<const completion_index_t> completions;
+
+        // recalled with up/down and searched with ctrl-r, entries are keyed by the question text
+        std::shared_ptr<history_t> history;
+
+        input_t(std::string question, std::string default_opt, validators_t v, std::shared_ptr<const completion_index_t> c)
+            : question_t(question),
+              default_option(default_opt),
+              validators(v),
+              completions(c)
+        {
+            _type = QUESTION_INPUT;
+        }
+
+        input_t(std::string question, std::string default_opt, validators_t v)
+            : question_t(question),
+              default_option(default_opt),
+              validators(v)
+        {
+            _type = QUESTION_INPUT;
+        }
 
         input_t(std::string question, std::string default_opt)
             : question_t(question),
@@ -98,13 +551,36 @@ namespace libquest
             _type = QUESTION_INPUT;
         }
 
-        std::string run() override;
+        using value_type = std::string;
+
+        std::string ask();
+
+        answer_t prompt() override
+        {
+            return ask();
+        }
+
+        void prompt_into(answer_t &answer) override;
+
+        std::string run() override
+        {
+            return to_string(prompt());
+        }
     };
 
     class multiline_t : public question_t
     {
     public:
         std::string default_option;
+        multiline_mode mode = MULTILINE_APPEND;
+
+        multiline_t(std::string question, std::string default_text, multiline_mode mode)
+            : question_t(question),
+              default_option(default_text),
+              mode(mode)
+        {
+            _type = QUESTION_MULTILINE;
+        }
 
         multiline_t(std::string question, std::string default_text)
             : question_t(question),
@@ -119,7 +595,21 @@ namespace libquest
             _type = QUESTION_MULTILINE;
         }
 
-        std::string run() override;
+        using value_type = std::string;
+
+        std::string ask();
+
+        answer_t prompt() override
+        {
+            return ask();
+        }
+
+        void prompt_into(answer_t &answer) override;
+
+        std::string run() override
+        {
+            return to_string(prompt());
+        }
     };
 
     class yesno_t : public question_t
@@ -141,7 +631,19 @@ namespace libquest
             _type = QUESTION_YESNO;
         }
 
-        std::string run() override;
+        using value_type = bool;
+
+        bool ask();
+
+        answer_t prompt() override
+        {
+            return ask();
+        }
+
+        std::string run() override
+        {
+            return to_string(prompt());
+        }
     };
 
     class select_t : public input_t
@@ -163,53 +665,443 @@ namespace libquest
             _type = QUESTION_SELECTION;
         }
 
-        std::string run() override;
-    };
+        using value_type = selection_t;
 
-    // Table
+        selection_t ask();
 
-    enum
-    {
-        TABLE_BORDER_HORIZ = 0b1,
-        TABLE_BORDER_VERT = 0b10,
-        TABLE_HEADER_BORDER = 0b100,
-        TABLE_FOOTER_BORDER = 0b1000,
-        TABLE_TRAILING_TEXT = 0b10000,
+        answer_t prompt() override
+        {
+            return ask();
+        }
+
+        void prompt_into(answer_t &answer) override
+        {
+            answer = ask();
+        }
     };
 
-    struct borders_t
+    // Binding answers to structs
+
+    // Stores the answer to a question straight into a member of a struct, e.g.
+    // bind<&user_t::name>(input_t { "What is your name?" })
+    template <auto Member, typename Question>
+    struct binding_t
     {
-        std::wstring top_left;
-        std::wstring top_right;
-        std::wstring bottom_left;
-        std::wstring bottom_right;
-        std::wstring horizontal_bar;
-        std::wstring vertical_bar;
-        std::wstring top_intersection;
-        std::wstring bottom_intersection;
-        std::wstring left_intersection;
-        std::wstring right_intersection;
-        std::wstring intersection;
+        Question question;
 
-        std::wstring padding_left;
-        std::wstring padding_right;
+        template <typename T>
+        void ask_into(T &out)
+        {
+            assign_answer(out.*Member, question.ask());
+        }
+
+    private:
+        template <typename M, typename V>
+        static void assign_answer(M &member, V &&value)
+        {
+            using value_type = std::decay_t<V>;
+
+            if constexpr (std::is_same_v<M, value_type>)
+            {
+                member = std::forward<V>(value);
+            }
+            else if constexpr (std::is_same_v<value_type, selection_t> && (std::is_integral_v<M> || std::is_enum_v<M>))
+            {
+                member = static_cast<M>(value.index);
+            }
+            else if constexpr (std::is_same_v<value_type, selection_t> && std::is_constructible_v<M, std::string_view>)
+            {
+                member = M(value.text);
+            }
+            else
+            {
+                static_assert(std::is_same_v<M, value_type>, "the member type cannot hold this kind of answer");
+            }
+        }
     };
 
-    extern const borders_t modern_borders;
-    extern const borders_t rounded_borders;
-    extern const borders_t ascii_borders;
+    template <auto Member, typename Question>
+    binding_t<Member, Question> bind(Question question)
+    {
+        return { std::move(question) };
+    }
 
-    using wcolumn_t = std::vector<std::wstring>;
-    using column_t = std::vector<std::string>;
-    class table_t
+    // Asks a fixed set of bound questions and fills in a T with the answers
+    template <typename T, typename... Bindings>
+    class form_t
     {
     public:
-        std::vector<wcolumn_t> columns;
-        int properties;
-        const borders_t *borders = &modern_borders;
+        std::tuple<Bindings...> bindings;
 
-    private:
-        int get_largest_row_len(int row_index) const;
+        form_t(Bindings... b)
+            : bindings(std::move(b)...)
+        {
+        }
+
+        void run(T &out)
+        {
+            std::apply([&](auto &...binding)
+            {
+                (binding.ask_into(out), ...);
+            }, bindings);
+        }
+
+        T run()
+        {
+            T out {};
+
+            run(out);
+
+            return out;
+        }
+    };
+
+    template <typename T, typename... Bindings>
+    form_t<T, Bindings...> make_form(Bindings... bindings)
+    {
+        return form_t<T, Bindings...>(std::move(bindings)...);
+    }
+
+    // Static questions
+
+    // a string literal that can be passed as a template argument
+    template <size_t N>
+    struct fixed_string_t
+    {
+        char data[N] {};
+
+        constexpr fixed_string_t(const char (&str)[N])
+        {
+            std::copy_n(str, N, data);
+        }
+
+        constexpr std::string_view view() const
+        {
+            return std::string_view(data, N - 1);
+        }
+    };
+
+    template <fixed_string_t Question, fixed_string_t Default = "">
+    struct static_input_t
+    {
+        using value_type = std::string;
+
+        std::string ask() const
+        {
+            return ask_input(Question.view(), Default.view());
+        }
+    };
+
+    template <fixed_string_t Question, fixed_string_t Default = "", multiline_mode Mode = MULTILINE_APPEND>
+    struct static_multiline_t
+    {
+        using value_type = std::string;
+
+        std::string ask() const
+        {
+            return ask_multiline(Question.view(), Default.view(), Mode);
+        }
+    };
+
+    template <fixed_string_t Question, bool Default = false>
+    struct static_yesno_t
+    {
+        using value_type = bool;
+
+        bool ask() const
+        {
+            return ask_yesno(Question.view(), Default);
+        }
+    };
+
+    // the first option is selected initially
+    template <fixed_string_t Question, fixed_string_t... Options>
+    struct static_select_t
+    {
+        using value_type = selection_t;
+
+        static constexpr std::string_view options[] = { Options.view()... };
+
+        selection_t ask() const
+        {
+            return ask_select(Question.view(), std::span<const std::string_view>(options));
+        }
+    };
+
+    // A questionaire whose questions are known at compile time. The questions
+    // are stored by value and the answers come back as a tuple of their own
+    // types, e.g. static_questionaire_t<static_input_t<"Name?">, static_yesno_t<"Sure?">>
+    // gives a std::tuple<std::string, bool>.
+    template <typename... Questions>
+    class static_questionaire_t
+    {
+    public:
+        using answers_type = std::tuple<typename Questions::value_type...>;
+
+        std::tuple<Questions...> questions;
+
+        void run(answers_type &answers)
+        {
+            run(answers, std::index_sequence_for<Questions...>());
+        }
+
+        answers_type run()
+        {
+            answers_type answers;
+
+            run(answers);
+
+            return answers;
+        }
+
+    private:
+        template <size_t... I>
+        void run(answers_type &answers, std::index_sequence<I...>)
+        {
+            ((std::get<I>(answers) = std::get<I>(questions).ask()), ...);
+        }
+    };
+
+    // Memory
+
+    // Where the prompts and table renderers take their working memory from,
+    // such as the text being edited or a table being drawn. By default it is a
+    // pool that keeps what is given back to it, so asking the same questions
+    // or drawing the same table again does not go to the heap once the pool
+    // has grown to fit. Any std::pmr resource can stand in for it, nullptr
+    // brings the pool back. A resource that is not thread safe is only fit
+    // while no concurrent_table_t or progress_t is drawing.
+    std::pmr::memory_resource *working_memory();
+    void set_working_memory(std::pmr::memory_resource *resource);
+
+    // Text
+
+    // Number of terminal columns text takes up. Grapheme clusters such as a
+    // letter with combining marks, a flag or a ZWJ emoji sequence are measured
+    // as the single character they are drawn as, and colour escape codes take
+    // up nothing.
+    size_t display_width(std::string_view text);
+    size_t display_width(std::wstring_view text);
+
+    // Rewrites the SGR escape codes (ESC [ ... m) of text on its way to the
+    // terminal so that only the changes it needs are sent. It keeps track of
+    // the style the terminal is in and the style text asks for, and only
+    // brings the terminal up to date right before something is drawn, with
+    // the shortest code that gets it there. Codes that change nothing or are
+    // overridden before any text disappear, and runs of spaces only need the
+    // attributes that show on a blank cell to be right. Codes it does not know
+    // are passed through as they are. In strip mode no codes are written.
+    class style_writer_t
+    {
+    public:
+        style_writer_t(bool strip = false)
+            : strip(strip)
+        {
+        }
+
+        // text that sets its own style, starting from the one left by the previous write
+        void write(std::string_view text, std::string &out);
+        void write(std::wstring_view text, std::wstring &out);
+
+        // text in the default style, such as table borders, so that no style bleeds into it
+        void write_plain(std::string_view text, std::string &out);
+        void write_plain(std::wstring_view text, std::wstring &out);
+
+        // takes on the style the codes in text leave behind, without writing anything
+        void apply(std::string_view text);
+        void apply(std::wstring_view text);
+
+        // brings the terminal up to the current style now, for output that does not go through the writer
+        void flush(std::string &out);
+
+        // leaves the terminal in the default style
+        void finish(std::string &out);
+        void finish(std::wstring &out);
+
+        // for when something else may have styled the terminal, so the next change starts with a reset
+        void forget()
+        {
+            terminal.opaque = true;
+        }
+
+        // the same for text in memory from a std::pmr resource
+        void write(std::string_view text, std::pmr::string &out);
+        void write(std::wstring_view text, std::pmr::wstring &out);
+        void write_plain(std::string_view text, std::pmr::string &out);
+        void write_plain(std::wstring_view text, std::pmr::wstring &out);
+        void flush(std::pmr::string &out);
+        void finish(std::pmr::string &out);
+        void finish(std::pmr::wstring &out);
+
+        // true while neither the terminal nor the text is styled
+        bool plain() const
+        {
+            return terminal == style_t() && wanted == style_t();
+        }
+
+    private:
+        struct style_t
+        {
+            uint16_t attributes = 0; // bit n is set by SGR code n, for 1 to 9
+            uint32_t foreground = 0; // 0 is the default, otherwise the kind of colour in the top byte
+            uint32_t background = 0;
+            bool opaque = false; // codes were passed through that only a reset undoes
+
+            bool operator==(const style_t &) const = default;
+        };
+
+        style_t terminal;
+        style_t wanted;
+        bool strip;
+
+        template <typename CharT, typename String>
+        void write_text(std::basic_string_view<CharT> text, String *out);
+
+        template <typename String>
+        void sync(bool blank, String &out);
+
+        template <typename CharT>
+        static bool apply_codes(std::basic_string_view<CharT> params, style_t &style);
+    };
+
+    // Stats
+
+    // Latencies counted in power of two buckets of microseconds
+    struct latency_histogram_t
+    {
+        // bucket i holds latencies under 2^i microseconds, the last one anything slower
+        std::array<uint64_t, 32> buckets = {};
+        uint64_t count = 0;
+        std::chrono::microseconds total = {};
+        std::chrono::microseconds max = {};
+
+        void record(std::chrono::microseconds latency);
+
+        // upper bound of the bucket holding the given fraction of latencies, as in percentile(0.99)
+        std::chrono::microseconds percentile(double fraction) const;
+    };
+
+    // Where the time of table_t and cell_table_t renders goes. Bytes are the
+    // UTF-8 output of to_string(), run() and render().
+    struct table_stats_t
+    {
+        uint64_t renders = 0;
+        uint64_t cells = 0;
+        uint64_t bytes = 0;
+        std::chrono::nanoseconds layout = {};
+        std::chrono::nanoseconds width = {};
+        std::chrono::nanoseconds render = {};
+        std::chrono::nanoseconds transcode = {};
+    };
+
+    // A frame is one batch of input read by a prompt together with the redraw
+    // it caused, up to the point it is flushed to the terminal. The syscalls
+    // are the reads, polls and writes made for it.
+    struct prompt_stats_t
+    {
+        uint64_t prompts = 0;
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        uint64_t syscalls = 0;
+        uint64_t max_frame_bytes = 0;
+        uint64_t max_frame_syscalls = 0;
+
+        // from the input being read to its frame being flushed
+        latency_histogram_t latency;
+
+        double bytes_per_frame() const
+        {
+            return frames ? (double)bytes / frames : 0;
+        }
+
+        double syscalls_per_frame() const
+        {
+            return frames ? (double)syscalls / frames : 0;
+        }
+    };
+
+    struct stats_t
+    {
+        table_stats_t table;
+
+        // indexed by question_type
+        std::array<prompt_stats_t, QUESTION_SELECTION + 1> prompts;
+    };
+
+    using stats_hook_t = std::function<void(const stats_t&)>;
+
+    // Stats are only gathered when the library is built with LIBQUEST_STATS
+    // defined (make STATS=1). Otherwise none of the counting is compiled in,
+    // stats() stays zeroed and the hook is never called.
+    //
+    // Each thread keeps stats of its own: stats() and reset_stats() are those
+    // of the calling thread. The frames concurrent_table_t draws from its
+    // render thread are not counted anywhere that can be read.
+    bool stats_enabled();
+    const stats_t &stats();
+    void reset_stats();
+
+    // Called with the stats after every prompt and every table render, on
+    // the thread that ran it and never on the library's own render threads.
+    // Set it before any other thread draws.
+    void set_stats_hook(stats_hook_t hook);
+
+    // Table
+
+    enum
+    {
+        TABLE_BORDER_HORIZ = 0b1,
+        TABLE_BORDER_VERT = 0b10,
+        TABLE_HEADER_BORDER = 0b100,
+        TABLE_FOOTER_BORDER = 0b1000,
+        TABLE_TRAILING_TEXT = 0b10000,
+        TABLE_STRIP_STYLES = 0b100000, // drops the colour escape codes of cells
+    };
+
+    struct borders_t
+    {
+        std::wstring top_left;
+        std::wstring top_right;
+        std::wstring bottom_left;
+        std::wstring bottom_right;
+        std::wstring horizontal_bar;
+        std::wstring vertical_bar;
+        std::wstring top_intersection;
+        std::wstring bottom_intersection;
+        std::wstring left_intersection;
+        std::wstring right_intersection;
+        std::wstring intersection;
+
+        std::wstring padding_left;
+        std::wstring padding_right;
+    };
+
+    extern const borders_t modern_borders;
+    extern const borders_t rounded_borders;
+    extern const borders_t ascii_borders;
+
+    // Machine readable forms a table can be written out in, see table_t::export_to
+    enum export_format
+    {
+        EXPORT_CSV,
+        EXPORT_TSV,
+        EXPORT_JSONL,
+        EXPORT_MARKDOWN
+    };
+
+    using wcolumn_t = std::vector<std::wstring>;
+    using column_t = std::vector<std::string>;
+    class table_t
+    {
+    public:
+        std::vector<wcolumn_t> columns;
+        int properties;
+        const borders_t *borders = &modern_borders;
+
+    private:
+        int get_largest_row_len(int row_index) const;
+        void get_widths(std::pmr::vector<int> &widths) const;
+        void render(std::pmr::wstring &out) const;
         void set_data(const std::vector<column_t> &data);
         void set_data(const std::vector<wcolumn_t> &data);
 
@@ -233,6 +1125,1103 @@ namespace libquest
         std::wstring to_wstring() const;
         std::string to_string() const;
 
+        // draws the table over what out held, reusing its memory
+        void to_string(std::string &out) const;
+
+        // Writes the rows out as data rather than for display, with the colour
+        // codes of cells taken out and the first row as the header. CSV quotes
+        // cells the way RFC 4180 does. TSV writes tabs, line breaks and
+        // backslashes as \t, \n, \r and \\. JSONL writes an object per row
+        // keyed by the header. Markdown pads the cells to the widths to_string
+        // would use. Output goes to sink a piece at a time.
+        using sink_t = std::function<void(std::string_view)>;
+
+        void export_to(export_format format, const sink_t &sink) const;
+        std::string export_to(export_format format) const;
+
+        void run() const;
+    };
+
+    // Tables that hand out their cells on demand instead of storing strings.
+    // They render with the same borders and TABLE_* properties as table_t.
+    // Row 0 is the header.
+    class cell_table_t
+    {
+    public:
+        int properties;
+        const borders_t *borders;
+
+        cell_table_t(int props = TABLE_BORDER_VERT | TABLE_HEADER_BORDER, const borders_t &b = modern_borders)
+            : properties(props),
+              borders(&b)
+        {
+        }
+
+        virtual ~cell_table_t() = default;
+
+        virtual size_t row_count() const = 0;
+        virtual size_t column_count() const = 0;
+
+        // How many terminal columns a cell takes up, and its text. A cell with
+        // line breaks is drawn over several lines, as table_t does.
+        virtual size_t cell_width(size_t row, size_t column) const = 0;
+        virtual void write_cell(size_t row, size_t column, std::string &out) const = 0;
+
+        virtual bool right_aligned(size_t) const
+        {
+            return false;
+        }
+
+        // the widest cell in a column, which measures every one of them
+        virtual size_t column_width(size_t column) const;
+
+        // Renders the header and the rows [first_row, first_row + rows), not
+        // counting the header, handing the output to sink a piece at a time so
+        // the whole table never has to be held at once.
+        using sink_t = std::function<void(std::string_view)>;
+
+        void render(const sink_t &sink) const;
+        void render(const sink_t &sink, size_t first_row, size_t rows) const;
+
+        std::string to_string() const;
         void run() const;
     };
+
+    // How typed_table_t measures and writes a value. Numbers are measured by
+    // counting digits and written with std::to_chars straight into the output.
+    template <typename T, typename = void>
+    struct cell_format_t
+    {
+        static constexpr bool right_aligned = false;
+
+        static size_t width(const T &value, int)
+        {
+            return display_width(std::string_view(value));
+        }
+
+        static void write(const T &value, int, std::string &out)
+        {
+            out.append(std::string_view(value));
+        }
+    };
+
+    template <typename T>
+    struct cell_format_t<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+    {
+        static constexpr bool right_aligned = true;
+
+        static size_t width(T value, int)
+        {
+            std::make_unsigned_t<T> magnitude = value < 0 ? 0 - (std::make_unsigned_t<T>)value : value;
+            size_t digits = value < 0 ? 2 : 1;
+
+            while (magnitude >= 10)
+            {
+                magnitude /= 10;
+                digits++;
+            }
+
+            return digits;
+        }
+
+        static void write(T value, int, std::string &out)
+        {
+            char buffer[24];
+
+            out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+        }
+    };
+
+    // written with a fixed number of digits after the point
+    template <typename T>
+    struct cell_format_t<T, std::enable_if_t<std::is_floating_point_v<T>>>
+    {
+        static constexpr bool right_aligned = true;
+
+        static size_t width(T value, int precision)
+        {
+            size_t sign = std::signbit(value) ? 1 : 0;
+
+            if (!std::isfinite(value))
+            {
+                return sign + 3;
+            }
+
+            // rounding can carry into another digit, as in 9.999 becoming 10.00
+            T magnitude = std::fabs(value) + T(0.5) * std::pow(T(10), T(-precision));
+            size_t digits = 1;
+
+            while (magnitude >= 10)
+            {
+                magnitude /= 10;
+                digits++;
+            }
+
+            return sign + digits + (precision > 0 ? precision + 1 : 0);
+        }
+
+        static void write(T value, int precision, std::string &out)
+        {
+            char buffer[512];
+
+            out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, precision).ptr);
+        }
+    };
+
+    // the count followed by its unit, as in 250ms
+    template <typename Rep, typename Period>
+    struct cell_format_t<std::chrono::duration<Rep, Period>>
+    {
+        static constexpr bool right_aligned = true;
+
+        static constexpr std::string_view unit()
+        {
+            if constexpr (std::is_same_v<Period, std::nano>)
+            {
+                return "ns";
+            }
+            else if constexpr (std::is_same_v<Period, std::micro>)
+            {
+                return "us";
+            }
+            else if constexpr (std::is_same_v<Period, std::milli>)
+            {
+                return "ms";
+            }
+            else if constexpr (std::is_same_v<Period, std::ratio<1>>)
+            {
+                return "s";
+            }
+            else if constexpr (std::is_same_v<Period, std::ratio<60>>)
+            {
+                return "min";
+            }
+            else if constexpr (std::is_same_v<Period, std::ratio<3600>>)
+            {
+                return "h";
+            }
+            else
+            {
+                return "";
+            }
+        }
+
+        static size_t width(const std::chrono::duration<Rep, Period> &value, int precision)
+        {
+            return cell_format_t<Rep>::width(value.count(), precision) + unit().size();
+        }
+
+        static void write(const std::chrono::duration<Rep, Period> &value, int precision, std::string &out)
+        {
+            cell_format_t<Rep>::write(value.count(), precision, out);
+            out.append(unit());
+        }
+    };
+
+    // A table with a column type per column. Rows are stored column by column,
+    // and numbers are only formatted while the table is being rendered.
+    template <typename... Ts>
+    class typed_table_t : public cell_table_t
+    {
+    public:
+        static constexpr size_t columns = sizeof...(Ts);
+
+        std::array<std::string, columns> headers;
+
+        // digits after the point for floating point columns
+        int precision = 2;
+
+        typed_table_t(std::array<std::string, columns> headers, int props = TABLE_BORDER_VERT | TABLE_HEADER_BORDER, const borders_t &b = modern_borders)
+            : cell_table_t(props, b),
+              headers(std::move(headers))
+        {
+        }
+
+        void append_row(Ts... values)
+        {
+            append_row(std::index_sequence_for<Ts...>(), std::move(values)...);
+        }
+
+        void reserve(size_t rows)
+        {
+            std::apply([&](auto &...column) { (column.reserve(rows), ...); }, data);
+        }
+
+        // number of rows, not counting the header
+        size_t size() const
+        {
+            return std::get<0>(data).size();
+        }
+
+        template <size_t I>
+        const auto &column() const
+        {
+            return std::get<I>(data);
+        }
+
+        size_t row_count() const override
+        {
+            return size() + 1;
+        }
+
+        size_t column_count() const override
+        {
+            return columns;
+        }
+
+        size_t cell_width(size_t row, size_t column) const override
+        {
+            if (row == 0)
+            {
+                return display_width(headers[column]);
+            }
+
+            size_t width = 0;
+
+            visit(column, [&](const auto &values)
+            {
+                using format = cell_format_t<typename std::decay_t<decltype(values)>::value_type>;
+
+                width = format::width(values[row - 1], precision);
+            });
+
+            return width;
+        }
+
+        void write_cell(size_t row, size_t column, std::string &out) const override
+        {
+            if (row == 0)
+            {
+                out.append(headers[column]);
+
+                return;
+            }
+
+            visit(column, [&](const auto &values)
+            {
+                using format = cell_format_t<typename std::decay_t<decltype(values)>::value_type>;
+
+                format::write(values[row - 1], precision, out);
+            });
+        }
+
+        bool right_aligned(size_t column) const override
+        {
+            static constexpr bool aligned[] = { cell_format_t<Ts>::right_aligned... };
+
+            return aligned[column];
+        }
+
+    private:
+        std::tuple<std::vector<Ts>...> data;
+
+        template <size_t... I>
+        void append_row(std::index_sequence<I...>, Ts &&...values)
+        {
+            (std::get<I>(data).push_back(std::move(values)), ...);
+        }
+
+        // calls f with the vector holding a column picked at run time
+        template <typename F>
+        void visit(size_t column, F &&f) const
+        {
+            visit(column, f, std::index_sequence_for<Ts...>());
+        }
+
+        template <typename F, size_t... I>
+        void visit(size_t column, F &f, std::index_sequence<I...>) const
+        {
+            ((I == column ? (f(std::get<I>(data)), 0) : 0), ...);
+        }
+    };
+
+    // A table drawn straight from wherever its cells live. The writer is called
+    // for a cell whenever it is measured or rendered and nothing but the layout
+    // is kept, so printing it takes O(columns) extra memory. A width hint that
+    // returns the width of a column, or 0 when it does not know, saves
+    // measuring that column's cells first.
+    class table_view_t : public cell_table_t
+    {
+    public:
+        using cell_writer_t = std::function<void(size_t row, size_t column, std::string &out)>;
+        using width_hint_t = std::function<size_t(size_t column)>;
+
+        table_view_t(size_t rows, size_t columns, cell_writer_t writer, width_hint_t width_hint = nullptr,
+                     int props = TABLE_BORDER_VERT | TABLE_HEADER_BORDER, const borders_t &b = modern_borders);
+
+        size_t row_count() const override
+        {
+            return rows;
+        }
+
+        size_t column_count() const override
+        {
+            return columns;
+        }
+
+        size_t cell_width(size_t row, size_t column) const override;
+        void write_cell(size_t row, size_t column, std::string &out) const override;
+        size_t column_width(size_t column) const override;
+
+    private:
+        size_t rows;
+        size_t columns;
+        cell_writer_t writer;
+        width_hint_t width_hint;
+        mutable std::string scratch;
+    };
+
+    // A table over a range of tuples, such as a vector of tuples or a view
+    // transforming records into them, under a row of headers. Rows are read
+    // from the range while rendering and formatted like typed_table_t cells.
+    template <typename Range>
+    class range_table_t : public cell_table_t
+    {
+    public:
+        using row_type = std::remove_cvref_t<std::ranges::range_reference_t<Range>>;
+
+        static constexpr size_t columns = std::tuple_size_v<row_type>;
+
+        std::array<std::string, columns> headers;
+
+        // digits after the point for floating point columns
+        int precision = 2;
+
+        range_table_t(Range range, std::array<std::string, columns> headers, int props = TABLE_BORDER_VERT | TABLE_HEADER_BORDER, const borders_t &b = modern_borders)
+            : cell_table_t(props, b),
+              headers(std::move(headers)),
+              range(std::move(range)),
+              cursor(std::ranges::begin(this->range))
+        {
+        }
+
+        size_t row_count() const override
+        {
+            return std::ranges::distance(range) + 1;
+        }
+
+        size_t column_count() const override
+        {
+            return columns;
+        }
+
+        size_t cell_width(size_t row, size_t column) const override
+        {
+            if (row == 0)
+            {
+                return display_width(headers[column]);
+            }
+
+            size_t width = 0;
+
+            visit(row - 1, column, [&](const auto &value)
+            {
+                width = cell_format_t<std::remove_cvref_t<decltype(value)>>::width(value, precision);
+            });
+
+            return width;
+        }
+
+        void write_cell(size_t row, size_t column, std::string &out) const override
+        {
+            if (row == 0)
+            {
+                out.append(headers[column]);
+
+                return;
+            }
+
+            visit(row - 1, column, [&](const auto &value)
+            {
+                cell_format_t<std::remove_cvref_t<decltype(value)>>::write(value, precision, out);
+            });
+        }
+
+        bool right_aligned(size_t column) const override
+        {
+            return aligned(column, std::make_index_sequence<columns>());
+        }
+
+    private:
+        mutable Range range;
+
+        // rendering reads the rows in order, so the last position is kept
+        // and ranges without random access are still walked only once
+        mutable std::ranges::iterator_t<Range> cursor;
+        mutable size_t cursor_row = 0;
+
+        template <typename F>
+        void visit(size_t row, size_t column, F &&f) const
+        {
+            if (row < cursor_row)
+            {
+                cursor = std::ranges::begin(range);
+                cursor_row = 0;
+            }
+
+            std::ranges::advance(cursor, row - cursor_row);
+            cursor_row = row;
+
+            decltype(auto) values = *cursor;
+
+            visit(values, column, f, std::make_index_sequence<columns>());
+        }
+
+        template <typename Row, typename F, size_t... I>
+        static void visit(const Row &values, size_t column, F &f, std::index_sequence<I...>)
+        {
+            ((I == column ? (f(std::get<I>(values)), 0) : 0), ...);
+        }
+
+        template <size_t... I>
+        static bool aligned(size_t column, std::index_sequence<I...>)
+        {
+            static constexpr bool right[] = { cell_format_t<std::remove_cvref_t<std::tuple_element_t<I, row_type>>>::right_aligned... };
+
+            return right[column];
+        }
+    };
+
+    template <std::ranges::forward_range Range>
+    auto make_range_table(Range &&range, std::array<std::string, std::tuple_size_v<std::remove_cvref_t<std::ranges::range_reference_t<Range>>>> headers)
+    {
+        return range_table_t<std::views::all_t<Range>>(std::views::all(std::forward<Range>(range)), std::move(headers));
+    }
+
+    // A table of text cells kept column by column. While a column has few
+    // distinct values, as a status or region column does, its cells are codes
+    // into a dictionary that holds every value once along with its width, so
+    // a repeated value costs two bytes and is never measured again. A column
+    // whose dictionary grows past DICTIONARY_MAX_VALUES, or past
+    // DICTIONARY_MIN_VALUES while holding more than half as many values as
+    // there are rows, is turned into plain strings for good.
+    class string_table_t : public cell_table_t
+    {
+    public:
+        static constexpr size_t DICTIONARY_MIN_VALUES = 1024;
+        static constexpr size_t DICTIONARY_MAX_VALUES = 65535;
+
+        string_table_t(std::vector<std::string> headers, int props = TABLE_BORDER_VERT | TABLE_HEADER_BORDER, const borders_t &b = modern_borders);
+
+        // takes one cell per column, missing ones are empty
+        void append_row(std::span<const std::string_view> cells);
+        void append_row(std::initializer_list<std::string_view> cells);
+        void reserve(size_t rows);
+
+        bool dictionary_encoded(size_t column) const;
+
+        // the distinct values of a column, 0 once it holds plain strings
+        size_t dictionary_size(size_t column) const;
+
+        // bytes held by the cells, their dictionaries and offsets
+        size_t memory_bytes() const;
+
+        size_t row_count() const override
+        {
+            return rows + 1;
+        }
+
+        size_t column_count() const override
+        {
+            return headers.size();
+        }
+
+        size_t cell_width(size_t row, size_t column) const override;
+        void write_cell(size_t row, size_t column, std::string &out) const override;
+        size_t column_width(size_t column) const override;
+
+    private:
+        struct string_column_t
+        {
+            bool encoded = true;
+            size_t width = 0;
+
+            // encoded: a code per row, the values one after another with where
+            // each ends and its width, and an open addressing table of code + 1
+            // by the hash of the value, 0 being a free slot
+            std::vector<uint16_t> codes;
+            std::string values;
+            std::vector<uint32_t> value_ends;
+            std::vector<uint32_t> value_widths;
+            std::vector<uint16_t> slots;
+
+            // plain: the cells one after another and where each ends
+            std::string data;
+            std::vector<size_t> ends;
+
+            std::string_view value(size_t code) const
+            {
+                size_t start = code > 0 ? value_ends[code - 1] : 0;
+
+                return std::string_view(values).substr(start, value_ends[code] - start);
+            }
+        };
+
+        std::vector<std::string> headers;
+        std::vector<string_column_t> columns;
+        size_t rows = 0;
+
+        std::string_view cell(size_t row, size_t column) const;
+        void append(string_column_t &column, std::string_view cell);
+        void grow_slots(string_column_t &column);
+        void decode(string_column_t &column);
+    };
+
+    // Table storage for more rows than fit in memory. Rows are gathered into
+    // chunks that are written to an unlinked temporary file once full, and
+    // mapped back in while they are read, with the least recently used chunk
+    // unmapped once the mappings would go over the memory limit. Only the chunk
+    // index and the width of every column stay in memory, so rendering the
+    // whole table, or any window of it, needs no column measuring pass.
+    class spill_table_t : public cell_table_t
+    {
+    public:
+        struct memory_stats_t
+        {
+            size_t limit = 0;
+            size_t rows = 0;
+            size_t chunks = 0;
+            size_t file_bytes = 0;
+
+            // the chunk being filled, chunks mapped in for reading and the chunk index
+            size_t buffered_bytes = 0;
+            size_t mapped_bytes = 0;
+            size_t index_bytes = 0;
+        };
+
+        // Returns nullptr if the temporary file cannot be created. It goes in
+        // $TMPDIR, or /tmp when that is not set.
+        static std::shared_ptr<spill_table_t> create(std::vector<std::string> headers, size_t memory_limit = 64 * 1024 * 1024,
+                                                     int props = TABLE_BORDER_VERT | TABLE_HEADER_BORDER, const borders_t &b = modern_borders);
+
+        ~spill_table_t();
+
+        spill_table_t(const spill_table_t &) = delete;
+        spill_table_t &operator=(const spill_table_t &) = delete;
+
+        // takes one cell per column, returns false if the chunk could not be written out
+        bool append_row(std::span<const std::string_view> cells);
+        bool append_row(std::initializer_list<std::string_view> cells);
+
+        memory_stats_t memory_stats() const;
+
+        size_t row_count() const override
+        {
+            return rows + 1;
+        }
+
+        size_t column_count() const override
+        {
+            return headers.size();
+        }
+
+        size_t cell_width(size_t row, size_t column) const override;
+        void write_cell(size_t row, size_t column, std::string &out) const override;
+        size_t column_width(size_t column) const override;
+
+    private:
+        struct chunk_t
+        {
+            uint64_t offset;
+            uint64_t size;
+            uint64_t first_row;
+        };
+
+        struct mapping_t
+        {
+            size_t chunk;
+            const char *data;
+            size_t size;
+            uint64_t last_used;
+        };
+
+        std::vector<std::string> headers;
+        std::vector<size_t> widths;
+        size_t memory_limit = 0;
+        size_t chunk_limit = 0;
+        size_t rows = 0;
+        int fd = -1;
+        uint64_t file_size = 0;
+        std::vector<chunk_t> chunks;
+
+        // the chunk being filled: cell offsets into its data, starting with 0
+        std::vector<uint32_t> open_offsets;
+        std::string open_data;
+        size_t open_first_row = 0;
+
+        mutable std::vector<mapping_t> mappings;
+        mutable size_t mapped_bytes = 0;
+        mutable uint64_t clock = 0;
+
+        spill_table_t(int props, const borders_t &b)
+            : cell_table_t(props, b)
+        {
+        }
+
+        bool flush();
+        std::string_view cell(size_t row, size_t column) const;
+        const char *map_chunk(size_t index) const;
+    };
+
+    // A table that any number of threads can push rows to while a thread of
+    // its own keeps the last rows drawn in place on the terminal. Pushing a
+    // row only links it onto a lock-free list, so producers never wait for
+    // rendering. At most max_fps times a second the render thread takes the
+    // whole list in one exchange, stores its rows and redraws, so a frame
+    // never shows part of a row. Rows from one thread keep their order.
+    //
+    // The sink defaults to writing to std::cout. The cell_table_t accessors,
+    // to_string() and run() are only safe to use once stop() has returned.
+    class concurrent_table_t : public cell_table_t
+    {
+    public:
+        concurrent_table_t(std::vector<std::string> headers, size_t visible_rows = 20, int max_fps = 30, sink_t sink = nullptr,
+                           int props = TABLE_BORDER_VERT | TABLE_HEADER_BORDER, const borders_t &b = modern_borders);
+
+        ~concurrent_table_t();
+
+        concurrent_table_t(const concurrent_table_t &) = delete;
+        concurrent_table_t &operator=(const concurrent_table_t &) = delete;
+
+        // takes one cell per column, missing cells are left empty
+        void push_row(std::vector<std::string> cells);
+        void push_row(std::initializer_list<std::string_view> cells);
+
+        // draws a last frame with every row pushed so far and ends the render thread
+        void stop();
+
+        // number of frames drawn so far
+        size_t frames() const
+        {
+            return frame_count.load(std::memory_order_relaxed);
+        }
+
+        size_t row_count() const override
+        {
+            return rows.size();
+        }
+
+        size_t column_count() const override
+        {
+            return columns;
+        }
+
+        size_t cell_width(size_t row, size_t column) const override
+        {
+            return display_width(rows[row][column]);
+        }
+
+        void write_cell(size_t row, size_t column, std::string &out) const override
+        {
+            out.append(rows[row][column]);
+        }
+
+        size_t column_width(size_t column) const override
+        {
+            return widths[column];
+        }
+
+    private:
+        struct row_node_t
+        {
+            row_node_t *next;
+            std::vector<std::string> cells;
+        };
+
+        const size_t columns;
+        const size_t visible_rows;
+        const std::chrono::microseconds frame_interval;
+        sink_t sink;
+
+        // rows pushed since the last frame, newest first
+        std::atomic<row_node_t *> pending = nullptr;
+        std::atomic<size_t> frame_count = 0;
+
+        // only touched by the render thread until it has stopped
+        std::vector<std::vector<std::string>> rows;
+        std::vector<size_t> widths;
+        size_t drawn_lines = 0;
+        std::string frame;
+
+        // the lock only guards stopping, producers never take it
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+        std::thread thread;
+
+        void render_loop();
+        bool take_pending();
+        void draw();
+    };
+
+    // A table one process writes rows to and others display live, kept in a
+    // POSIX shared memory segment. The writer appends each row as one record
+    // to a fixed size ring, dropping the oldest rows once it is full, and
+    // keeps the widest cell seen in every column next to it. Rows are numbered
+    // in the order they were written and the ring has an index entry per row
+    // holding its number, so a reader can tell a row it is reading from one
+    // that has since taken its place.
+    //
+    // Opening the segment maps it and reads the header, which takes the same
+    // time however many rows were written. Readers see the rows as of their
+    // last refresh(), read the cells where they lie in the segment and take
+    // column widths from the summary, so drawing the newest rows costs only
+    // those rows. A row the writer overwrites after refresh() comes out
+    // empty. There may be one writer, and any number of readers.
+    class shared_table_t : public cell_table_t
+    {
+    public:
+        // Creates the segment under name, which is a POSIX shared memory name
+        // such as /collector, replacing one left behind by a writer that has
+        // died. It holds up to capacity bytes of records and up to max_rows
+        // rows. Returns nullptr if it cannot be created, with errno set to
+        // EEXIST when a writer that is still running has the name. The writer
+        // unlinks the segment when it goes away; readers that have it open
+        // keep it.
+        static std::shared_ptr<shared_table_t> create(const std::string &name, std::vector<std::string> headers, size_t capacity = 16 * 1024 * 1024,
+                                                      size_t max_rows = 64 * 1024, int props = TABLE_BORDER_VERT | TABLE_HEADER_BORDER,
+                                                      const borders_t &b = modern_borders);
+
+        // opens the segment for reading, nullptr if there is none or it is not a table
+        static std::shared_ptr<shared_table_t> open(const std::string &name, int props = TABLE_BORDER_VERT | TABLE_HEADER_BORDER,
+                                                    const borders_t &b = modern_borders);
+
+        ~shared_table_t();
+
+        shared_table_t(const shared_table_t &) = delete;
+        shared_table_t &operator=(const shared_table_t &) = delete;
+
+        // Takes one cell per column, missing cells are left empty. Only the
+        // writer can append, and a row that does not fit in half the ring is
+        // refused.
+        bool append_row(std::span<const std::string_view> cells);
+        bool append_row(std::initializer_list<std::string_view> cells);
+
+        // Catches up with the writer, returning how many rows were written
+        // since the last time. The writer's own view is kept up to date.
+        size_t refresh();
+
+        // true once the writer has gone away, whether it exited or crashed, and
+        // no more rows will come
+        bool finished() const;
+
+        // the number the writer gave row 1 of the table, the oldest row still there at the last refresh()
+        uint64_t first_sequence() const
+        {
+            return first;
+        }
+
+        // A cell straight from the segment, without copying it. It can be
+        // overwritten at any time, so check current() after using it.
+        std::string_view cell(size_t row, size_t column) const;
+
+        // false once the writer has overwritten the row
+        bool current(size_t row) const;
+
+        size_t row_count() const override
+        {
+            return last - first + 1;
+        }
+
+        size_t column_count() const override
+        {
+            return columns;
+        }
+
+        size_t cell_width(size_t row, size_t column) const override;
+        void write_cell(size_t row, size_t column, std::string &out) const override;
+        size_t column_width(size_t column) const override;
+
+    private:
+        struct segment_header_t;
+        struct row_entry_t;
+
+        int fd = -1;
+        void *mapping = nullptr;
+        size_t mapping_size = 0;
+        std::string name;
+        bool writer = false;
+
+        segment_header_t *header = nullptr;
+        std::atomic<uint32_t> *widths = nullptr;
+        row_entry_t *entries = nullptr;
+        char *ring = nullptr;
+        size_t columns = 0;
+        uint64_t capacity = 0;
+        uint64_t max_rows = 0;
+
+        std::vector<std::string_view> headers;
+        std::vector<size_t> header_widths;
+
+        // the rows [first, last) seen by the last refresh()
+        uint64_t first = 0;
+        uint64_t last = 0;
+
+        // where the writer puts the next record
+        uint64_t data_head = 0;
+
+        shared_table_t(int props, const borders_t &b)
+            : cell_table_t(props, b)
+        {
+        }
+
+        bool map();
+        const char *record(uint64_t sequence, uint64_t &size) const;
+    };
+
+    // A table of nested rows, such as clusters holding nodes holding
+    // processes, where a row's children are only shown while it is expanded.
+    // The first column is indented by depth and marked with whether the row
+    // can be expanded. Every row keeps the widest cell of each column over
+    // the rows shown under it, so expanding or collapsing a row only goes
+    // over the rows it shows or hides and the rows above it, and the layout
+    // never needs a measuring pass. Rows under a collapsed row are stored but
+    // not measured until they are first shown. Row 0 is the header.
+    class tree_table_t : public cell_table_t
+    {
+    public:
+        // the header, which the top level rows are added under
+        static constexpr size_t root = 0;
+        static constexpr size_t npos = SIZE_MAX;
+
+        // adds the children of a row added with load_later, the first time it is expanded
+        using loader_t = std::function<void(tree_table_t &table, size_t node)>;
+
+        tree_table_t(std::vector<std::string> headers, int props = TABLE_BORDER_VERT | TABLE_HEADER_BORDER, const borders_t &b = modern_borders);
+
+        // Adds a collapsed row after the children parent already has and
+        // returns its node. One cell per column, missing cells are left
+        // empty. A row added with load_later can be expanded before it has
+        // any children, which the loader then adds.
+        size_t add_row(size_t parent, std::span<const std::string_view> cells, bool load_later = false);
+        size_t add_row(size_t parent, std::initializer_list<std::string_view> cells, bool load_later = false);
+
+        void set_loader(loader_t loader);
+
+        void expand(size_t node);
+        void collapse(size_t node);
+
+        bool expanded(size_t node) const
+        {
+            return nodes[node].expanded;
+        }
+
+        // whether the row has children, or can load them
+        bool expandable(size_t node) const
+        {
+            return nodes[node].first_child != npos || nodes[node].load_later;
+        }
+
+        size_t parent(size_t node) const
+        {
+            return nodes[node].parent;
+        }
+
+        // the node a row shows, and the row a node is shown on, npos if there is none
+        size_t node_at(size_t row) const;
+        size_t row_of(size_t node) const;
+
+        // Draws the table on the terminal, height rows at a time, and lets the
+        // rows be browsed with the same keys as ask_select: up and down, page
+        // up and down, home and end. Right expands the selected row, or moves
+        // into it if it is expanded, left collapses it, or moves to the row it
+        // is under, and space toggles it. Enter returns the selected node,
+        // escape, q or the end of input returns npos. A height of 0 fits the
+        // table to the terminal.
+        size_t browse(size_t height = 0);
+
+        size_t row_count() const override
+        {
+            return nodes[root].shown_rows;
+        }
+
+        size_t column_count() const override
+        {
+            return columns;
+        }
+
+        size_t cell_width(size_t row, size_t column) const override;
+        void write_cell(size_t row, size_t column, std::string &out) const override;
+
+        size_t column_width(size_t column) const override
+        {
+            return summaries[column];
+        }
+
+    private:
+        struct node_t
+        {
+            size_t parent;
+            size_t first_child = npos;
+            size_t last_child = npos;
+            size_t next_sibling = npos;
+
+            // Rows taken up by this row and the rows shown under it. Like the
+            // widths in summaries, it is only kept up to date while the row is
+            // shown, and worked out again when it is shown next.
+            size_t shown_rows = 1;
+            uint32_t depth = 0;
+            bool expanded = false;
+            bool measured = false;
+            bool load_later = false;
+        };
+
+        size_t columns;
+        std::vector<node_t> nodes;
+
+        // the cells of every node one after the other, columns cells per node
+        std::string text;
+        std::vector<size_t> cell_ends;
+        std::vector<uint32_t> cell_widths;
+
+        // the widest cell in each column over a node and the rows shown under it
+        std::vector<uint32_t> summaries;
+
+        loader_t loader;
+
+        // the row browse() has selected
+        size_t selected = npos;
+
+        // rendering asks for rows in order, so the last one found leads to the next
+        mutable size_t cached_row = 0;
+        mutable size_t cached_node = root;
+
+        std::string_view cell(size_t node, size_t column) const;
+        bool shown(size_t node) const;
+        size_t next_shown(size_t node) const;
+        void show(size_t node);
+        void summarise(size_t node);
+        void resize_ancestors(size_t node, size_t old_rows);
+    };
+
+    // Progress
+
+    // A bar for a job of known size. Updates only touch relaxed atomics, so
+    // worker threads can call them from hot loops; the progress_t the bar
+    // belongs to picks up the latest values whenever it draws.
+    class progress_bar_t
+    {
+    public:
+        progress_bar_t(std::string label, uint64_t total)
+            : label(std::move(label)),
+              total(total)
+        {
+        }
+
+        void add(uint64_t n = 1)
+        {
+            done.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        void set(uint64_t n)
+        {
+            done.store(n, std::memory_order_relaxed);
+        }
+
+        uint64_t value() const
+        {
+            return done.load(std::memory_order_relaxed);
+        }
+
+        void finish()
+        {
+            finished.store(true, std::memory_order_relaxed);
+        }
+
+        const std::string label;
+        const uint64_t total;
+
+    private:
+        friend class progress_t;
+
+        std::atomic<uint64_t> done = 0;
+        std::atomic<bool> finished = false;
+    };
+
+    // A spinner for a job of unknown size, counting the steps ticked off
+    class spinner_t
+    {
+    public:
+        spinner_t(std::string label)
+            : label(std::move(label))
+        {
+        }
+
+        void tick(uint64_t n = 1)
+        {
+            ticks.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t value() const
+        {
+            return ticks.load(std::memory_order_relaxed);
+        }
+
+        void finish()
+        {
+            finished.store(true, std::memory_order_relaxed);
+        }
+
+        const std::string label;
+
+    private:
+        friend class progress_t;
+
+        std::atomic<uint64_t> ticks = 0;
+        std::atomic<bool> finished = false;
+    };
+
+    // Draws a stack of bars and spinners, one per line, from a thread of its
+    // own. However often they are updated it redraws at most max_fps times a
+    // second, going back over the previous frame with the same escape codes
+    // prompts use to erase their lines, and skips frames that would not
+    // change anything. Widgets stay valid for as long as the progress_t.
+    class progress_t
+    {
+    public:
+        using sink_t = std::function<void(std::string_view)>;
+
+        // the sink defaults to writing to std::cout
+        progress_t(int max_fps = 15, sink_t sink = nullptr);
+
+        ~progress_t();
+
+        progress_t(const progress_t &) = delete;
+        progress_t &operator=(const progress_t &) = delete;
+
+        progress_bar_t &add_bar(std::string label, uint64_t total);
+        spinner_t &add_spinner(std::string label);
+
+        // draws a last frame and ends the render thread
+        void stop();
+
+        // number of frames written so far
+        size_t frames() const
+        {
+            return frame_count.load(std::memory_order_relaxed);
+        }
+
+    private:
+        const std::chrono::microseconds frame_interval;
+        sink_t sink;
+        std::atomic<size_t> frame_count = 0;
+
+        // the lock guards the widgets and stopping, updates never take it
+        std::vector<std::variant<std::unique_ptr<progress_bar_t>, std::unique_ptr<spinner_t>>> widgets;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+        std::thread thread;
+
+        // only touched by the render thread
+        size_t drawn_lines = 0;
+        size_t spinner_frame = 0;
+        std::string lines;
+        std::string previous_lines;
+        std::string frame;
+
+        void render_loop();
+        void build_lines(size_t columns);
+        void draw();
+    };
 }
@@ -7,28 +7,35 @@
 
 using namespace libquest;
 
+struct entry_t
+{
+    std::string name;
+    std::string colour;
+    std::string text;
+    bool another = false;
+};
+
 int main(int argc, char** argv)
 {
-    questionaire_t questions =
-    {
-        new input_t {
+    auto form = make_form<entry_t>(
+        bind<&entry_t::name>(input_t {
             "What is your name?"
-        },
-        new select_t {
+        }),
+        bind<&entry_t::colour>(select_t {
             "What is your favorite color?",
             {
                 "red",
                 "green",
                 "blue"
             }
-        },
-        new multiline_t {
+        }),
+        bind<&entry_t::text>(multiline_t {
             "Write some multiline text."
-        },
-        new yesno_t {
+        }),
+        bind<&entry_t::another>(yesno_t {
             "Do you want to enter a new entry?"
-        }
-    };
+        })
+    );
 
     table_t table = 
     {
@@ -43,13 +50,14 @@ int main(int argc, char** argv)
         rounded_borders
     };
 
+    entry_t entry;
 
     do
     {
-        questions.run();
-        table.append_column(column_t { questions.answers[0], questions.answers[1], questions.answers[2] });
+        form.run(entry);
+        table.append_column(column_t { entry.name, entry.colour, entry.text });
     }
-    while(questions.answers[3] == "yes");
+    while(entry.another);
 
     table.run();
 }